@@ -0,0 +1,369 @@
+// bench.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <random>
+
+#include "defs.h"
+#include "tinyxml2.h"
+
+#include "picojson.h"
+namespace pj = picojson;
+
+extern "C" {
+	#include <libavutil/avutil.h>
+}
+
+// microbenchmarks for the cpu-bound parts: filename parsing, language guessing, stream picking,
+// tag serialisation, and the formatting/parsing helpers. every allocation through operator new is
+// counted, so each benchmark reports allocs/op alongside ns/op.
+//
+// usage: mkvtaginator-bench [--data <dir>] [filter...]
+
+static std::atomic<uint64_t> allocCount = 0;
+static std::atomic<uint64_t> allocBytes = 0;
+
+// the build uses -fvisibility=hidden, but these need to replace the ones in libstdc++ as well.
+#define EXPORT __attribute__((visibility("default")))
+
+EXPORT void* operator new(size_t sz)
+{
+	allocCount.fetch_add(1, std::memory_order_relaxed);
+	allocBytes.fetch_add(sz, std::memory_order_relaxed);
+
+	if(auto p = malloc(sz ? sz : 1); p)
+		return p;
+
+	throw std::bad_alloc();
+}
+
+EXPORT void* operator new[](size_t sz)
+{
+	return operator new(sz);
+}
+
+EXPORT void operator delete(void* p) noexcept               { free(p); }
+EXPORT void operator delete[](void* p) noexcept             { free(p); }
+EXPORT void operator delete(void* p, size_t) noexcept       { free(p); }
+EXPORT void operator delete[](void* p, size_t) noexcept     { free(p); }
+
+namespace bench
+{
+	// how long each timed run should take, and how many runs to take the median of.
+	static constexpr auto RUN_TIME = std::chrono::milliseconds(200);
+	static constexpr size_t NUM_RUNS = 5;
+
+	// keeps the optimiser from throwing away results.
+	template <typename T>
+	static void keep(const T& x)
+	{
+		asm volatile("" : : "g"(&x) : "memory");
+	}
+
+	static uint64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static std::vector<std::string> filters;
+
+	template <typename Fn>
+	static void run(const std::string& name, Fn&& fn)
+	{
+		if(!filters.empty() && std::none_of(filters.begin(), filters.end(), [&name](const std::string& f) {
+			return name.find(f) != std::string::npos;
+		}))
+		{
+			return;
+		}
+
+		// warm up, and find how many iterations fill one run.
+		size_t iters = 1;
+		while(true)
+		{
+			auto start = now_ns();
+			for(size_t i = 0; i < iters; i++)
+				fn();
+
+			if(now_ns() - start >= static_cast<uint64_t>(std::chrono::nanoseconds(RUN_TIME).count()) / 4)
+				break;
+
+			iters *= 2;
+		}
+
+		iters *= 4;
+
+		std::vector<double> times;
+		uint64_t allocs = 0;
+		uint64_t bytes = 0;
+
+		for(size_t r = 0; r < NUM_RUNS; r++)
+		{
+			auto a0 = allocCount.load();
+			auto b0 = allocBytes.load();
+			auto start = now_ns();
+
+			for(size_t i = 0; i < iters; i++)
+				fn();
+
+			times.push_back(static_cast<double>(now_ns() - start) / iters);
+
+			// the same work every run, so these should always be the same.
+			allocs = allocCount.load() - a0;
+			bytes = allocBytes.load() - b0;
+		}
+
+		std::sort(times.begin(), times.end());
+
+		zpr::println("%-40s %12.1f ns/op %10.1f allocs/op %12.1f B/op", name, times[NUM_RUNS / 2],
+			static_cast<double>(allocs) / iters, static_cast<double>(bytes) / iters);
+	}
+
+
+
+
+	static const std::vector<std::string> TV_NAMES = {
+		"Tide Runner S02E07 - Dead Reckoning",
+		"Tide.Runner.S02E07.1080p.WEB.H264-GROUP",
+		"[SubGroup] Kaze no Tani - 12 [1080p][ABCD1234]",
+		"[SubGroup] Kaze no Tani S2 - 03v2 (BD 1080p FLAC)",
+		"The Long Watch - 1x04 - Signal Fire",
+		"the_long_watch_s01e04_signal_fire",
+		"Harbour Lights E05",
+		"Harbour Lights - S01E05",
+	};
+
+	static const std::vector<std::string> MOVIE_NAMES = {
+		"Memory of the Tide (2020)",
+		"Memory.of.the.Tide.2020.1080p.BluRay.x264",
+		"Memory of the Tide",
+		"A Quiet Harbour (1998) [Remastered]",
+		"a_quiet_harbour_1998",
+	};
+
+	static const std::vector<std::string> TRACK_TITLES = {
+		"English",
+		"English (SDH)",
+		"Japanese 5.1",
+		"Commentary with the Director",
+		"Signs & Songs",
+		"Full Subtitles [Chinese Simplified]",
+		"Portuguese (Brazil)",
+		"Stereo",
+		"",
+		"eng",
+	};
+
+	static const std::vector<std::string> AUDIO_LANGS = { "jpn", "eng" };
+	static const std::vector<std::string> SUBTITLE_LANGS = { "eng" };
+
+	static const std::vector<std::string> DISPLAY_STRINGS = {
+		"Tide Runner S02E07 - Dead Reckoning",
+		"風の谷 第12話「潮の記憶」",
+		COLOUR_BLUE_BOLD "*" COLOUR_RESET " selection [1 - 12, 0 to skip]",
+		"Ünïcödé wïth àccénts — and a dash",
+	};
+
+	// a stream table in the shape of a typical anime or multi-language release; with a fixed seed,
+	// so the same tables are generated every time.
+	static std::vector<mux::FileInfo> make_stream_tables(size_t count)
+	{
+		auto rng = std::mt19937(36);
+		auto pick = [&rng](const auto& xs) -> const auto& { return xs[rng() % xs.size()]; };
+
+		static const std::vector<std::string> langs = { "eng", "jpn", "spa", "fre", "ger", "chi", "por", "" };
+		static const std::vector<std::string> audioCodecs = { "flac", "aac", "ac3", "eac3", "opus", "truehd" };
+		static const std::vector<std::string> subCodecs = { "ass", "subrip", "hdmv_pgs_subtitle", "mov_text" };
+
+		std::vector<mux::FileInfo> ret;
+		for(size_t k = 0; k < count; k++)
+		{
+			mux::FileInfo info;
+			int idx = 0;
+
+			auto add = [&info, &idx](int type, const std::string& codec, const std::string& lang, const std::string& title) {
+				mux::StreamInfo si;
+				si.index = idx++;
+				si.type = type;
+				si.codec = codec;
+				si.lang = lang;
+				si.title = title;
+				info.streams.push_back(si);
+			};
+
+			add(AVMEDIA_TYPE_VIDEO, "hevc", "", "");
+
+			for(size_t i = 0, n = 1 + rng() % 4; i < n; i++)
+				add(AVMEDIA_TYPE_AUDIO, pick(audioCodecs), pick(langs), pick(TRACK_TITLES));
+
+			for(size_t i = 0, n = 2 + rng() % 12; i < n; i++)
+				add(AVMEDIA_TYPE_SUBTITLE, pick(subCodecs), pick(langs), pick(TRACK_TITLES));
+
+			for(size_t i = 0, n = rng() % 8; i < n; i++)
+				add(AVMEDIA_TYPE_ATTACHMENT, "ttf", "", zpr::sprint("font%d.ttf", i));
+
+			ret.push_back(std::move(info));
+		}
+
+		return ret;
+	}
+
+	static tag::MovieMetadata make_movie()
+	{
+		tag::MovieMetadata ret;
+		ret.valid = true;
+		ret.id = "501234";
+		ret.title = "Memory of the Tide";
+		ret.originalTitle = "潮の記憶";
+		ret.airDate = "2020-11-13";
+		ret.year = 2020;
+		ret.synopsis = std::string(400, 'x');
+
+		for(int i = 0; i < 20; i++)
+			ret.cast.push_back({ zpr::sprint("Actor %d", i), zpr::sprint("Character %d", i) });
+
+		ret.genres = { "Drama", "Science Fiction", "Thriller" };
+		ret.writers = { "Writer One", "Writer Two" };
+		ret.directors = { "Director One" };
+		ret.producers = { "Producer One", "Producer Two", "Producer Three" };
+		ret.productionStudios = { "Studio One", "Studio Two" };
+
+		return ret;
+	}
+
+	static tag::EpisodeMetadata make_episode()
+	{
+		tag::EpisodeMetadata ret;
+		ret.valid = true;
+		ret.id = "7100007";
+		ret.name = "Dead Reckoning";
+		ret.airDate = "2021-01-08";
+		ret.seasonNumber = 2;
+		ret.episodeNumber = 7;
+		ret.synopsis = std::string(300, 'x');
+		ret.description = std::string(600, 'x');
+
+		ret.seriesMeta.valid = true;
+		ret.seriesMeta.id = "360000";
+		ret.seriesMeta.name = "Tide Runner";
+		ret.seriesMeta.airDate = "2019-04-01";
+		ret.seriesMeta.genres = { "Drama", "Science-Fiction", "Adventure" };
+
+		for(int i = 0; i < 12; i++)
+			ret.actors.push_back(zpr::sprint("Actor %d", i));
+
+		ret.writers = { "Writer One", "Writer Two" };
+		ret.directors = { "Director One" };
+
+		return ret;
+	}
+
+	static std::string read_file(const std::string& path)
+	{
+		auto [ buf, sz ] = util::readEntireFile(path);
+		if(!buf)
+		{
+			util::error("failed to read '%s'", path);
+			exit(1);
+		}
+
+		auto ret = std::string(reinterpret_cast<char*>(buf), sz);
+		delete[] buf;
+
+		return ret;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	using namespace bench;
+
+	std::string dataDir = "bench/data";
+	for(int i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "--data") && i + 1 < argc)
+			dataDir = argv[++i];
+
+		else
+			filters.push_back(argv[i]);
+	}
+
+	zpr::println("%-40s %17s %20s %17s", "benchmark", "time", "allocations", "bytes");
+
+	run("nameparser/tv", []() {
+		for(const auto& n : TV_NAMES)
+			keep(tag::parseTVShow(n));
+	});
+
+	run("nameparser/movie", []() {
+		for(const auto& n : MOVIE_NAMES)
+			keep(tag::parseMovie(n));
+	});
+
+	run("lang/guess-title", []() {
+		for(const auto& t : TRACK_TITLES)
+			keep(misc::guessLanguageFromTitle(AUDIO_LANGS, t));
+	});
+
+	{
+		auto tables = make_stream_tables(64);
+		run("mux/pick-streams", [&tables]() {
+			for(const auto& info : tables)
+			{
+				std::vector<const mux::StreamInfo*> selected;
+				std::vector<const mux::StreamInfo*> video;
+				std::vector<const mux::StreamInfo*> audio;
+				std::vector<const mux::StreamInfo*> subs;
+				mux::StreamLangMap audioLangs;
+				mux::StreamLangMap subLangs;
+
+				mux::pickStreams(info, AUDIO_LANGS, SUBTITLE_LANGS, selected, video, audio, subs, audioLangs, subLangs);
+				keep(selected);
+				keep(audio);
+				keep(subs);
+			}
+		});
+	}
+
+	{
+		auto movie = make_movie();
+		run("tags/serialise-movie", [&movie]() {
+			auto xml = tag::serialiseMetadata(movie);
+			keep(xml);
+			delete xml;
+		});
+
+		auto episode = make_episode();
+		run("tags/serialise-episode", [&episode]() {
+			auto xml = tag::serialiseMetadata(episode);
+			keep(xml);
+			delete xml;
+		});
+	}
+
+	run("util/displayed-text-length", []() {
+		for(const auto& s : DISPLAY_STRINGS)
+			keep(util::displayedTextLength(s));
+	});
+
+	run("zpr/sprint", []() {
+		keep(zpr::sprint("%s %s*%s %2d%s: %s%s%s - %s", "  ", COLOUR_BLUE_BOLD, COLOUR_RESET, 12, " (eng)",
+			COLOUR_BLACK_BOLD, "flac", COLOUR_RESET, "Commentary with the Director"));
+		keep(zpr::sprint("%.1f MB, %d writes, avg latency %.2f ms", 1234.5, 4096, 0.87));
+	});
+
+	for(auto name : { "tvdb-search", "tvdb-episodes", "tvmaze-show", "moviedb-movie", "moviedb-credits" })
+	{
+		auto json = read_file(zpr::sprint("%s/%s.json", dataDir, name));
+		run(zpr::sprint("picojson/%s", name), [&json]() {
+			pj::value v;
+			auto err = pj::parse(v, json);
+			keep(v);
+			keep(err);
+		});
+	}
+}
@@ -0,0 +1,460 @@
+// corpus.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <random>
+
+#include "defs.h"
+
+extern "C" {
+	#include <libavutil/avutil.h>
+	#include <libavutil/channel_layout.h>
+	#include <libavformat/avformat.h>
+}
+
+// generates a corpus of synthetic episodes for the end-to-end benchmark (see bench/e2e.py). the payloads
+// are junk, but the container is real: a video stream, several audio and subtitle languages (some
+// without language tags, so they have to be guessed from the title), font attachments, and for every
+// episode, a matching file in the extra-subs folder. the output only depends on the options and seed.
+//
+// usage: mkvtaginator-corpus [options] <output dir>
+//   --episodes <n>     number of episodes (default: 24)
+//   --movies <n>       number of movies, in <output dir>/movies (default: 0)
+//   --size <mb>        approximate size of each file (default: 64)
+//   --duration <s>     length of each file (default: 120)
+//   --seed <n>         (default: 1)
+
+namespace corpus
+{
+	static constexpr int FPS = 24;
+	static constexpr int AUDIO_PACKET_MS = 32;
+	static constexpr int SUBTITLE_INTERVAL_MS = 4000;
+	static constexpr int KEYFRAME_INTERVAL = 48;
+
+	// 1ms ticks, which is what matroska uses anyway.
+	static constexpr AVRational TIME_BASE = { 1, 1000 };
+
+	struct Options
+	{
+		std::string outdir;
+		int episodes = 24;
+		int movies = 0;
+		int sizeMB = 64;
+		int duration = 120;
+		uint32_t seed = 1;
+	};
+
+	struct Track
+	{
+		AVMediaType type;
+		AVCodecID codec;
+		std::string lang;
+		std::string title;
+
+		// for attachments
+		std::string filename;
+		size_t attachmentSize = 0;
+	};
+
+	struct Series
+	{
+		std::string name;
+		int seasons;
+
+		// fansub-style names have no season number, eg. '[Group] Series - 03 [1080p].mkv'
+		bool fansub;
+	};
+
+	static const std::vector<Series> SERIES = {
+		{ "Tide Runner", 2, false },
+		{ "Harbour Lights", 3, false },
+		{ "The Long Watch", 1, false },
+		{ "Kaze no Tani", 1, true },
+	};
+
+	static const std::vector<std::string> MOVIES = {
+		"Memory of the Tide (2020)",
+		"A Quiet Harbour (1998)",
+		"Signal Fire (2011)",
+		"The Undertow (2016)",
+	};
+
+	static const char* ASS_HEADER =
+		"[Script Info]\n"
+		"ScriptType: v4.00+\n"
+		"PlayResX: 1920\n"
+		"PlayResY: 1080\n"
+		"\n"
+		"[V4+ Styles]\n"
+		"Format: Name, Fontname, Fontsize, PrimaryColour, SecondaryColour, OutlineColour, BackColour, Bold, Italic, "
+		"Underline, StrikeOut, ScaleX, ScaleY, Spacing, Angle, BorderStyle, Outline, Shadow, Alignment, MarginL, "
+		"MarginR, MarginV, Encoding\n"
+		"Style: Default,Harbour Sans,64,&H00FFFFFF,&H000000FF,&H00000000,&H00000000,0,0,0,0,100,100,0,0,1,3,0,2,"
+		"40,40,40,1\n"
+		"\n"
+		"[Events]\n"
+		"Format: Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text\n";
+
+	static std::vector<Track> episode_tracks(std::mt19937& rng)
+	{
+		std::vector<Track> ret;
+		ret.push_back({ AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_MPEG4, "", "" });
+
+		ret.push_back({ AVMEDIA_TYPE_AUDIO, AV_CODEC_ID_PCM_S16LE, "jpn", "Japanese 2.0" });
+		ret.push_back({ AVMEDIA_TYPE_AUDIO, AV_CODEC_ID_PCM_S16LE, "eng", "English 2.0" });
+
+		// sometimes there's commentary, and sometimes the tags are just missing.
+		if(rng() % 3 == 0)
+			ret.push_back({ AVMEDIA_TYPE_AUDIO, AV_CODEC_ID_PCM_S16LE, "eng", "Commentary with the Director" });
+
+		if(rng() % 4 == 0)
+			ret.push_back({ AVMEDIA_TYPE_AUDIO, AV_CODEC_ID_PCM_S16LE, "", "Spanish (Latin America)" });
+
+		ret.push_back({ AVMEDIA_TYPE_SUBTITLE, AV_CODEC_ID_ASS, "eng", "Full Subtitles" });
+		ret.push_back({ AVMEDIA_TYPE_SUBTITLE, AV_CODEC_ID_ASS, "eng", "Signs & Songs" });
+		ret.push_back({ AVMEDIA_TYPE_SUBTITLE, AV_CODEC_ID_SUBRIP, "", "English (SDH)" });
+		ret.push_back({ AVMEDIA_TYPE_SUBTITLE, AV_CODEC_ID_SUBRIP, "spa", "Español" });
+		ret.push_back({ AVMEDIA_TYPE_SUBTITLE, AV_CODEC_ID_SUBRIP, "", "Portuguese (Brazil)" });
+
+		for(int i = 0, n = 2 + rng() % 4; i < n; i++)
+		{
+			Track t { AVMEDIA_TYPE_ATTACHMENT, AV_CODEC_ID_TTF, "", "" };
+			t.filename = zpr::sprint("HarbourSans-%d.ttf", i);
+			t.attachmentSize = 32 * 1024 + rng() % (256 * 1024);
+			ret.push_back(t);
+		}
+
+		return ret;
+	}
+
+	// what goes in the extra-subs folder: just the full subs and the signs, plus the fonts they need.
+	static std::vector<Track> extra_sub_tracks(std::mt19937& rng)
+	{
+		std::vector<Track> ret;
+		ret.push_back({ AVMEDIA_TYPE_SUBTITLE, AV_CODEC_ID_ASS, "eng", "Full Subtitles (Retimed)" });
+		ret.push_back({ AVMEDIA_TYPE_SUBTITLE, AV_CODEC_ID_ASS, "eng", "Signs & Songs (Retimed)" });
+
+		for(int i = 0, n = 1 + rng() % 3; i < n; i++)
+		{
+			Track t { AVMEDIA_TYPE_ATTACHMENT, AV_CODEC_ID_TTF, "", "" };
+			t.filename = zpr::sprint("RetimedSans-%d.ttf", i);
+			t.attachmentSize = 32 * 1024 + rng() % (128 * 1024);
+			ret.push_back(t);
+		}
+
+		return ret;
+	}
+
+	static bool set_extradata(AVCodecParameters* par, const void* data, size_t size)
+	{
+		par->extradata = static_cast<uint8_t*>(av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE));
+		if(!par->extradata)
+			return false;
+
+		memcpy(par->extradata, data, size);
+		par->extradata_size = static_cast<int>(size);
+		return true;
+	}
+
+	static bool write_file(const std::fs::path& path, const std::vector<Track>& tracks, int durationMs, size_t targetBytes,
+		std::mt19937& rng, const std::vector<uint8_t>& noise)
+	{
+		AVFormatContext* ctx = 0;
+		if(avformat_alloc_output_context2(&ctx, nullptr, "matroska", path.string().c_str()) < 0 || !ctx)
+		{
+			util::error("failed to create output context for '%s'", path.string());
+			return false;
+		}
+
+		defer(avformat_free_context(ctx));
+
+		size_t audioBytesPerPacket = 48 * AUDIO_PACKET_MS * 2 * sizeof(int16_t);
+		size_t audioBytes = 0;
+		size_t numVideo = 0;
+
+		for(const auto& t : tracks)
+		{
+			auto strm = avformat_new_stream(ctx, nullptr);
+			auto par = strm->codecpar;
+
+			strm->time_base = TIME_BASE;
+			par->codec_type = t.type;
+			par->codec_id = t.codec;
+
+			if(!t.lang.empty())
+				av_dict_set(&strm->metadata, "language", t.lang.c_str(), 0);
+
+			if(!t.title.empty())
+				av_dict_set(&strm->metadata, "title", t.title.c_str(), 0);
+
+			if(t.type == AVMEDIA_TYPE_VIDEO)
+			{
+				par->width = 1920;
+				par->height = 1080;
+				strm->avg_frame_rate = AVRational { FPS, 1 };
+				numVideo += 1;
+			}
+			else if(t.type == AVMEDIA_TYPE_AUDIO)
+			{
+				par->sample_rate = 48000;
+				par->bits_per_coded_sample = 16;
+				av_channel_layout_default(&par->ch_layout, 2);
+
+				audioBytes += audioBytesPerPacket * (durationMs / AUDIO_PACKET_MS);
+			}
+			else if(t.type == AVMEDIA_TYPE_SUBTITLE && t.codec == AV_CODEC_ID_ASS)
+			{
+				set_extradata(par, ASS_HEADER, strlen(ASS_HEADER));
+			}
+			else if(t.type == AVMEDIA_TYPE_ATTACHMENT)
+			{
+				// not a real font, but nothing here looks inside it.
+				std::vector<uint8_t> font(t.attachmentSize);
+				for(size_t i = 0; i < font.size(); i++)
+					font[i] = noise[(i * 7) % noise.size()];
+
+				set_extradata(par, font.data(), font.size());
+				av_dict_set(&strm->metadata, "filename", t.filename.c_str(), 0);
+				av_dict_set(&strm->metadata, "mimetype", "font/ttf", 0);
+			}
+		}
+
+		if(avio_open(&ctx->pb, path.string().c_str(), AVIO_FLAG_WRITE) < 0)
+		{
+			util::error("failed to open '%s' for writing", path.string());
+			return false;
+		}
+
+		defer(avio_closep(&ctx->pb));
+
+		if(avformat_write_header(ctx, nullptr) < 0)
+		{
+			util::error("failed to write header for '%s'", path.string());
+			return false;
+		}
+
+		// whatever isn't audio goes to the video; keyframes are much bigger than the rest.
+		size_t numFrames = static_cast<size_t>(durationMs) * FPS / 1000;
+		size_t videoBytes = targetBytes > audioBytes ? targetBytes - audioBytes : numFrames * 1024;
+		size_t frameBytes = numVideo > 0 && numFrames > 0 ? videoBytes / (numVideo * numFrames) : 0;
+
+		AVPacket* pkt = av_packet_alloc();
+		defer(av_packet_free(&pkt));
+
+		auto write = [&](int stream, int64_t pts, int64_t duration, const uint8_t* data, size_t size, bool key) -> bool {
+			if(av_new_packet(pkt, static_cast<int>(size)) < 0)
+				return false;
+
+			memcpy(pkt->data, data, size);
+			pkt->stream_index = stream;
+			pkt->pts = pkt->dts = av_rescale_q(pts, TIME_BASE, ctx->streams[stream]->time_base);
+			pkt->duration = av_rescale_q(duration, TIME_BASE, ctx->streams[stream]->time_base);
+			pkt->flags = key ? AV_PKT_FLAG_KEY : 0;
+
+			return av_interleaved_write_frame(ctx, pkt) >= 0;
+		};
+
+		auto noise_at = [&noise, &rng](size_t size) -> const uint8_t* {
+			assert(size <= noise.size() / 2);
+			return noise.data() + (rng() % (noise.size() - size));
+		};
+
+		bool ok = true;
+		int line = 0;
+
+		// step through the timeline one audio packet at a time, and emit whatever else is due.
+		int64_t nextFrame = 0;
+		int64_t nextSub = 1000;
+
+		for(int64_t t = 0; ok && t < durationMs; t += AUDIO_PACKET_MS)
+		{
+			for(size_t i = 0; ok && i < tracks.size(); i++)
+			{
+				if(tracks[i].type == AVMEDIA_TYPE_AUDIO)
+					ok = write(static_cast<int>(i), t, AUDIO_PACKET_MS, noise_at(audioBytesPerPacket), audioBytesPerPacket, true);
+			}
+
+			while(ok && nextFrame * 1000 / FPS < t + AUDIO_PACKET_MS)
+			{
+				bool key = (nextFrame % KEYFRAME_INTERVAL == 0);
+
+				// keyframes are ~8x the size of the others, with the total staying about the same.
+				auto size = key
+					? std::min(noise.size() / 2, frameBytes * 8)
+					: std::min(noise.size() / 2, frameBytes * (KEYFRAME_INTERVAL - 8) / (KEYFRAME_INTERVAL - 1));
+
+				size = std::max(size_t(16), size - size / 8 + rng() % (size / 4 + 1));
+
+				for(size_t i = 0; ok && i < tracks.size(); i++)
+				{
+					if(tracks[i].type == AVMEDIA_TYPE_VIDEO)
+						ok = write(static_cast<int>(i), nextFrame * 1000 / FPS, 1000 / FPS, noise_at(size), size, key);
+				}
+
+				nextFrame += 1;
+			}
+
+			if(ok && nextSub < t + AUDIO_PACKET_MS)
+			{
+				line += 1;
+				for(size_t i = 0; ok && i < tracks.size(); i++)
+				{
+					if(tracks[i].type != AVMEDIA_TYPE_SUBTITLE)
+						continue;
+
+					// matroska wants ass events without the timestamps; srt is just the text.
+					auto text = tracks[i].codec == AV_CODEC_ID_ASS
+						? zpr::sprint("%d,0,Default,,0,0,0,,%s line %d", line, tracks[i].title, line)
+						: zpr::sprint("%s line %d", tracks[i].title, line);
+
+					ok = write(static_cast<int>(i), nextSub, SUBTITLE_INTERVAL_MS / 2,
+						reinterpret_cast<const uint8_t*>(text.data()), text.size(), true);
+				}
+
+				nextSub += SUBTITLE_INTERVAL_MS;
+			}
+		}
+
+		if(!ok)
+		{
+			util::error("failed to write packets to '%s'", path.string());
+			return false;
+		}
+
+		if(av_write_trailer(ctx) < 0)
+		{
+			util::error("failed to write trailer for '%s'", path.string());
+			return false;
+		}
+
+		return true;
+	}
+
+	static std::vector<std::pair<std::string, std::string>> episode_names(int count)
+	{
+		// { input name, extra-subs name }
+		std::vector<std::pair<std::string, std::string>> ret;
+
+		std::vector<int> next(SERIES.size(), 0);
+		for(int i = 0; i < count; i++)
+		{
+			auto k = i % SERIES.size();
+			auto& series = SERIES[k];
+
+			// 12 episodes a season, then wrap around.
+			int n = next[k]++;
+			int season = 1 + (n / 12) % series.seasons;
+			int episode = 1 + n % 12 + 12 * (n / (12 * series.seasons));
+
+			if(series.fansub)
+			{
+				ret.push_back({
+					zpr::sprint("[Harbour] %s - %02d [1080p][%08X].mkv", series.name, episode, 0x1234567u * (i + 1)),
+					zpr::sprint("%s - %02d.mkv", series.name, episode)
+				});
+			}
+			else
+			{
+				ret.push_back({
+					zpr::sprint("%s S%02dE%02d - Chapter %d.mkv", series.name, season, episode, episode),
+					zpr::sprint("%s S%02dE%02d.mkv", series.name, season, episode)
+				});
+			}
+		}
+
+		return ret;
+	}
+
+	static bool generate(const Options& opts)
+	{
+		auto rng = std::mt19937(opts.seed);
+
+		// one block of junk, that all the packets are sliced from.
+		std::vector<uint8_t> noise(8 * 1024 * 1024);
+		for(auto& b : noise)
+			b = static_cast<uint8_t>(rng());
+
+		auto outdir = std::fs::path(opts.outdir);
+		auto subsdir = outdir / "extra-subs";
+		auto moviedir = outdir / "movies";
+
+		std::error_code ec;
+		std::fs::create_directories(subsdir, ec);
+		if(opts.movies > 0)
+			std::fs::create_directories(moviedir, ec);
+
+		if(ec)
+		{
+			util::error("failed to create '%s': %s", outdir.string(), ec.message());
+			return false;
+		}
+
+		auto durationMs = opts.duration * 1000;
+		auto targetBytes = static_cast<size_t>(opts.sizeMB) * 1024 * 1024;
+
+		size_t total = 0;
+		for(const auto& [ name, subname ] : episode_names(opts.episodes))
+		{
+			if(!write_file(outdir / name, episode_tracks(rng), durationMs, targetBytes, rng, noise))
+				return false;
+
+			if(!write_file(subsdir / subname, extra_sub_tracks(rng), durationMs, 0, rng, noise))
+				return false;
+
+			total += util::getFileSize((outdir / name).string());
+			util::log("%s", name);
+		}
+
+		for(int i = 0; i < opts.movies; i++)
+		{
+			auto name = zpr::sprint("%s.mkv", MOVIES[i % MOVIES.size()]);
+			if(i >= static_cast<int>(MOVIES.size()))
+				name = zpr::sprint("%s (Part %d).mkv", MOVIES[i % MOVIES.size()], 1 + i / MOVIES.size());
+
+			if(!write_file(moviedir / name, episode_tracks(rng), durationMs, targetBytes, rng, noise))
+				return false;
+
+			total += util::getFileSize((moviedir / name).string());
+			util::log("%s", name);
+		}
+
+		util::info("wrote %d %s (%.1f MB) to '%s'", opts.episodes + opts.movies,
+			util::plural("file", opts.episodes + opts.movies), total / (1024.0 * 1024.0), outdir.string());
+
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	corpus::Options opts;
+
+	auto get_int = [&](int& i) -> int {
+		if(i + 1 >= argc)
+		{
+			util::error("expected a number after '%s'", argv[i]);
+			exit(1);
+		}
+
+		return std::stoi(argv[++i]);
+	};
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "--episodes"))      opts.episodes = get_int(i);
+		else if(!strcmp(argv[i], "--movies"))   opts.movies = get_int(i);
+		else if(!strcmp(argv[i], "--size"))     opts.sizeMB = get_int(i);
+		else if(!strcmp(argv[i], "--duration")) opts.duration = get_int(i);
+		else if(!strcmp(argv[i], "--seed"))     opts.seed = static_cast<uint32_t>(get_int(i));
+		else                                    opts.outdir = argv[i];
+	}
+
+	if(opts.outdir.empty())
+	{
+		util::error("usage: %s [--episodes n] [--movies n] [--size mb] [--duration s] [--seed n] <output dir>", argv[0]);
+		return 1;
+	}
+
+	av_log_set_level(AV_LOG_ERROR);
+	return corpus::generate(opts) ? 0 : 1;
+}
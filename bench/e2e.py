@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+# e2e.py
+# Copyright (c) 2022, zhiayang
+# SPDX-License-Identifier: Apache-2.0
+
+# end-to-end batch benchmark: generates a synthetic corpus (mkvtaginator-corpus), starts the mock
+# metadata server (mock_server.py), then muxes and tags the whole corpus in one run, the way a real
+# batch would be run. reports files/s and MB/s, and the per-stage breakdown from --stats-json.
+#
+# usage: e2e.py [options] [-- extra mkvtaginator args]
+# the corpus is kept in the work directory and only regenerated if the options change, so repeated
+# runs only measure mkvtaginator.
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import mock_server
+
+
+def generate_corpus(args, corpus_dir):
+	stamp_path = os.path.join(corpus_dir, ".options")
+	stamp = f"{args.episodes} {args.movies} {args.size} {args.duration} {args.seed}"
+
+	if os.path.exists(stamp_path) and open(stamp_path).read() == stamp:
+		return
+
+	shutil.rmtree(corpus_dir, ignore_errors=True)
+
+	print(f"generating corpus in '{corpus_dir}'...", file=sys.stderr)
+	subprocess.run([ args.corpus_tool, "--episodes", str(args.episodes), "--movies", str(args.movies),
+		"--size", str(args.size), "--duration", str(args.duration), "--seed", str(args.seed), corpus_dir ], check=True)
+
+	with open(stamp_path, "w") as f:
+		f.write(stamp)
+
+
+def list_mkvs(folder):
+	if not os.path.isdir(folder):
+		return []
+
+	return sorted(os.path.join(folder, f) for f in os.listdir(folder) if f.endswith(".mkv"))
+
+
+def run_batch(args, workdir, files, base_url, stats_path, extra):
+	cmd = [ os.path.abspath(args.binary),
+		"--mux", "--tag", "--no-progress", "--no-auto-cover",
+		"--audio-langs", "jpn,eng", "--subtitle-langs", "eng",
+		"--moviedb-api", "bench",
+		"--api-base-url", base_url,
+		"--stats-json", stats_path,
+	] + extra + files
+
+	# the config file is only looked for in $HOME and the current directory, so make sure
+	# we get ours and not the user's.
+	env = dict(os.environ, HOME=workdir)
+
+	start = time.monotonic()
+	proc = subprocess.run(cmd, cwd=workdir, env=env, stdin=subprocess.DEVNULL,
+		stdout=subprocess.DEVNULL if not args.verbose else None, stderr=subprocess.DEVNULL if not args.verbose else None)
+
+	return time.monotonic() - start, proc.returncode
+
+
+def main():
+	ap = argparse.ArgumentParser(description="end-to-end batch benchmark")
+	ap.add_argument("--binary", default="build/mkvtaginator")
+	ap.add_argument("--corpus-tool", default="build/mkvtaginator-corpus")
+	ap.add_argument("--workdir", default="build/e2e")
+	ap.add_argument("--episodes", type=int, default=24)
+	ap.add_argument("--movies", type=int, default=4)
+	ap.add_argument("--size", type=int, default=64, help="approximate size of each file, in MB")
+	ap.add_argument("--duration", type=int, default=120, help="length of each file, in seconds")
+	ap.add_argument("--seed", type=int, default=1)
+	ap.add_argument("--latency", type=float, default=20, help="mock server latency, in ms")
+	ap.add_argument("--jitter", type=float, default=5, help="mock server latency jitter, in ms")
+	ap.add_argument("--rate-429", type=float, default=0, help="fraction of requests the mock server rate-limits")
+	ap.add_argument("--verbose", action="store_true", help="show mkvtaginator's output")
+
+	argv = sys.argv[1:]
+	extra = []
+	if "--" in argv:
+		extra = argv[argv.index("--") + 1:]
+		argv = argv[:argv.index("--")]
+
+	args = ap.parse_args(argv)
+
+	workdir = os.path.abspath(args.workdir)
+	corpus_dir = os.path.join(workdir, "corpus")
+	output_dir = os.path.join(workdir, "output")
+
+	generate_corpus(args, corpus_dir)
+
+	shutil.rmtree(output_dir, ignore_errors=True)
+	os.makedirs(output_dir)
+
+	# a clean slate every run: no stream cache or remembered selections from last time, and no prompts
+	# for picking between streams.
+	with open(os.path.join(workdir, "mkvtaginator-config.json"), "w") as f:
+		json.dump({ "options": {
+			"prefer-one-stream": False,
+			"stream-info-cache": False,
+			"output-folder": output_dir,
+		} }, f, indent=4)
+
+	server = mock_server.serve(0, args.latency, args.jitter, args.rate_429)
+	base_url = f"http://127.0.0.1:{server.server_address[1]}"
+
+	episodes = list_mkvs(corpus_dir)
+	movies = list_mkvs(os.path.join(corpus_dir, "movies"))
+
+	batches = [
+		("episodes", episodes, [ "--extra-subs-folder", os.path.join(corpus_dir, "extra-subs") ]),
+		("movies", movies, [ "--no-series" ]),
+	]
+
+	input_bytes = 0
+	total_time = 0
+	files = []
+	failed_runs = 0
+
+	for name, inputs, flags in batches:
+		if not inputs:
+			continue
+
+		stats_path = os.path.join(workdir, f"stats-{name}.json")
+		elapsed, rc = run_batch(args, workdir, inputs, base_url, stats_path, flags + extra)
+
+		total_time += elapsed
+		input_bytes += sum(os.path.getsize(f) for f in inputs)
+		failed_runs += (rc != 0)
+
+		if os.path.exists(stats_path):
+			files += json.load(open(stats_path))["files"]
+
+	server.shutdown()
+
+	if not files:
+		print("no stats were written; did mkvtaginator fail to start? (try --verbose)", file=sys.stderr)
+		sys.exit(1)
+
+	ok = sum(1 for f in files if f["ok"])
+	mb = input_bytes / (1024 * 1024)
+
+	print(f"{len(files)} files, {mb:.1f} MB in {total_time:.2f} s: "
+		+ f"{len(files) / total_time:.2f} files/s, {mb / total_time:.1f} MB/s ({ok} ok, {len(files) - ok} failed)")
+
+	counts = mock_server.Handler.counts
+	print(f"http: {counts['requests']} requests ({counts['429']} rate-limited, {counts['404']} not found)")
+
+	# per-stage totals over every file, and each stage's share of the total wall time.
+	wall = sum(f["wall_ns"] for f in files)
+	stages = {}
+	for f in files:
+		for stage, st in f["stages"].items():
+			s = stages.setdefault(stage, [ 0, 0, [] ])
+			s[0] += st["count"]
+			s[1] += st["total_ns"]
+			s[2].append(st["total_ns"])
+
+	print()
+	print(f"{'stage':<12} {'count':>8} {'total':>10} {'per file':>10} {'p95 file':>10} {'share':>7}")
+	for stage, (count, total, per_file) in sorted(stages.items(), key=lambda x: -x[1][1]):
+		per_file.sort()
+		p95 = per_file[min(len(per_file) - 1, int(len(per_file) * 0.95))]
+		print(f"{stage:<12} {count:>8} {total / 1e9:>9.2f}s {total / len(files) / 1e6:>8.1f}ms "
+			+ f"{p95 / 1e6:>8.1f}ms {100 * total / wall if wall else 0:>6.1f}%")
+
+	sys.exit(1 if failed_runs or ok < len(files) else 0)
+
+
+if __name__ == "__main__":
+	main()
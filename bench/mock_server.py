@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+# mock_server.py
+# Copyright (c) 2022, zhiayang
+# SPDX-License-Identifier: Apache-2.0
+
+# a stand-in for the tvmaze and themoviedb apis, for benchmarking without the network (or api keys).
+# point mkvtaginator at it with '--api-base-url http://127.0.0.1:<port>'; requests then arrive as
+# '/<host>/<path>', eg. '/api.tvmaze.com/search/shows?q=...'.
+#
+# every search returns exactly one result (so there's never a prompt), and everything else is generated
+# from the id in the path, so any show or movie name works. latency, jitter and rate-limiting (429s with
+# a retry-after) can be added to see how the batch behaves against a slow or unhappy server.
+
+import argparse
+import json
+import random
+import re
+import sys
+import threading
+import time
+import zlib
+
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import urlsplit, parse_qs
+
+
+def make_id(name):
+	return 1000 + zlib.crc32(name.lower().encode()) % 90000
+
+def summary(words):
+	return "<p>" + " ".join(("lorem ipsum dolor sit amet",) * words) + "</p>"
+
+
+# tvmaze
+def tvmaze_show(show_id, name=None):
+	return {
+		"id": show_id,
+		"name": name or f"Show {show_id}",
+		"premiered": "2019-04-01",
+		"genres": [ "Drama", "Science-Fiction", "Adventure" ],
+		"summary": summary(20),
+	}
+
+def tvmaze_route(path, query):
+	if path == "/search/shows":
+		name = query.get("q", [ "" ])[0].strip()
+		return [ { "score": 17.5, "show": tvmaze_show(make_id(name), name) } ]
+
+	if m := re.fullmatch(r"/shows/(\d+)", path):
+		return tvmaze_show(int(m[1]))
+
+	if m := re.fullmatch(r"/shows/(\d+)/cast", path):
+		return [ { "person": { "id": i, "name": f"Actor {i}" }, "character": { "name": f"Character {i}" } } for i in range(12) ]
+
+	if m := re.fullmatch(r"/shows/(\d+)/episodebynumber", path):
+		season = int(query.get("season", [ "1" ])[0])
+		number = int(query.get("number", [ "1" ])[0])
+		return {
+			"id": int(m[1]) * 1000 + season * 100 + number,
+			"name": f"Chapter {number}",
+			"season": season,
+			"number": number,
+			"airdate": f"2019-{1 + (number - 1) % 12:02d}-{1 + season:02d}",
+			"summary": summary(60),
+		}
+
+	if m := re.fullmatch(r"/episodes/(\d+)", path):
+		return { "id": int(m[1]), "name": "Episode", "airdate": "2019-04-01", "summary": summary(60) }
+
+	return None
+
+
+# themoviedb
+def moviedb_movie(movie_id, title=None, year=2020):
+	return {
+		"id": movie_id,
+		"title": title or f"Movie {movie_id}",
+		"original_title": title or f"Movie {movie_id}",
+		"release_date": f"{year}-11-13",
+		"overview": summary(40),
+	}
+
+def moviedb_route(path, query):
+	if path == "/3/search/movie":
+		title = query.get("query", [ "" ])[0].strip()
+		return { "page": 1, "total_results": 1, "results": [ moviedb_movie(make_id(title), title) ] }
+
+	if m := re.fullmatch(r"/3/movie/(\d+)", path):
+		movie = moviedb_movie(int(m[1]))
+		movie["genres"] = [ { "id": 18, "name": "Drama" }, { "id": 53, "name": "Thriller" } ]
+		movie["production_companies"] = [ { "id": 1, "name": "Studio One" }, { "id": 2, "name": "Studio Two" } ]
+		return movie
+
+	if m := re.fullmatch(r"/3/movie/(\d+)/credits", path):
+		crew = [ ("Director", "Director One"), ("Writer", "Writer One"), ("Producer", "Producer One"),
+			("Co-Producer", "Producer Two"), ("Executive Producer", "Producer Three") ]
+		return {
+			"id": int(m[1]),
+			"cast": [ { "name": f"Actor {i}", "character": f"Character {i}" } for i in range(20) ],
+			"crew": [ { "job": job, "name": name } for job, name in crew ],
+		}
+
+	if m := re.fullmatch(r"/3/movie/(\d+)/alternative_titles", path):
+		return { "id": int(m[1]), "titles": [ { "iso_3166_1": "US", "title": "Alternative Title", "type": "working title" } ] }
+
+	return None
+
+
+ROUTES = {
+	"api.tvmaze.com": tvmaze_route,
+	"api.themoviedb.org": moviedb_route,
+}
+
+
+class Handler(BaseHTTPRequestHandler):
+	protocol_version = "HTTP/1.1"
+
+	# set by serve()
+	latency = 0.0
+	jitter = 0.0
+	rate_429 = 0.0
+
+	lock = threading.Lock()
+	counts = { "requests": 0, "429": 0, "404": 0 }
+
+	def log_message(self, fmt, *args):
+		pass
+
+	def send_json(self, code, obj, headers={}):
+		body = json.dumps(obj).encode()
+		self.send_response(code)
+		self.send_header("Content-Type", "application/json")
+		self.send_header("Content-Length", str(len(body)))
+		for k, v in headers.items():
+			self.send_header(k, v)
+
+		self.end_headers()
+		self.wfile.write(body)
+
+	def do_GET(self):
+		delay = self.latency + random.uniform(-self.jitter, self.jitter)
+		if delay > 0:
+			time.sleep(delay)
+
+		with self.lock:
+			self.counts["requests"] += 1
+
+		if self.rate_429 > 0 and random.random() < self.rate_429:
+			with self.lock:
+				self.counts["429"] += 1
+
+			return self.send_json(429, { "status_message": "rate limited" }, { "Retry-After": "1" })
+
+		url = urlsplit(self.path)
+		host, _, path = url.path.lstrip("/").partition("/")
+
+		resp = None
+		if route := ROUTES.get(host):
+			resp = route("/" + path, parse_qs(url.query))
+
+		if resp is None:
+			with self.lock:
+				self.counts["404"] += 1
+
+			return self.send_json(404, { "status_message": f"not found: {url.path}" })
+
+		self.send_json(200, resp)
+
+
+# starts the server on a background thread, and returns it; the port is in server.server_address.
+def serve(port=0, latency_ms=0, jitter_ms=0, rate_429=0.0):
+	Handler.latency = latency_ms / 1000.0
+	Handler.jitter = jitter_ms / 1000.0
+	Handler.rate_429 = rate_429
+
+	server = ThreadingHTTPServer(("127.0.0.1", port), Handler)
+	server.daemon_threads = True
+
+	threading.Thread(target=server.serve_forever, daemon=True).start()
+	return server
+
+
+def main():
+	ap = argparse.ArgumentParser(description="mock tvmaze/themoviedb server")
+	ap.add_argument("--port", type=int, default=8765)
+	ap.add_argument("--latency", type=float, default=0, help="added latency per request, in ms")
+	ap.add_argument("--jitter", type=float, default=0, help="random +/- variation of the latency, in ms")
+	ap.add_argument("--rate-429", type=float, default=0, help="fraction of requests to answer with 429")
+	args = ap.parse_args()
+
+	server = serve(args.port, args.latency, args.jitter, args.rate_429)
+	print(f"listening on http://127.0.0.1:{server.server_address[1]}", file=sys.stderr)
+
+	try:
+		threading.Event().wait()
+	except KeyboardInterrupt:
+		pass
+
+	print(json.dumps(Handler.counts), file=sys.stderr)
+
+
+if __name__ == "__main__":
+	main()
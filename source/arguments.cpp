@@ -18,6 +18,20 @@ static constexpr const char* VERSION = "1.4.3";
 #define ARG_MANUAL_SEASON                   "--season"
 #define ARG_MANUAL_EPISODE                  "--episode"
 #define ARG_DRY_RUN                         "--dry-run"
+#define ARG_BENCH_MUX                       "--bench-mux"
+#define ARG_BENCH_MUX_OUTPUT                "--bench-mux-output"
+#define ARG_FULL_PROBE                      "--full-probe"
+#define ARG_STREAM_CACHE                    "--stream-cache"
+#define ARG_NO_STREAM_CACHE                 "--no-stream-cache"
+#define ARG_REMEMBER_SELECTIONS             "--remember-selections"
+#define ARG_LOG_JSON                        "--log-json"
+#define ARG_STATS                           "--stats"
+#define ARG_STATS_JSON                      "--stats-json"
+#define ARG_TRACE                           "--trace"
+#define ARG_PROM_FILE                       "--prom-file"
+#define ARG_API_BASE_URL                    "--api-base-url"
+#define ARG_HTTP_RECORD                     "--http-record"
+#define ARG_HTTP_REPLAY                     "--http-replay"
 #define ARG_TVDB_API_KEY                    "--tvdb-api"
 #define ARG_USE_SUBTITLE                    "--subtitles"
 #define ARG_MOVIEDB_API_KEY                 "--moviedb-api"
@@ -32,6 +46,20 @@ static constexpr const char* VERSION = "1.4.3";
 #define ARG_NO_SERIES                       "--no-series"
 #define ARG_NO_MOVIE                        "--no-movie"
 #define ARG_SUBTITLE_DELAY                  "--subtitle-delay"
+#define ARG_INTERLEAVE_DELTA                "--interleave-delta"
+#define ARG_INTERLEAVE_BUFFER               "--interleave-buffer"
+#define ARG_CHECKSUM_FILE                   "--checksum-file"
+#define ARG_SYNC_BATCH                      "--sync-batch"
+#define ARG_KEEP_PAGE_CACHE                 "--keep-page-cache"
+#define ARG_JOBS                            "--jobs"
+#define ARG_JOBS_PER_DEVICE                 "--jobs-per-device"
+#define ARG_ORDER                           "--order"
+#define ARG_MAX_MEMORY                      "--max-memory"
+#define ARG_MAX_RATE                        "--max-rate"
+#define ARG_BACKGROUND                      "--background"
+#define ARG_RESUME                          "--resume"
+#define ARG_JOURNAL                         "--journal"
+#define ARG_CHECKPOINT_INTERVAL             "--checkpoint-interval"
 #define ARG_PREFER_SDH_SUBS                 "--prefer-sdh-subs"
 #define ARG_PREFER_TEXT_SUBS                "--prefer-text-subs"
 #define ARG_PREFER_ENGLISH_TITLE            "--prefer-eng-title"
@@ -82,6 +110,64 @@ static void setupMap()
 		"number of seconds (eg. +0.1, -1.7) to delay the subtitles by (applies to both embedded subtitles and the extra-subs input)"
 	});
 
+	helpList.push_back({ ARG_INTERLEAVE_DELTA + std::string(" <seconds>"),
+		"when muxing, write out packets that are this far behind the newest one, even if a stream has nothing queued yet (default 10, 0 for no limit)"
+	});
+
+	helpList.push_back({ ARG_INTERLEAVE_BUFFER + std::string(" <MB>"),
+		"when muxing, hold back at most this much packet data for interleaving (default 64, 0 for no limit)"
+	});
+
+	helpList.push_back({ ARG_CHECKSUM_FILE,
+		"after muxing, write the crc32c of each verified output next to it, as '<output>.crc32c' (not when tagging, which changes the file)"
+	});
+
+	helpList.push_back({ ARG_SYNC_BATCH + std::string(" <n>"),
+		"outputs are written under a temporary name, then synced and given their real name this many at a time (default 16, 0 for all at the end)"
+	});
+
+	helpList.push_back({ ARG_KEEP_PAGE_CACHE,
+		"keep finished inputs and outputs in the page cache, instead of evicting them to make room for other things"
+	});
+
+	helpList.push_back({ ARG_JOBS + std::string(" <n>"),
+		"process up to this many files at once (default 1); the log is then printed one whole file at a time"
+	});
+
+	helpList.push_back({ ARG_JOBS_PER_DEVICE + std::string(" <n>"),
+		"with " ARG_JOBS ", let at most this many files use the same disk (input or output) at once (default 1, 0 for no limit)"
+	});
+
+	helpList.push_back({ ARG_ORDER + std::string(" <order>"),
+		"process files in the 'given' order (default), by 'physical' location on disk (less seeking on hard disks), "
+		"or by 'size' (smallest first) or 'size-desc' (largest first)"
+	});
+
+	helpList.push_back({ ARG_MAX_MEMORY + std::string(" <size>"),
+		"with " ARG_JOBS ", only start another file while the memory in use (estimated) stays under this, eg. '2G' (default 0, no limit)"
+	});
+
+	helpList.push_back({ ARG_RESUME,
+		"skip files (and stages: muxing, tagging, renaming) that an earlier run already finished, according to the journal"
+	});
+
+	helpList.push_back({ ARG_JOURNAL + std::string(" <path>"),
+		"where to keep the journal of finished files for " ARG_RESUME " (default: next to the stream cache)"
+	});
+
+	helpList.push_back({ ARG_CHECKPOINT_INTERVAL + std::string(" <size>"),
+		"when muxing, save a checkpoint every this much output, eg. '1G' (default 0, never); "
+		ARG_RESUME " continues an interrupted remux from its last checkpoint"
+	});
+
+	helpList.push_back({ ARG_BACKGROUND,
+		"run at idle cpu and io priority (including mkvtoolnix), so other programs using the same disks aren't slowed down"
+	});
+
+	helpList.push_back({ ARG_MAX_RATE + std::string(" <size>"),
+		"write outputs at most this fast, per second, eg. '20M' (default 0, no limit)"
+	});
+
 	helpList.push_back({ ARG_MANUAL_SERIES_TITLE,
 		"override the series title with the given string"
 	});
@@ -142,6 +228,54 @@ static void setupMap()
 		"disable progress indication (for muxing)"
 	});
 
+	helpList.push_back({ ARG_FULL_PROBE,
+		"always decode frames to probe input streams, instead of trusting the mkv track headers"
+	});
+
+	helpList.push_back({ ARG_STREAM_CACHE + std::string(" <path>"),
+		"use the given file to cache stream information (default: ~/.cache/mkvtaginator/streams.json)"
+	});
+
+	helpList.push_back({ ARG_NO_STREAM_CACHE,
+		"do not read or write the stream information cache"
+	});
+
+	helpList.push_back({ ARG_REMEMBER_SELECTIONS,
+		"save stream choices made with --prefer-one-stream, and reuse them for files with the same stream layout"
+	});
+
+	helpList.push_back({ ARG_LOG_JSON + std::string(" <path>"),
+		"also append every log message to the given file as json lines (with timestamps, without colours)"
+	});
+
+	helpList.push_back({ ARG_STATS,
+		"print time spent in each stage, bytes read and written, and http/cache counts for each file, and a summary at the end"
+	});
+
+	helpList.push_back({ ARG_STATS_JSON + std::string(" <path>"),
+		"write the per-file and per-stage statistics (with p50/p95/p99 timings) to the given file as json"
+	});
+
+	helpList.push_back({ ARG_TRACE + std::string(" <path>"),
+		"write a timeline of every file, stage, http request and subprocess to the given file (chrome trace format, for perfetto)"
+	});
+
+	helpList.push_back({ ARG_PROM_FILE + std::string(" <path>"),
+		"write prometheus metrics (files, bytes, throughput, http latency, cache and subprocess stats) to the given file, for the node_exporter textfile collector"
+	});
+
+	helpList.push_back({ ARG_API_BASE_URL + std::string(" <url>"),
+		"send metadata requests to '<url>/<host>/<path>' instead of the real servers (eg. a caching proxy or mock server)"
+	});
+
+	helpList.push_back({ ARG_HTTP_RECORD + std::string(" <dir>"),
+		"save every metadata response (with api keys removed) to the given folder, for '--http-replay'"
+	});
+
+	helpList.push_back({ ARG_HTTP_REPLAY + std::string(" <dir>"),
+		"answer metadata requests from responses saved with '--http-record', without using the network (no api keys needed)"
+	});
+
 	helpList.push_back({ ARG_RENAME_FILES,
 		"rename the output file to the canonical format; for TV shows, 'SERIES S01E01 - EP TITLE'; for movies, 'TITLE (YEAR)'"
 	});
@@ -167,6 +301,14 @@ static void setupMap()
 		"do everything normally, but do not modify the input files"
 	});
 
+	helpList.push_back({ ARG_BENCH_MUX,
+		"benchmark muxing: remux the inputs (one at a time) into a null sink (no tagging, no prompts for streams), and report packets/s, MB/s, per-stream counts, and buffering"
+	});
+
+	helpList.push_back({ ARG_BENCH_MUX_OUTPUT + std::string(" <dir>"),
+		"like '--bench-mux', but really write the outputs into the given folder (eg. a tmpfs), deleting each one afterwards"
+	});
+
 	helpList.push_back({ ARG_NO_AUTO_COVER,
 		"do not automatically detect cover art in the current folder"
 	});
@@ -466,6 +608,26 @@ namespace args
 					config::setIsDryRun(true);
 					continue;
 				}
+				else if(!strcmp(argv[i], ARG_BENCH_MUX))
+				{
+					config::setBenchmarkMux(true);
+					continue;
+				}
+				else if(!strcmp(argv[i], ARG_BENCH_MUX_OUTPUT))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						config::setBenchmarkMux(true);
+						config::setBenchmarkMuxOutput(argv[i]);
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected path after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
 				else if(!strcmp(argv[i], ARG_NO_AUTO_COVER))
 				{
 					config::setDisableAutoCoverSearch(true);
@@ -502,6 +664,172 @@ namespace args
 					config::setDisableProgress(true);
 					continue;
 				}
+				else if(!strcmp(argv[i], ARG_FULL_PROBE))
+				{
+					config::setUseFastProbe(false);
+					continue;
+				}
+				else if(!strcmp(argv[i], ARG_NO_STREAM_CACHE))
+				{
+					config::setUseStreamCache(false);
+					continue;
+				}
+				else if(!strcmp(argv[i], ARG_REMEMBER_SELECTIONS))
+				{
+					config::setRememberSelections(true);
+					continue;
+				}
+				else if(!strcmp(argv[i], ARG_STREAM_CACHE))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						config::setStreamCachePath(argv[i]);
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected path after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_LOG_JSON))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						config::setJsonLogPath(argv[i]);
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected path after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_STATS))
+				{
+					config::setShowStats(true);
+					continue;
+				}
+				else if(!strcmp(argv[i], ARG_KEEP_PAGE_CACHE))
+				{
+					config::setDropPageCache(false);
+					continue;
+				}
+				else if(!strcmp(argv[i], ARG_BACKGROUND))
+				{
+					config::setBackgroundMode(true);
+					continue;
+				}
+				else if(!strcmp(argv[i], ARG_CHECKSUM_FILE))
+				{
+					config::setWriteChecksumFile(true);
+					continue;
+				}
+				else if(!strcmp(argv[i], ARG_STATS_JSON))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						config::setStatsJsonPath(argv[i]);
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected path after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_TRACE))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						config::setTracePath(argv[i]);
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected path after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_PROM_FILE))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						config::setMetricsPath(argv[i]);
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected path after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_API_BASE_URL))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						config::setApiBaseUrl(argv[i]);
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected url after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_HTTP_RECORD))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						config::setHttpRecordPath(argv[i]);
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected path after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_HTTP_REPLAY))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						config::setHttpReplayPath(argv[i]);
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected path after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_JOURNAL))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						config::setJournalPath(argv[i]);
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected path after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_RESUME))
+				{
+					config::setResuming(true);
+					continue;
+				}
 				else if(!strcmp(argv[i], ARG_PREFER_SDH_SUBS))
 				{
 					config::setPreferSDHSubs(true);
@@ -648,6 +976,149 @@ namespace args
 						exit(-1);
 					}
 				}
+				else if(!strcmp(argv[i], ARG_INTERLEAVE_DELTA))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						char* end = nullptr;
+						auto delta = strtod(argv[i], &end);
+
+						if(end != argv[i] + strlen(argv[i]) || delta < 0)
+						{
+							util::error("%serror:%s invalid number '%s' for interleave delta", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+							exit(-1);
+						}
+
+						config::setInterleaveDelta(delta);
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected decimal number after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_INTERLEAVE_BUFFER))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						char* end = nullptr;
+						auto size = strtoul(argv[i], &end, 10);
+
+						if(end == argv[i] || *end != 0 || argv[i][0] == '-')
+						{
+							util::error("%serror:%s invalid size '%s' for interleave buffer", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+							exit(-1);
+						}
+
+						config::setInterleaveBufferSize(size);
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected (positive) integer after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_JOBS) || !strcmp(argv[i], ARG_JOBS_PER_DEVICE))
+				{
+					if(i != argc - 1)
+					{
+						bool perDevice = !strcmp(argv[i], ARG_JOBS_PER_DEVICE);
+
+						i++;
+						char* end = nullptr;
+						auto n = strtoul(argv[i], &end, 10);
+
+						if(end == argv[i] || *end != 0 || argv[i][0] == '-' || (n == 0 && !perDevice))
+						{
+							util::error("%serror:%s invalid job count '%s'", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+							exit(-1);
+						}
+
+						if(perDevice)   config::setJobsPerDevice(n);
+						else            config::setJobCount(n);
+
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected (positive) integer after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_ORDER))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						if(auto x = std::string(argv[i]); x == "given" || x == "physical" || x == "size" || x == "size-desc")
+						{
+							config::setFileOrder(x);
+							continue;
+						}
+
+						util::error("%serror:%s invalid order '%s' (expected 'given', 'physical', 'size' or 'size-desc')",
+							COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+					else
+					{
+						util::error("%serror:%s expected order after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_MAX_MEMORY) || !strcmp(argv[i], ARG_MAX_RATE)
+					|| !strcmp(argv[i], ARG_CHECKPOINT_INTERVAL))
+				{
+					if(i != argc - 1)
+					{
+						auto opt = argv[i];
+
+						i++;
+						if(uint64_t n = 0; util::parseByteSize(argv[i], &n))
+						{
+							if(!strcmp(opt, ARG_MAX_RATE))              config::setMaxRate(n);
+							else if(!strcmp(opt, ARG_MAX_MEMORY))       config::setMemoryBudget(n);
+							else                                        config::setCheckpointInterval(n);
+
+							continue;
+						}
+
+						util::error("%serror:%s invalid size '%s' (expected eg. '512M' or '2G')", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+					else
+					{
+						util::error("%serror:%s expected size after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
+				else if(!strcmp(argv[i], ARG_SYNC_BATCH))
+				{
+					if(i != argc - 1)
+					{
+						i++;
+						char* end = nullptr;
+						auto n = strtoul(argv[i], &end, 10);
+
+						if(end == argv[i] || *end != 0 || argv[i][0] == '-')
+						{
+							util::error("%serror:%s invalid batch size '%s'", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+							exit(-1);
+						}
+
+						config::setSyncBatchSize(n);
+						continue;
+					}
+					else
+					{
+						util::error("%serror:%s expected (positive) integer after '%s' option", COLOUR_RED_BOLD, COLOUR_RESET, argv[i]);
+						exit(-1);
+					}
+				}
 				else if(!strcmp(argv[i], ARG_OUTPUT_FOLDER))
 				{
 					if(i != argc - 1)
@@ -723,19 +1194,58 @@ namespace args
 			exit(-1);
 		}
 
+		// benchmarks only mux, and never into the real output folder. keeping every matching stream
+		// (instead of asking which one) means nothing waits on the user.
+		if(config::isBenchmarkingMux())
+		{
+			if(config::isTagging())
+				util::warn("warn: '%s' disables tagging", ARG_BENCH_MUX);
+
+			// the heap numbers are for the whole process, so they'd mix up files that run at once.
+			if(config::getJobCount() != 1)
+				util::warn("warn: '%s' runs one file at a time", ARG_BENCH_MUX);
+
+			config::setIsMuxing(true);
+			config::setIsTagging(false);
+			config::setIsDryRun(false);
+			config::setPreferOneStream(false);
+			config::setJobCount(1);
+			config::setOutputFolder(config::getBenchmarkMuxOutput());
+		}
+
 		if(!config::isMuxing() && !config::isTagging())
 		{
 			util::error("%serror:%s one or both of '--mux' or '--tag' must be specified",
 				COLOUR_RED_BOLD, COLOUR_RESET);
 			exit(-1);
 		}
-		else if(config::getOutputFolder().empty() && config::isMuxing())
+		else if(config::getOutputFolder().empty() && config::isMuxing() && !config::isBenchmarkingMux())
 		{
 			util::error("%serror:%s output folder must be specified ('--output-folder') when muxing",
 				COLOUR_RED_BOLD, COLOUR_RESET);
 			exit(-1);
 		}
 
+		// files are muxed in parallel, and these are read by every one of them, so check them once here;
+		// like any other error, they only stop everything with '--stop-on-error', and are ignored otherwise.
+		if(auto manual = config::getManualSubsPath(); config::isMuxing() && !manual.empty() && !std::fs::exists(manual))
+		{
+			util::error("subtitle input '%s' does not exist", manual);
+			if(config::shouldStopOnError())
+				exit(-1);
+
+			config::setManualSubsPath("");
+		}
+
+		if(auto extra = config::getExtraSubsPath(); config::isMuxing() && !extra.empty() && !std::fs::is_directory(extra))
+		{
+			util::error("extra subs directory '%s' does not exist, or is not a directory", extra);
+			if(config::shouldStopOnError())
+				exit(-1);
+
+			config::setExtraSubsPath("");
+		}
+
 		return filenames;
 	}
 }
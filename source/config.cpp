@@ -123,6 +123,19 @@ namespace config
 					return def;
 				};
 
+				auto get_number = [&opts](const std::string& key, double def) -> double {
+					if(auto it = opts.find(key); it != opts.end())
+					{
+						if(it->second.is<double>() && it->second.get<double>() >= 0)
+							return it->second.get<double>();
+
+						else
+							error("expected non-negative number for '%s'", key);
+					}
+
+					return def;
+				};
+
 				if(auto x = get_string("tvdb-api-key", ""); !x.empty())
 					setTVDBApiKey(x);
 
@@ -132,6 +145,33 @@ namespace config
 				if(auto x = get_string("output-folder", ""); !x.empty())
 					setOutputFolder(x);
 
+				if(auto x = get_string("stream-info-cache-path", ""); !x.empty())
+					setStreamCachePath(x);
+
+				if(auto x = get_string("log-json-path", ""); !x.empty())
+					setJsonLogPath(x);
+
+				if(auto x = get_string("stats-json-path", ""); !x.empty())
+					setStatsJsonPath(x);
+
+				if(auto x = get_string("trace-path", ""); !x.empty())
+					setTracePath(x);
+
+				if(auto x = get_string("prometheus-file-path", ""); !x.empty())
+					setMetricsPath(x);
+
+				if(auto x = get_string("api-base-url", ""); !x.empty())
+					setApiBaseUrl(x);
+
+				if(auto x = get_string("http-record-path", ""); !x.empty())
+					setHttpRecordPath(x);
+
+				if(auto x = get_string("http-replay-path", ""); !x.empty())
+					setHttpReplayPath(x);
+
+				if(auto x = get_string("journal-path", ""); !x.empty())
+					setJournalPath(x);
+
 
 				auto get_langs = [](const std::vector<pj::value>& xs, const std::string& foo) -> std::vector<std::string> {
 
@@ -193,6 +233,53 @@ namespace config
 				setPreferTextSubs(get_bool("prefer-text-subtitles", true));
 				setPreferSignSongSubs(get_bool("prefer-signs-and-songs-subs", false));
 				setSkipNCOPNCED(get_bool("skip-ncop-nced", false));
+				setUseFastProbe(get_bool("fast-stream-probe", true));
+				setUseStreamCache(get_bool("stream-info-cache", true));
+				setRememberSelections(get_bool("remember-stream-selections", false));
+				setShowStats(get_bool("show-stats", false));
+				setDropPageCache(get_bool("drop-finished-from-cache", true));
+				setWriteChecksumFile(get_bool("write-checksum-file", false));
+				setSyncBatchSize(static_cast<size_t>(get_number("sync-batch-size", 16)));
+				setJobCount(static_cast<size_t>(get_number("jobs", 1)));
+				setJobsPerDevice(static_cast<size_t>(get_number("jobs-per-device", 1)));
+
+				if(auto x = get_string("file-order", "given"); x == "given" || x == "physical" || x == "size" || x == "size-desc")
+					setFileOrder(x);
+
+				else
+					error("invalid value '%s' for 'file-order' (expected 'given', 'physical', 'size' or 'size-desc')", x);
+
+				if(auto x = get_string("max-memory", ""); !x.empty())
+				{
+					if(uint64_t n = 0; util::parseByteSize(x, &n))
+						setMemoryBudget(n);
+
+					else
+						error("invalid size '%s' for 'max-memory' (expected eg. '512M' or '2G')", x);
+				}
+
+				if(auto x = get_string("max-rate", ""); !x.empty())
+				{
+					if(uint64_t n = 0; util::parseByteSize(x, &n))
+						setMaxRate(n);
+
+					else
+						error("invalid size '%s' for 'max-rate' (expected eg. '20M')", x);
+				}
+
+				if(auto x = get_string("checkpoint-interval", ""); !x.empty())
+				{
+					if(uint64_t n = 0; util::parseByteSize(x, &n))
+						setCheckpointInterval(n);
+
+					else
+						error("invalid size '%s' for 'checkpoint-interval' (expected eg. '1G')", x);
+				}
+
+				setBackgroundMode(get_bool("background-mode", false));
+
+				setInterleaveDelta(get_number("interleave-max-delta", 10));
+				setInterleaveBufferSize(static_cast<size_t>(get_number("interleave-max-buffer", 64)));
 			}
 			else
 			{
@@ -242,11 +329,40 @@ namespace config
 	static std::string extraSubsPath;
 	static std::string manualSubsPath;
 	static std::string manualSeriesTitle;
+	static std::string streamCachePath;
+	static std::string jsonLogPath;
+	static std::string statsJsonPath;
+	static std::string tracePath;
+	static std::string metricsPath;
+	static std::string apiBaseUrl;
+	static std::string httpRecordPath;
+	static std::string httpReplayPath;
+	static std::string benchMuxOutput;
+	static std::string journalPath;
+
+	// in bytes (per second, for the rate); 0 is unlimited.
+	static uint64_t memoryBudget = 0;
+	static uint64_t maxRate = 0;
+	static bool backgroundMode = false;
+
+	// in bytes of output; 0 never checkpoints. see mux::checkpoint.
+	static uint64_t checkpointInterval = 0;
+
+	// "given", "physical", "size" or "size-desc"; see driver::processFiles.
+	static std::string fileOrder = "given";
 
 	static std::vector<std::string> audioLangs;
 	static std::vector<std::string> subtitleLangs;
 
 	static bool dryrun = false;
+	static bool benchMux = false;
+	static bool fastProbe = true;
+	static bool streamCache = true;
+	static bool rememberSelections = false;
+	static bool showStats = false;
+	static bool dropPageCache = true;
+	static bool writeChecksumFile = false;
+	static bool resuming = false;
 	static bool muxing = false;
 	static bool tagging = false;
 	static bool noprogress = false;
@@ -276,6 +392,17 @@ namespace config
 
 	static double subtitleDelay = 0;
 
+	// seconds and megabytes; 0 is unlimited.
+	static double interleaveDelta = 10;
+	static size_t interleaveBufferSize = 64;
+
+	// finished outputs are synced and renamed this many at a time; 0 waits until the end.
+	static size_t syncBatchSize = 16;
+
+	// files processed at once, in total and per block device (0 is no limit).
+	static size_t jobCount = 1;
+	static size_t jobsPerDevice = 1;
+
 
 	void setAudioLangs(const std::vector<std::string>& xs)      { audioLangs = xs; }
 	void setSubtitleLangs(const std::vector<std::string>& xs)   { subtitleLangs = xs; }
@@ -294,10 +421,36 @@ namespace config
 	std::string getExtraSubsPath()          { return extraSubsPath; }
 	std::string getManualSubsPath()         { return manualSubsPath; }
 	std::string getManualSeriesTitle()      { return manualSeriesTitle; }
+	std::string getStreamCachePath()        { return streamCachePath; }
+	std::string getJsonLogPath()            { return jsonLogPath; }
+	std::string getStatsJsonPath()          { return statsJsonPath; }
+	std::string getTracePath()              { return tracePath; }
+	std::string getMetricsPath()            { return metricsPath; }
+	std::string getApiBaseUrl()             { return apiBaseUrl; }
+	std::string getHttpRecordPath()         { return httpRecordPath; }
+	std::string getHttpReplayPath()         { return httpReplayPath; }
 	bool isOverridingMovieName()            { return overrideMovieName; }
 	bool isOverridingSeriesName()           { return overrideSeriesName; }
 	bool isOverridingEpisodeName()          { return overrideEpisodeName; }
 	bool isDryRun()                         { return dryrun; }
+	bool isBenchmarkingMux()                { return benchMux; }
+	std::string getBenchmarkMuxOutput()     { return benchMuxOutput; }
+	bool shouldWriteChecksumFile()          { return writeChecksumFile; }
+	size_t getSyncBatchSize()               { return syncBatchSize; }
+	size_t getJobCount()                    { return jobCount; }
+	size_t getJobsPerDevice()               { return jobsPerDevice; }
+	std::string getFileOrder()              { return fileOrder; }
+	uint64_t getMemoryBudget()              { return memoryBudget; }
+	uint64_t getMaxRate()                   { return maxRate; }
+	bool isBackgroundMode()                 { return backgroundMode; }
+	uint64_t getCheckpointInterval()        { return checkpointInterval; }
+	bool isResuming()                       { return resuming; }
+	std::string getJournalPath()            { return journalPath; }
+	bool useFastProbe()                     { return fastProbe; }
+	bool useStreamCache()                   { return streamCache; }
+	bool shouldRememberSelections()         { return rememberSelections; }
+	bool shouldShowStats()                  { return showStats; }
+	bool shouldDropPageCache()              { return dropPageCache; }
 	bool isMuxing()                         { return muxing; }
 	bool isTagging()                        { return tagging; }
 	bool shouldRenameFiles()                { return renameFiles; }
@@ -318,6 +471,8 @@ namespace config
 	int getSeasonNumber()                   { return manualSeasonNumber; }
 	int getEpisodeNumber()                  { return manualEpisodeNumber; }
 	double getSubtitleDelay()               { return subtitleDelay; }
+	double getInterleaveDelta()             { return interleaveDelta; }
+	size_t getInterleaveBufferSize()        { return interleaveBufferSize; }
 
 	void setManualMovieId(const std::string& x)     { movieId = x; }
 	void setManualSeriesId(const std::string& x)    { seriesId = x; }
@@ -329,8 +484,34 @@ namespace config
 	void setExtraSubsPath(const std::string& x)     { extraSubsPath = x; }
 	void setManualSubsPath(const std::string& x)    { manualSubsPath = x; }
 	void setManualSeriesTitle(const std::string& x) { manualSeriesTitle = x; }
+	void setStreamCachePath(const std::string& x)   { streamCachePath = x; }
+	void setJsonLogPath(const std::string& x)       { jsonLogPath = x; }
+	void setStatsJsonPath(const std::string& x)     { statsJsonPath = x; }
+	void setTracePath(const std::string& x)         { tracePath = x; }
+	void setMetricsPath(const std::string& x)       { metricsPath = x; }
+	void setApiBaseUrl(const std::string& x)        { apiBaseUrl = x; }
+	void setHttpRecordPath(const std::string& x)    { httpRecordPath = x; }
+	void setHttpReplayPath(const std::string& x)    { httpReplayPath = x; }
 	void setDisableAutoCoverSearch(bool x)          { noAutoCover = x; }
 	void setIsDryRun(bool x)                        { dryrun = x; }
+	void setBenchmarkMux(bool x)                    { benchMux = x; }
+	void setBenchmarkMuxOutput(const std::string& x) { benchMuxOutput = x; }
+	void setWriteChecksumFile(bool x)               { writeChecksumFile = x; }
+	void setSyncBatchSize(size_t x)                 { syncBatchSize = x; }
+	void setJobCount(size_t x)                      { jobCount = x; }
+	void setJobsPerDevice(size_t x)                 { jobsPerDevice = x; }
+	void setFileOrder(const std::string& x)         { fileOrder = x; }
+	void setMemoryBudget(uint64_t x)                { memoryBudget = x; }
+	void setMaxRate(uint64_t x)                     { maxRate = x; }
+	void setBackgroundMode(bool x)                  { backgroundMode = x; }
+	void setCheckpointInterval(uint64_t x)          { checkpointInterval = x; }
+	void setResuming(bool x)                        { resuming = x; }
+	void setJournalPath(const std::string& x)       { journalPath = x; }
+	void setUseFastProbe(bool x)                    { fastProbe = x; }
+	void setUseStreamCache(bool x)                  { streamCache = x; }
+	void setRememberSelections(bool x)              { rememberSelections = x; }
+	void setShowStats(bool x)                       { showStats = x; }
+	void setDropPageCache(bool x)                   { dropPageCache = x; }
 	void setIsMuxing(bool x)                        { muxing = x;}
 	void setIsTagging(bool x)                       { tagging = x;}
 	void setDisableProgress(bool x)                 { noprogress = x; }
@@ -353,6 +534,8 @@ namespace config
 	void setSeasonNumber(int x)                     { manualSeasonNumber = x; }
 	void setEpisodeNumber(int x)                    { manualEpisodeNumber = x; }
 	void setSubtitleDelay(double x)                 { subtitleDelay = x; }
+	void setInterleaveDelta(double x)               { interleaveDelta = x; }
+	void setInterleaveBufferSize(size_t x)          { interleaveBufferSize = x; }
 
 	void setConfigPath(const std::string& x)
 	{
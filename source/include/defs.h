@@ -10,6 +10,7 @@
 #include <string.h>
 #include <assert.h>
 
+#include <mutex>
 #include <filesystem>
 
 #include "zpr.h"
@@ -41,6 +42,10 @@ namespace tinyxml2
 	class XMLDocument;
 }
 
+struct AVPacket;
+struct AVIOContext;
+struct AVFormatContext;
+
 // https://stackoverflow.com/questions/28367913/how-to-stdhash-an-unordered-stdpair
 
 template<typename T>
@@ -69,45 +74,62 @@ namespace std
 
 namespace util
 {
+	// the indent is per-thread, as is the current log block.
 	void indent_log(int n = 1);
 	void unindent_log(int n = 1);
 
 	int get_log_indent();
 
+	enum class LogLevel { Log, Info, Warn, Error, Raw };
+
+	void write_log(LogLevel level, const std::string& msg);
+
+	// for formatting a message in place: begin_log() returns the current thread's buffer (with the
+	// prefix already in it) to append the message to, and end_log() finishes the line.
+	std::string& begin_log(LogLevel level);
+	void end_log(LogLevel level);
+
+	// starts a block of output for one job (eg. a file). the job name is attached to json log
+	// records, and if 'buffered' is set, console output is held until the block ends.
+	void begin_log_block(const std::string& job, bool buffered);
+	void end_log_block();
+
+	// writes out anything the current thread has buffered.
+	void flush_log();
+
+	// for prompts: flushes this thread's buffer, and keeps other threads' output off the console. it
+	// doesn't erase the progress lines, see progress::clear.
+	std::unique_lock<std::recursive_mutex> lock_console();
+
+	// also write every log line as a json record (with timestamps, no colours) to this file.
+	bool open_json_log(const std::string& path);
+
 	template <typename... Args>
 	static void error(const std::string& fmt, Args&&... args)
 	{
-		for(int i = 0; i < get_log_indent(); i++)
-			fprintf(stderr, "  ");
-
-		fprintf(stderr, " %s*%s %s\n", COLOUR_RED_BOLD, COLOUR_RESET, zpr::sprint(fmt, args...).c_str());
+		zpr::sprint_into(begin_log(LogLevel::Error), fmt, args...);
+		end_log(LogLevel::Error);
 	}
 
 	template <typename... Args>
 	static void log(const std::string& fmt, Args&&... args)
 	{
-		for(int i = 0; i < get_log_indent(); i++)
-			printf("  ");
-
-		printf(" %s*%s %s\n", COLOUR_GREEN_BOLD, COLOUR_RESET, zpr::sprint(fmt, args...).c_str());
+		zpr::sprint_into(begin_log(LogLevel::Log), fmt, args...);
+		end_log(LogLevel::Log);
 	}
 
 	template <typename... Args>
 	static void info(const std::string& fmt, Args&&... args)
 	{
-		for(int i = 0; i < get_log_indent(); i++)
-			printf("  ");
-
-		printf(" %s*%s %s\n", COLOUR_BLUE_BOLD, COLOUR_RESET, zpr::sprint(fmt, args...).c_str());
+		zpr::sprint_into(begin_log(LogLevel::Info), fmt, args...);
+		end_log(LogLevel::Info);
 	}
 
 	template <typename... Args>
 	static void warn(const std::string& fmt, Args&&... args)
 	{
-		for(int i = 0; i < get_log_indent(); i++)
-			printf("  ");
-
-		printf(" %s*%s %s\n", COLOUR_YELLOW_BOLD, COLOUR_RESET, zpr::sprint(fmt, args...).c_str());
+		zpr::sprint_into(begin_log(LogLevel::Warn), fmt, args...);
+		end_log(LogLevel::Warn);
 	}
 
 
@@ -119,6 +141,21 @@ namespace util
 	size_t getFileSize(const std::string& path);
 	std::pair<uint8_t*, size_t> readEntireFile(const std::string& path);
 
+	// a size like "512M" or "2G" (powers of 1024); a plain number is in megabytes.
+	bool parseByteSize(const std::string& s, uint64_t* out);
+
+	struct FileStat
+	{
+		uint64_t dev = 0;
+		uint64_t inode = 0;
+		uint64_t size = 0;
+
+		// nanoseconds since the epoch
+		int64_t mtime = 0;
+	};
+
+	bool statFile(const std::string& path, FileStat* st);
+
 	static inline std::vector<std::string> splitString(std::string view, char delim = '\n')
 	{
 		std::vector<std::string> ret;
@@ -206,6 +243,14 @@ namespace config
 	std::string getExtraSubsPath();
 	std::string getManualSubsPath();
 	std::string getManualSeriesTitle();
+	std::string getStreamCachePath();
+	std::string getJsonLogPath();
+	std::string getStatsJsonPath();
+	std::string getTracePath();
+	std::string getMetricsPath();
+	std::string getApiBaseUrl();
+	std::string getHttpRecordPath();
+	std::string getHttpReplayPath();
 
 	std::vector<std::string> getAudioLangs();
 	std::vector<std::string> getSubtitleLangs();
@@ -228,6 +273,24 @@ namespace config
 	bool disableMovieSearch();
 
 	bool isDryRun();
+	bool isBenchmarkingMux();
+	std::string getBenchmarkMuxOutput();
+	bool shouldWriteChecksumFile();
+	size_t getSyncBatchSize();
+	size_t getJobCount();
+	size_t getJobsPerDevice();
+	std::string getFileOrder();
+	uint64_t getMemoryBudget();
+	uint64_t getMaxRate();
+	bool isBackgroundMode();
+	uint64_t getCheckpointInterval();
+	bool isResuming();
+	std::string getJournalPath();
+	bool useFastProbe();
+	bool useStreamCache();
+	bool shouldRememberSelections();
+	bool shouldShowStats();
+	bool shouldDropPageCache();
 	bool disableProgress();
 	bool shouldRenameFiles();
 	bool shouldStopOnError();
@@ -237,6 +300,8 @@ namespace config
 	int getEpisodeNumber();
 
 	double getSubtitleDelay();
+	double getInterleaveDelta();
+	size_t getInterleaveBufferSize();
 
 	bool isMuxing();
 	bool isTagging();
@@ -244,6 +309,19 @@ namespace config
 
 
 	void setSubtitleDelay(double seconds);
+	void setWriteChecksumFile(bool x);
+	void setSyncBatchSize(size_t x);
+	void setJobCount(size_t x);
+	void setJobsPerDevice(size_t x);
+	void setFileOrder(const std::string& x);
+	void setMemoryBudget(uint64_t bytes);
+	void setMaxRate(uint64_t bytesPerSecond);
+	void setBackgroundMode(bool x);
+	void setCheckpointInterval(uint64_t bytes);
+	void setResuming(bool x);
+	void setJournalPath(const std::string& x);
+	void setInterleaveDelta(double seconds);
+	void setInterleaveBufferSize(size_t megabytes);
 
 	void setAudioLangs(const std::vector<std::string>& xs);
 	void setSubtitleLangs(const std::vector<std::string>& xs);
@@ -276,6 +354,21 @@ namespace config
 	void setDisableSmartReplaceCoverArt(bool x);
 	void setShouldRenameWithoutEpisodeTitle(bool x);
 	void setIsDryRun(bool x);
+	void setBenchmarkMux(bool x);
+	void setBenchmarkMuxOutput(const std::string& x);
+	void setUseFastProbe(bool x);
+	void setUseStreamCache(bool x);
+	void setStreamCachePath(const std::string& x);
+	void setJsonLogPath(const std::string& x);
+	void setStatsJsonPath(const std::string& x);
+	void setTracePath(const std::string& x);
+	void setMetricsPath(const std::string& x);
+	void setApiBaseUrl(const std::string& x);
+	void setHttpRecordPath(const std::string& x);
+	void setHttpReplayPath(const std::string& x);
+	void setRememberSelections(bool x);
+	void setShowStats(bool x);
+	void setDropPageCache(bool x);
 	void setIsMuxing(bool x);
 	void setIsTagging(bool x);
 	void setDisableProgress(bool x);
@@ -290,6 +383,124 @@ namespace driver
 	void createOutputFolder();
 	std::vector<std::filesystem::path> collectFiles(const std::vector<std::string>& files);
 	bool processOneFile(const std::filesystem::path& filepath);
+
+	// runs processOneFile on every file, as many at once as '--jobs' and '--jobs-per-device' allow;
+	// returns how many succeeded.
+	size_t processFiles(const std::vector<std::filesystem::path>& paths);
+
+	// for errors that should end the run (eg. with '--stop-on-error'), from any job: no more files are
+	// started, and processFiles returns once the running ones are done. exit() from a job would pull
+	// everything out from under the others.
+	void stop();
+	bool isStopping();
+}
+
+namespace staging
+{
+	// where an output is written before it is complete.
+	std::filesystem::path tempPath(const std::filesystem::path& final);
+
+	// 'temp' is finished, and will be renamed to 'final' at the next commit (after release()).
+	void add(const std::filesystem::path& temp, const std::filesystem::path& final);
+	void discard(const std::filesystem::path& temp);
+
+	// the calling thread is done with everything it added, so those can be committed.
+	void release();
+
+	// where the file that will be called 'path' currently is.
+	std::filesystem::path resolve(const std::filesystem::path& path);
+
+	// renames a file, or changes the name a staged file will get.
+	bool rename(const std::filesystem::path& from, const std::filesystem::path& to);
+
+	// syncs and renames the released files, once there are enough of them (or always, with 'force').
+	// files that haven't been released are left alone.
+	bool commit(bool force);
+}
+
+namespace pagecache
+{
+	// starts reading the parts of the file that are needed first, in the background.
+	void prefetch(const std::filesystem::path& path);
+
+	// evicts the file from the page cache (unless '--keep-page-cache').
+	void drop(const std::filesystem::path& path);
+}
+
+namespace journal
+{
+	enum class Stage { Muxed, Tagged, Renamed };
+
+	// what earlier runs did to a file, according to the journal.
+	struct Progress
+	{
+		bool muxed = false;
+		bool tagged = false;
+		bool renamed = false;
+
+		// where the result of the last stage is.
+		std::filesystem::path output;
+	};
+
+	// reads the journal (with '--resume'), and opens it for appending.
+	void open();
+
+	// fingerprints the input that the calling thread is about to work on; with '--resume', also returns
+	// what was already done to it.
+	Progress beginFile(const std::filesystem::path& input);
+
+	// the current file finished a stage, with its result in 'output'. staged outputs are only written to
+	// the journal once they are committed.
+	void record(Stage stage, const std::filesystem::path& output);
+	void committed(const std::filesystem::path& temp, const std::filesystem::path& final);
+
+	void close();
+}
+
+namespace priority
+{
+	// lowers our cpu and io priority to idle, for '--background'.
+	void enterBackground();
+
+	// blocks until 'bytes' more can be written without going over '--max-rate'.
+	void throttle(uint64_t bytes);
+}
+
+namespace memory
+{
+	struct Account;
+
+	// roughly how much memory processing this file will take.
+	uint64_t estimate(const std::filesystem::path& path);
+
+	// whether a job with this estimate can start without going over '--max-memory'.
+	bool fits(uint64_t estimate);
+
+	// what the running jobs are holding (or are expected to hold).
+	uint64_t inUse();
+
+	// the account for one job; release() returns the most it was charged at once.
+	Account* reserve(uint64_t estimate);
+	uint64_t release(Account* account);
+
+	// charges made on this thread go to this account (or nowhere, if null).
+	void attach(Account* account);
+	void charge(int64_t bytes);
+
+	// charges the current job for as long as it is alive.
+	struct Charge
+	{
+		Charge(uint64_t bytes);
+		~Charge();
+
+		Charge(const Charge&) = delete;
+		Charge& operator = (const Charge&) = delete;
+
+		uint64_t bytes;
+	};
+
+	// picojson's tree is several times the size of the text it was parsed from.
+	constexpr uint64_t jsonSize(size_t textSize) { return 8 * static_cast<uint64_t>(textSize); }
 }
 
 namespace misc
@@ -315,14 +526,311 @@ namespace misc
 
 	size_t userChoice(const std::vector<Option>& options, bool* showmore = 0, size_t first = 0, size_t limit = 0);
 	std::vector<size_t> userChoiceMultiple(const std::vector<Option>& options);
+
+	// returns the first language in the list whose name (in english) appears in the title, or
+	// an empty string if none of them do.
+	std::string guessLanguageFromTitle(const std::vector<std::string>& preferredLangs, std::string_view title);
 }
 
 
 
 
+namespace progress
+{
+	struct Job;
+
+	// returns null if progress is disabled; the other functions accept null and do nothing. 'totalBytes'
+	// (the size of the inputs) and 'doneBytes' (how much of them is already behind us) are for the eta,
+	// and 'durationNs' is just for display (all can be 0).
+	Job* begin(const std::string& name, uint64_t totalBytes, uint64_t doneBytes, uint64_t durationNs);
+
+	// cheap enough to call for every packet; it's just a few relaxed atomics. 'position' is how far
+	// into the inputs we are, in bytes.
+	void update(Job* job, uint64_t position, uint64_t packets, uint64_t timeNs);
+	void end(Job* job);
+
+	// erases the progress lines, so something else can be printed; the next redraw starts below it.
+	// the console must be locked (see util::lock_console).
+	void clear();
+}
+
+namespace trace
+{
+	using Args = std::vector<std::pair<std::string, std::string>>;
+
+	// --trace: writes spans in the chrome trace event format, for perfetto or chrome://tracing.
+	bool open(const std::string& path);
+	void close();
+	bool enabled();
+
+	void setThreadName(const std::string& name);
+
+	// spans nest per thread, so every begin() needs an end() on the same thread -- use defer().
+	void begin(const std::string& name, const char* category, const Args& args = {});
+	void end(const Args& args = {});
+	void instant(const std::string& name, const char* category, const Args& args = {});
+}
+
+namespace stats
+{
+	enum class Stage { Parse, Http, Probe, Remux, Xml, Subprocess, Copy, Rename, Count };
+
+	// times the enclosing scope, and attributes it to the current thread's file (if any).
+	// this is also a trace span, named after the stage.
+	struct Scope
+	{
+		Scope(Stage stage, const trace::Args& args = {});
+		~Scope();
+
+		Scope(const Scope&) = delete;
+		Scope& operator = (const Scope&) = delete;
+
+		uint64_t elapsed() const;
+
+		Stage stage;
+		uint64_t start;
+	};
+
+	const char* stageName(Stage stage);
+
+	// the counters below go to the file that the current thread is working on.
+	void beginFile(const std::string& name);
+	void endFile(bool ok);
+
+	void addBytesRead(uint64_t n);
+	void addBytesWritten(uint64_t n);
+	void addPackets(uint64_t n);
+	void addInterleaveBuffer(uint64_t n);
+	void setVerified(bool verified, const std::string& checksum);
+	void addHttpBytes(uint64_t n);
+	void addCacheHit();
+	void addCacheMiss();
+
+	// these also feed the prometheus metrics.
+	void addSkippedFile();
+	void addRemux(uint64_t bytes, uint64_t ns);
+	void addSubprocess(const std::string& program, uint64_t ns);
+	void addHttpRequest(const std::string& url, long status, uint64_t ns);
+
+	// prints the batch summary (--stats) and/or writes the json dump (--stats-json).
+	void report();
+
+	// writes the prometheus textfile (--prom-file); unless forced, at most once a minute.
+	void writeMetrics(bool force);
+}
+
 namespace mux
 {
 	bool muxOneFile(std::fs::path& filepath);
+
+	// everything that stream selection needs to know about a stream, without needing the file open.
+	struct StreamInfo
+	{
+		int index = 0;
+
+		// 0 for the main input, 1 for the extra subtitle source. this isn't cached, since it
+		// depends on how the file is being used.
+		int source = 0;
+
+		// an AVMediaType
+		int type = -1;
+
+		std::string codec;
+		std::string lang;
+		std::string title;
+		std::string filename;
+
+		int64_t bitrate = 0;
+		uint64_t durationNs = 0;
+
+		// video
+		int width = 0;
+		int height = 0;
+		double fps = 0;
+
+		// audio
+		int sampleRate = 0;
+		int channels = 0;
+		int bitsPerSample = 0;
+		std::string layout;
+		std::string sampleFormat;
+	};
+
+	struct FileInfo
+	{
+		uint64_t durationNs = 0;
+		std::vector<StreamInfo> streams;
+	};
+
+	// audio or subtitle streams by language, along with their (lowercased) titles.
+	using StreamLangMap = std::unordered_map<std::string, std::vector<std::pair<const StreamInfo*, std::string>>>;
+
+	// sorts the streams of one input into the output lists, according to the language and subtitle preferences;
+	// audio and subtitles are also grouped by language, for when nothing matched.
+	void pickStreams(const FileInfo& info, const std::vector<std::string>& preferredAudioLangs,
+		const std::vector<std::string>& preferredSubtitleLangs, std::vector<const StreamInfo*>& selectedStreams,
+		std::vector<const StreamInfo*>& videoStrms, std::vector<const StreamInfo*>& audioStrms,
+		std::vector<const StreamInfo*>& subtitleStrms, StreamLangMap& audioStreamLangs, StreamLangMap& subtitleStreamLangs);
+
+	// stream tables for files we've already probed, keyed by (dev, inode, size, mtime) and kept on disk.
+	namespace cache
+	{
+		bool lookup(const std::fs::path& path, FileInfo* info);
+		void store(const std::fs::path& path, const FileInfo& info);
+
+		// stream choices made by the user, keyed by the layout signature of the file(s)
+		// and the stream type. ids are "source:index".
+		bool lookupSelection(const std::string& signature, std::vector<std::string>* ids);
+		void storeSelection(const std::string& signature, const std::vector<std::string>& ids);
+
+		// writes the cache (and remembered selections, if enabled) back to disk, if anything changed.
+		void save();
+	}
+
+	namespace verify
+	{
+		// chained like zlib's crc32(): start with 0, and pass the previous result back in.
+		uint32_t crc32c(uint32_t crc, const void* data, size_t len);
+
+		// updates the crc of a message after 'len' bytes in it changed from 'before' to 'after',
+		// with 'following' more bytes after them.
+		uint32_t crc32cPatch(uint32_t crc, const void* before, const void* after, size_t len, uint64_t following);
+
+		struct StreamTally
+		{
+			size_t packets = 0;
+			uint64_t bytes = 0;
+			uint32_t crc = 0;
+		};
+
+		// indexed by output stream.
+		using Tally = std::vector<StreamTally>;
+
+		void add(Tally& tally, const AVPacket* pkt);
+
+		// logs every stream that doesn't match; returns true if they all do.
+		bool compare(const Tally& in, const Tally& out);
+	}
+
+	// every '--checkpoint-interval' of output (at the end of a cluster), the partial output is synced and a
+	// checkpoint saved next to it, so that '--resume' can continue the remux from there.
+	namespace checkpoint
+	{
+		struct Tracker;
+
+		// returns null if checkpoints are off. 'key' identifies the inputs and settings that the output is
+		// made from; with '--resume', a checkpoint from an earlier run with the same key is picked up.
+		Tracker* create(const std::fs::path& output, AVFormatContext* outctx, const std::string& key);
+
+		// how much of the partial output to keep, if we're resuming (0 if not); and the 'output_ts_offset'
+		// the muxer needs, to shift timestamps the same way it did before.
+		uint64_t resumeOffset(Tracker* t);
+		int64_t timestampOffset(Tracker* t);
+
+		// call after writing the header. when resuming, checks that it came out the same size as before,
+		// then seeks the output to where it left off, and the input to a bit before that.
+		bool headerWritten(Tracker* t, AVFormatContext* outctx, AVFormatContext* inctx);
+
+		// when resuming, true for packets (already in the output's time base) that were written before.
+		bool skip(Tracker* t, const AVPacket* pkt);
+
+		// the input wasn't seeked back far enough, or the new part doesn't line up with the old.
+		bool failed(Tracker* t);
+
+		// every packet that goes to the muxer, in order.
+		void fed(Tracker* t, const AVPacket* pkt);
+
+		// bytes appended to the output at 'offset'; returns true if a checkpoint should be saved, once
+		// everything written so far is on disk.
+		bool scan(Tracker* t, uint64_t offset, const uint8_t* data, size_t len);
+		void save(Tracker* t);
+
+		// after the output is closed: puts back the cues from before resuming, removes the checkpoint,
+		// and frees the tracker. returns false if 'ok' was, or the output couldn't be fixed up.
+		bool finish(Tracker* t, const std::fs::path& output, bool ok);
+	}
+
+	namespace output
+	{
+		struct Stats
+		{
+			const char* backend = "";
+
+			size_t writes = 0;
+			size_t bytes = 0;
+
+			// how much space was allocated up front.
+			uint64_t preallocated = 0;
+
+			// crc32c of the whole file, as it ended up on disk (not for the null output).
+			bool checksummed = false;
+			uint32_t checksum = 0;
+
+			size_t maxQueueDepth = 0;
+			double avgQueueDepth = 0;
+
+			uint64_t avgLatencyNs = 0;
+			uint64_t maxLatencyNs = 0;
+		};
+
+		struct Writer;
+
+		// io_uring if we have it, a writer thread if we don't. if the final size can be guessed, that much
+		// is allocated up front (so the file isn't fragmented by lots of small appends). everything appended
+		// is also given to 'tracker', if there is one.
+		Writer* open(const std::fs::path& path, uint64_t sizeHint = 0, checkpoint::Tracker* tracker = nullptr);
+
+		// keeps the first 'length' bytes of an existing file, for resuming from a checkpoint; writes past
+		// there append to it. there's no checksum, since the start of the file wasn't hashed.
+		Writer* reopen(const std::fs::path& path, uint64_t length, checkpoint::Tracker* tracker);
+		AVIOContext* getContext(Writer* w);
+		Stats getStats(Writer* w);
+
+		// discards everything written to it (for '--bench-mux').
+		Writer* openNull();
+
+		// flushes everything and closes the file; returns false if any write failed.
+		bool close(Writer* w, Stats* stats = nullptr);
+	}
+
+	namespace interleave
+	{
+		struct Stats
+		{
+			size_t peakPackets = 0;
+			uint64_t peakBytes = 0;
+			uint64_t peakSpanNs = 0;
+
+			// packets that had to be written before every stream had caught up.
+			size_t deltaFlushes = 0;
+			size_t memoryFlushes = 0;
+		};
+
+		struct Interleaver;
+
+		// packets are buffered for at most 'maxDeltaSecs' of stream time, and 'maxBytes' in total (0 for no limit).
+		// every packet the muxer accepts is added to 'muxed', and every one handed to it is given to 'tracker' (if any).
+		Interleaver* create(AVFormatContext* outctx, double maxDeltaSecs, uint64_t maxBytes, verify::Tally* muxed,
+			checkpoint::Tracker* tracker = nullptr);
+
+		// takes the packet's data (leaving it blank); returns false if writing failed.
+		bool write(Interleaver* il, AVPacket* pkt);
+
+		// writes out whatever is left, and frees the interleaver.
+		bool finish(Interleaver* il, Stats* stats = nullptr);
+	}
+
+	namespace bench
+	{
+		struct Recorder;
+
+		// these do nothing (and begin returns null) unless '--bench-mux' was given.
+		Recorder* begin(AVFormatContext* outctx);
+		void subtitleBuffer(Recorder* r, size_t packets, uint64_t bytes);
+		void packet(Recorder* r, const AVPacket* pkt);
+		void dropped(Recorder* r);
+		void end(Recorder* r, const output::Stats& ws, const interleave::Stats& is);
+	}
 }
 
 
@@ -426,6 +934,22 @@ namespace tag
 		MovieMetadata fetchMovieMetadata(const std::string& title, int year, const std::string& manualId);
 	}
 
+	namespace http
+	{
+		using Params = std::vector<std::pair<std::string, std::string>>;
+
+		// the parts of cpr::Response that we use; 'url' includes the query parameters.
+		struct Response
+		{
+			long status_code = 0;
+			std::string url;
+			std::string text;
+		};
+
+		Response get(const std::string& url, const Params& params = { }, const Params& headers = { });
+		Response post(const std::string& url, const std::string& body, const Params& headers = { });
+	}
+
 	namespace cache
 	{
 		std::string getSeriesId(const std::string& name);
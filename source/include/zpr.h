@@ -152,119 +152,123 @@ namespace zpr
 		}
 
 
-		inline std::string skip(const char* fmt, const char** end)
+		inline void skip(std::string& out, const char* fmt, const char** end)
 		{
-			std::string ret;
-
 			top:
 			while(*fmt && *fmt != '%')
-				ret += *fmt++;
+				out += *fmt++;
 
 			if(*fmt && fmt[1] == '%')
 			{
-				ret += "%";
+				out += "%";
 				fmt += 2;
 				goto top;
 			}
 
 			*end = fmt;
-			return ret;
 		}
 
-		inline std::string sprint(const char* &fmt)
+		// everything appends to 'out', so formatting into a buffer that's kept around doesn't allocate
+		// once the buffer is big enough (only the formatters' own strings are temporary).
+		inline void sprint(std::string& out, const char* fmt)
 		{
-			return std::string(fmt);
+			out.append(fmt);
 		}
 
 		// we need to forward declare this.
 		template <typename... Args>
-		std::string sprint(const char* fmt, Args&&... xs);
+		void sprint(std::string& out, const char* fmt, Args&&... xs);
 
 
 
 		// we need bogus ones that don't take the arguments. if we get error handling, these will throw errors.
 		template <typename... Args>
-		std::string _consume_both_sprint(const format_args&, const char* fmt, Args&&... xs)
+		void _consume_both_sprint(std::string& out, const format_args&, const char* fmt, Args&&... xs)
 		{
-			return std::string("<missing width and prec>")
-				.append(sprint(fmt, xs...));
+			out.append("<missing width and prec>");
+			sprint(out, fmt, xs...);
 		}
 
 		template <typename... Args>
-		std::string _consume_prec_sprint(const format_args&, const char* fmt, Args&&... xs)
+		void _consume_prec_sprint(std::string& out, const format_args&, const char* fmt, Args&&... xs)
 		{
-			return std::string("<missing prec>")
-				.append(sprint(fmt, xs...));
+			out.append("<missing prec>");
+			sprint(out, fmt, xs...);
 		}
 
 		template <typename... Args>
-		std::string _consume_width_sprint(const format_args&, const char* fmt, Args&&... xs)
+		void _consume_width_sprint(std::string& out, const format_args&, const char* fmt, Args&&... xs)
 		{
-			return std::string("<missing width>")
-				.append(sprint(fmt, xs...));
+			out.append("<missing width>");
+			sprint(out, fmt, xs...);
 		}
 
 		template <typename T, typename... Args>
-		std::string _consume_neither_sprint(const format_args& args, const char* fmt, T&& x, Args&&... xs)
+		void _consume_neither_sprint(std::string& out, const format_args& args, const char* fmt, T&& x, Args&&... xs)
 		{
-			return print_formatter<std::decay_t<T>>()
-				.print(x, args)
-				.append(sprint(fmt, xs...));
+			out.append(print_formatter<std::decay_t<T>>().print(x, args));
+			sprint(out, fmt, xs...);
 		}
 
 		template <typename W, typename T, typename... Args,
 			typename E = std::enable_if_t<std::is_integral_v<std::remove_reference_t<W>>>>
-		std::string _consume_width_sprint(format_args args, const char* fmt, W&& width, T&& x, Args&&... xs)
+		void _consume_width_sprint(std::string& out, format_args args, const char* fmt, W&& width, T&& x, Args&&... xs)
 		{
 			args.width = width;
 
-			return print_formatter<std::decay_t<T>>()
-				.print(x, args)
-				.append(sprint(fmt, xs...));
+			out.append(print_formatter<std::decay_t<T>>().print(x, args));
+			sprint(out, fmt, xs...);
 		}
 
 
 		template <typename P, typename T, typename... Args,
 			typename E = std::enable_if_t<std::is_integral_v<std::remove_reference_t<P>>>>
-		std::string _consume_prec_sprint(format_args args, const char* fmt, P&& prec, T&& x, Args&&... xs)
+		void _consume_prec_sprint(std::string& out, format_args args, const char* fmt, P&& prec, T&& x, Args&&... xs)
 		{
 			args.precision = prec;
 
-			return print_formatter<std::decay_t<T>>()
-				.print(x, args)
-				.append(sprint(fmt, xs...));
+			out.append(print_formatter<std::decay_t<T>>().print(x, args));
+			sprint(out, fmt, xs...);
 		}
 
 		template <typename W, typename P, typename T, typename... Args,
 			typename E = std::enable_if_t<std::is_integral_v<std::remove_reference_t<W>>
 				&& std::is_integral_v<std::remove_reference_t<P>>>>
-		std::string _consume_both_sprint(format_args args, const char* fmt, W&& width, P&& prec, T&& x, Args&&... xs)
+		void _consume_both_sprint(std::string& out, format_args args, const char* fmt, W&& width, P&& prec, T&& x, Args&&... xs)
 		{
 			args.width = width;
 			args.precision = prec;
 
-			return print_formatter<std::decay_t<T>>()
-				.print(x, args)
-				.append(sprint(fmt, xs...));
+			out.append(print_formatter<std::decay_t<T>>().print(x, args));
+			sprint(out, fmt, xs...);
 		}
 
 
 		template <typename... Args>
-		std::string sprint(const char* fmt, Args&&... xs)
+		void sprint(std::string& out, const char* fmt, Args&&... xs)
 		{
 			bool need_prec = false;
 			bool need_width = false;
 
-			std::string ret = skip(fmt, &fmt);
+			skip(out, fmt, &fmt);
 
 			auto args = parseFormatArgs(fmt, &fmt, &need_width, &need_prec);
 
 			// because the if happens at runtime, all these functions need to be instantiable. that's
 			// why we make bogus ones that just return error strings when there aren't enough arguments.
-			if(need_width && need_prec) return ret.append(_consume_both_sprint(args, fmt, xs...));
-			else if(need_prec)          return ret.append(_consume_prec_sprint(args, fmt, xs...));
-			else if(need_width)         return ret.append(_consume_width_sprint(args, fmt, xs...));
-			else                        return ret.append(_consume_neither_sprint(args, fmt, xs...));
+			if(need_width && need_prec) _consume_both_sprint(out, args, fmt, xs...);
+			else if(need_prec)          _consume_prec_sprint(out, args, fmt, xs...);
+			else if(need_width)         _consume_width_sprint(out, args, fmt, xs...);
+			else                        _consume_neither_sprint(out, args, fmt, xs...);
+		}
+
+		template <typename... Args>
+		std::string sprint(const char* fmt, Args&&... xs)
+		{
+			std::string ret;
+			sprint(ret, fmt, xs...);
+
+			return ret;
 		}
 	}
 
@@ -292,6 +296,13 @@ namespace zpr
 		return _internal::sprint(fmt.c_str(), xs...);
 	}
 
+	// appends to 'out' instead of making a new string.
+	template <typename... Args>
+	void sprint_into(std::string& out, const std::string& fmt, Args&&... xs)
+	{
+		_internal::sprint(out, fmt.c_str(), xs...);
+	}
+
 	template <typename... Args>
 	int print(const std::string& fmt, Args&&... xs)
 	{
@@ -0,0 +1,376 @@
+// journal.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <map>
+#include <mutex>
+#include <fstream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "defs.h"
+
+#include "picojson.h"
+namespace pj = picojson;
+
+// a record of which stages each file has been through, so that a run that died halfway
+// can be picked up again with '--resume'. files are identified by a fingerprint of their contents rather
+// than their name, since tagging can rename them (and the same file might be given from another path).
+namespace journal
+{
+	// enough to tell apart files of the same size and mtime (eg. copied with 'cp -p') without reading
+	// all of them -- the start has the segment info and tracks, the end has the cues and tags.
+	static constexpr size_t FINGERPRINT_BLOCK = 64 * 1024;
+
+	// runs without '--resume' don't read the journal, so past this it's compacted anyway.
+	static constexpr uintmax_t COMPACT_SIZE = 16 * 1024 * 1024;
+
+	struct Record
+	{
+		Stage stage;
+		std::string fingerprint;
+		std::fs::path input;
+		std::fs::path output;
+	};
+
+	static std::mutex lock;
+
+	static int fd = -1;
+
+	// keyed by the fingerprint of the input, and of the output (so a file tagged in place, whose
+	// fingerprint changed, is still recognised).
+	static std::unordered_map<std::string, Progress> inputs;
+	static std::unordered_map<std::string, std::string> outputs;
+
+	// records for staged outputs, which are only written once the output has its real name (and is on
+	// disk); keyed by the temporary path.
+	static std::unordered_map<std::string, std::vector<Record>> pending;
+
+	static thread_local std::string currentFingerprint;
+	static thread_local std::fs::path currentInput;
+
+	static const char* stage_name(Stage s)
+	{
+		switch(s)
+		{
+			case Stage::Muxed:      return "muxed";
+			case Stage::Tagged:     return "tagged";
+			case Stage::Renamed:    return "renamed";
+		}
+
+		return "";
+	}
+
+	static std::fs::path get_journal_path()
+	{
+		if(auto x = config::getJournalPath(); !x.empty())
+			return x;
+
+		if(auto x = util::getEnvironmentVar("XDG_CACHE_HOME"); !x.empty())
+			return std::fs::path(x) / "mkvtaginator" / "journal.jsonl";
+
+		if(auto x = util::getEnvironmentVar("HOME"); !x.empty())
+			return std::fs::path(x) / ".cache" / "mkvtaginator" / "journal.jsonl";
+
+		return "";
+	}
+
+	static std::string fingerprint(const std::fs::path& path)
+	{
+		util::FileStat st;
+		if(!util::statFile(path.string(), &st))
+			return "";
+
+		int f = ::open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+		if(f < 0)
+			return "";
+
+		defer(::close(f));
+
+		auto buf = std::vector<uint8_t>(FINGERPRINT_BLOCK);
+		auto hash_at = [&](uint64_t offset) -> uint32_t {
+			auto n = pread(f, buf.data(), buf.size(), static_cast<off_t>(offset));
+			return n > 0 ? mux::verify::crc32c(0, buf.data(), static_cast<size_t>(n)) : 0;
+		};
+
+		auto head = hash_at(0);
+		auto tail = hash_at(st.size > FINGERPRINT_BLOCK ? st.size - FINGERPRINT_BLOCK : 0);
+
+		return util::join({ std::to_string(st.size), std::to_string(st.mtime), zpr::sprint("%08x", head),
+			zpr::sprint("%08x", tail) }, ":");
+	}
+
+	static void apply(const std::string& fp, Stage stage, const std::string& output, const std::string& outputFp)
+	{
+		auto& p = inputs[fp];
+		switch(stage)
+		{
+			case Stage::Muxed:      p.muxed = true; break;
+			case Stage::Tagged:     p.tagged = true; break;
+			case Stage::Renamed:    p.renamed = true; break;
+		}
+
+		p.output = output;
+
+		if(!outputFp.empty() && outputFp != fp)
+			outputs[outputFp] = fp;
+	}
+
+	// rewrites the journal with only the last record of each stage of each file, dropping the files whose
+	// output has since gone away (they'd just be started over anyway). the rest of the records are only
+	// superseded, so the result resumes exactly the same way; 'lines' is in the original order.
+	static void compact(const std::fs::path& path, const std::vector<std::pair<std::string, std::string>>& lines,
+		size_t total)
+	{
+		auto tmp = path.string() + ".tmp";
+		size_t kept = 0;
+		{
+			auto out = std::ofstream(tmp, std::ios::binary | std::ios::trunc);
+			if(!out.good())
+			{
+				util::warn("warn: failed to compact journal '%s'", path.string());
+				return;
+			}
+
+			for(auto& [ fp, line ] : lines)
+			{
+				if(auto& p = inputs[fp]; !p.output.empty() && !std::fs::exists(p.output))
+					continue;
+
+				out << line << "\n";
+				kept += 1;
+			}
+
+			out.flush();
+			if(!out.good())
+			{
+				util::warn("warn: failed to compact journal '%s'", path.string());
+				return;
+			}
+		}
+
+		std::error_code ec;
+		std::fs::rename(tmp, path, ec);
+		if(ec)
+		{
+			util::warn("warn: failed to compact journal '%s'", path.string());
+			return;
+		}
+
+		if(kept < total)
+			util::log("compacted journal (%d %s down to %d)", total, util::plural("record", total), kept);
+	}
+
+	static void load()
+	{
+		auto path = get_journal_path();
+		if(path.empty())
+			return;
+
+		bool writable = !config::isDryRun() && !(config::isBenchmarkingMux() && !config::isTagging());
+
+		// a run without '--resume' only appends, so it's compacted here too once it gets big enough.
+		std::error_code ec;
+		auto size = std::fs::file_size(path, ec);
+		bool shouldCompact = writable && !ec && size > 0 && (config::isResuming() || size > COMPACT_SIZE);
+
+		if(config::isResuming() || shouldCompact)
+		{
+			auto in = std::ifstream(path);
+
+			// the last line for each (fingerprint, stage), by its index in 'lines'.
+			std::vector<std::pair<std::string, std::string>> lines;
+			std::map<std::pair<std::string, Stage>, size_t> latest;
+
+			size_t count = 0;
+			for(std::string line; std::getline(in, line); )
+			{
+				// a crash can leave the last line half-written; that stage just gets done again.
+				pj::value v;
+				if(!pj::parse(v, line).empty() || !v.is<pj::object>())
+					continue;
+
+				auto& s = v.get("stage");
+				auto& fp = v.get("fingerprint");
+				if(!s.is<std::string>() || !fp.is<std::string>())
+					continue;
+
+				auto out = v.get("output").is<std::string>() ? v.get("output").get<std::string>() : "";
+				auto ofp = v.get("output_fingerprint").is<std::string>() ? v.get("output_fingerprint").get<std::string>() : "";
+
+				Stage stage;
+				if(s.get<std::string>() == "muxed")         stage = Stage::Muxed;
+				else if(s.get<std::string>() == "tagged")   stage = Stage::Tagged;
+				else if(s.get<std::string>() == "renamed")  stage = Stage::Renamed;
+				else                                        continue;
+
+				apply(fp.get<std::string>(), stage, out, ofp);
+				count += 1;
+
+				if(auto [ it, added ] = latest.try_emplace({ fp.get<std::string>(), stage }, lines.size()); !added)
+				{
+					lines[it->second].second.clear();
+					it->second = lines.size();
+				}
+
+				lines.emplace_back(fp.get<std::string>(), std::move(line));
+			}
+
+			if(config::isResuming())
+			{
+				util::log("resuming from '%s' (%d %s for %d %s)", path.string(), count, util::plural("record", count),
+					inputs.size(), util::plural("file", inputs.size()));
+			}
+
+			if(shouldCompact)
+			{
+				lines.erase(std::remove_if(lines.begin(), lines.end(), [](const auto& l) -> bool {
+					return l.second.empty();
+				}), lines.end());
+
+				compact(path, lines, count);
+			}
+		}
+
+		if(!writable)
+			return;
+
+		std::fs::create_directories(path.parent_path(), ec);
+
+		fd = ::open(path.string().c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if(fd < 0)
+		{
+			util::warn("warn: failed to open journal '%s'; this run can't be resumed", path.string());
+			return;
+		}
+
+		// finish off a half-written line, so the next record doesn't get glued onto it.
+		if(auto end = lseek(fd, 0, SEEK_END); end > 0)
+		{
+			char last = 0;
+			if(pread(fd, &last, 1, end - 1) == 1 && last != '\n')
+				(void) !write(fd, "\n", 1);
+		}
+	}
+
+	// must be called with the lock held.
+	static void append(const Record& r, const std::string& outputFp)
+	{
+		apply(r.fingerprint, r.stage, r.output.string(), outputFp);
+
+		if(fd < 0)
+			return;
+
+		pj::object obj;
+		obj["stage"]                = pj::value(std::string(stage_name(r.stage)));
+		obj["fingerprint"]          = pj::value(r.fingerprint);
+		obj["input"]                = pj::value(r.input.string());
+		obj["output"]               = pj::value(r.output.string());
+		obj["output_fingerprint"]   = pj::value(outputFp);
+
+		// one write per line, so lines from different jobs can't interleave (O_APPEND).
+		auto line = pj::value(obj).serialise() + "\n";
+		if(write(fd, line.c_str(), line.size()) != static_cast<ssize_t>(line.size()))
+			util::warn("warn: failed to write to journal");
+	}
+
+
+
+
+	void open()
+	{
+		auto lk = std::unique_lock(lock);
+		load();
+	}
+
+	Progress beginFile(const std::fs::path& input)
+	{
+		currentInput = std::fs::absolute(input);
+		currentFingerprint = fingerprint(input);
+
+		if(!config::isResuming() || currentFingerprint.empty())
+			return { };
+
+		auto lk = std::unique_lock(lock);
+
+		Progress ret;
+		if(auto it = inputs.find(currentFingerprint); it != inputs.end())
+		{
+			ret = it->second;
+		}
+		else if(auto it = outputs.find(currentFingerprint); it != outputs.end())
+		{
+			// the file is itself an output of an earlier run (eg. tagged in place, then renamed).
+			ret = inputs[it->second];
+			ret.output = currentInput;
+		}
+
+		// if the output went away since, start over.
+		if(!ret.output.empty() && !std::fs::exists(ret.output))
+		{
+			util::log("'%s' (from an earlier run) is missing; starting over", ret.output.filename().string());
+			return { };
+		}
+
+		return ret;
+	}
+
+	void record(Stage stage, const std::fs::path& output)
+	{
+		if(config::isDryRun() || currentFingerprint.empty())
+			return;
+
+		auto r = Record { stage, currentFingerprint, currentInput, output };
+
+		// the output isn't finished until it has its real name; see staging.
+		if(auto temp = staging::resolve(output); temp != output)
+		{
+			auto lk = std::unique_lock(lock);
+			pending[temp.string()].push_back(std::move(r));
+			return;
+		}
+
+		auto outputFp = fingerprint(output);
+
+		auto lk = std::unique_lock(lock);
+		append(r, outputFp);
+	}
+
+	void committed(const std::fs::path& temp, const std::fs::path& final)
+	{
+		std::vector<Record> records;
+		{
+			auto lk = std::unique_lock(lock);
+			if(auto it = pending.find(temp.string()); it != pending.end())
+			{
+				records = std::move(it->second);
+				pending.erase(it);
+			}
+		}
+
+		if(records.empty())
+			return;
+
+		auto outputFp = fingerprint(final);
+
+		auto lk = std::unique_lock(lock);
+		for(auto& r : records)
+		{
+			r.output = final;
+			append(r, outputFp);
+		}
+	}
+
+	void close()
+	{
+		auto lk = std::unique_lock(lock);
+		if(fd >= 0)
+		{
+			fsync(fd);
+			::close(fd);
+			fd = -1;
+		}
+	}
+}
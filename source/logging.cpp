@@ -0,0 +1,264 @@
+// logging.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <time.h>
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "defs.h"
+
+#include "picojson.h"
+namespace pj = picojson;
+
+// each thread formats into its own buffer, and only takes the console lock to write out complete
+// lines (or, for buffered blocks, the whole block at once), so concurrent jobs don't interleave.
+// messages are formatted straight into that buffer -- a buffered block is one string that lines
+// are appended to, so nothing is copied on the way out.
+namespace util
+{
+	// a line of a buffered block, as a range of the block.
+	struct Line
+	{
+		FILE* out = 0;
+		size_t start = 0;
+		size_t end = 0;
+	};
+
+	static std::atomic<int> threadCounter = 0;
+
+	struct LogContext
+	{
+		int indent = 0;
+		int thread = threadCounter++;
+
+		std::string job;
+		bool buffered = false;
+
+		std::string block;
+		std::vector<Line> lines;
+
+		// unbuffered lines are put together here.
+		std::string scratch;
+
+		// where the line being written starts, and its message (after the prefix).
+		size_t lineStart = 0;
+		size_t messageStart = 0;
+	};
+
+	static thread_local LogContext context;
+
+	static std::recursive_mutex consoleLock;
+
+	static std::mutex jsonLock;
+	static FILE* jsonLog = 0;
+
+	static const char* level_name(LogLevel level)
+	{
+		switch(level)
+		{
+			case LogLevel::Log:     return "log";
+			case LogLevel::Info:    return "info";
+			case LogLevel::Warn:    return "warn";
+			case LogLevel::Error:   return "error";
+			case LogLevel::Raw:     return "raw";
+		}
+
+		return "";
+	}
+
+	static const char* level_colour(LogLevel level)
+	{
+		switch(level)
+		{
+			case LogLevel::Log:     return COLOUR_GREEN_BOLD;
+			case LogLevel::Info:    return COLOUR_BLUE_BOLD;
+			case LogLevel::Warn:    return COLOUR_YELLOW_BOLD;
+			case LogLevel::Error:   return COLOUR_RED_BOLD;
+			case LogLevel::Raw:     return "";
+		}
+
+		return "";
+	}
+
+	static std::string strip_colours(std::string_view s)
+	{
+		std::string ret;
+		ret.reserve(s.size());
+
+		for(size_t i = 0; i < s.size(); i++)
+		{
+			if(s[i] == '\x1b' && i + 1 < s.size() && s[i + 1] == '[')
+			{
+				// skip to the final byte of the sequence.
+				i += 2;
+				while(i < s.size() && !(('A' <= s[i] && s[i] <= 'Z') || ('a' <= s[i] && s[i] <= 'z')))
+					i++;
+
+				continue;
+			}
+
+			ret += s[i];
+		}
+
+		return ret;
+	}
+
+	static std::string timestamp()
+	{
+		auto now = std::chrono::system_clock::now();
+		auto secs = std::chrono::system_clock::to_time_t(now);
+		auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+
+		struct tm tm;
+	#if OS_WINDOWS
+		gmtime_s(&tm, &secs);
+	#else
+		gmtime_r(&secs, &tm);
+	#endif
+
+		char buf[32] = { };
+		strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+
+		return zpr::sprint("%s.%03dZ", buf, static_cast<int>(ms));
+	}
+
+	static void write_json(LogLevel level, std::string_view msg)
+	{
+		if(level == LogLevel::Raw && msg.empty())
+			return;
+
+		pj::object obj;
+		obj["time"]     = pj::value(timestamp());
+		obj["level"]    = pj::value(level_name(level));
+		obj["thread"]   = pj::value(static_cast<int64_t>(context.thread));
+		obj["indent"]   = pj::value(static_cast<int64_t>(context.indent));
+		obj["message"]  = pj::value(strip_colours(msg));
+
+		if(!context.job.empty())
+			obj["job"] = pj::value(context.job);
+
+		auto line = pj::value(obj).serialise();
+		line += "\n";
+
+		auto lk = std::unique_lock(jsonLock);
+		fwrite(line.data(), 1, line.size(), jsonLog);
+		fflush(jsonLog);
+	}
+
+	static void write_lines(const std::string& block, const std::vector<Line>& lines)
+	{
+		auto lk = std::unique_lock(consoleLock);
+		progress::clear();
+
+		FILE* prev = 0;
+		for(const auto& line : lines)
+		{
+			// keep stdout and stderr in order, if they happen to be going to the same place.
+			if(prev && prev != line.out)
+				fflush(prev);
+
+			fwrite(block.data() + line.start, 1, line.end - line.start, line.out);
+			prev = line.out;
+		}
+
+		fflush(stdout);
+		fflush(stderr);
+	}
+
+	std::string& begin_log(LogLevel level)
+	{
+		auto& buf = (context.buffered ? context.block : context.scratch);
+		if(!context.buffered)
+			buf.clear();
+
+		context.lineStart = buf.size();
+
+		if(level != LogLevel::Raw)
+		{
+			buf.append(2 * context.indent, ' ');
+			buf.append(" ").append(level_colour(level)).append("*").append(COLOUR_RESET).append(" ");
+		}
+
+		context.messageStart = buf.size();
+		return buf;
+	}
+
+	void end_log(LogLevel level)
+	{
+		auto& buf = (context.buffered ? context.block : context.scratch);
+
+		if(jsonLog)
+			write_json(level, std::string_view(buf).substr(context.messageStart));
+
+		buf.append("\n");
+
+		auto out = (level == LogLevel::Error ? stderr : stdout);
+		if(context.buffered)
+		{
+			context.lines.push_back(Line { out, context.lineStart, buf.size() });
+		}
+		else
+		{
+			auto lk = std::unique_lock(consoleLock);
+			progress::clear();
+
+			fwrite(buf.data() + context.lineStart, 1, buf.size() - context.lineStart, out);
+			fflush(out);
+		}
+	}
+
+	void write_log(LogLevel level, const std::string& msg)
+	{
+		begin_log(level).append(msg);
+		end_log(level);
+	}
+
+	void begin_log_block(const std::string& job, bool buffered)
+	{
+		flush_log();
+
+		context.job = job;
+		context.buffered = buffered;
+	}
+
+	void end_log_block()
+	{
+		flush_log();
+
+		context.job.clear();
+		context.buffered = false;
+	}
+
+	void flush_log()
+	{
+		if(context.lines.empty())
+			return;
+
+		write_lines(context.block, context.lines);
+		context.lines.clear();
+		context.block.clear();
+	}
+
+	std::unique_lock<std::recursive_mutex> lock_console()
+	{
+		flush_log();
+		return std::unique_lock(consoleLock);
+	}
+
+	bool open_json_log(const std::string& path)
+	{
+		auto lk = std::unique_lock(jsonLock);
+		if(jsonLog)
+			fclose(jsonLog);
+
+		jsonLog = fopen(path.c_str(), "ab");
+		return jsonLog != nullptr;
+	}
+
+	void indent_log(int n)    { context.indent += n; }
+	void unindent_log(int n)  { context.indent = std::max(0, context.indent - n); }
+	int get_log_indent()      { return context.indent; }
+}
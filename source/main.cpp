@@ -9,23 +9,39 @@ int main(int argc, char** argv)
 	config::readConfig();
 	auto files = args::parseCmdLineOpts(argc, argv);
 
+	if(auto x = config::getJsonLogPath(); !x.empty() && !util::open_json_log(x))
+		util::error("failed to open '%s' for json logging", x);
+
+	if(auto x = config::getTracePath(); !x.empty() && !trace::open(x))
+		util::error("failed to open '%s' for tracing", x);
+
 	util::info("received %zu %s", files.size(), util::plural("file", files.size()));
 	if(config::getEpisodeNumber() != -1 && files.size() > 1)
 		util::warn("warn: using '--episode' with more than one input file");
 
+	priority::enterBackground();
 	driver::createOutputFolder();
+	journal::open();
 
 	auto paths = driver::collectFiles(files);
 
-	size_t doneFiles = 0;
-	for(const auto& filepath : paths)
-	{
-		auto ok = driver::processOneFile(filepath);
+	auto doneFiles = driver::processFiles(paths);
 
-		if(ok) doneFiles += 1;
-	}
+	staging::commit(/* force: */ true);
+	journal::close();
+	mux::cache::save();
+	stats::report();
+	stats::writeMetrics(/* force: */ true);
+	trace::close();
 
 	util::info("processed %d %s", doneFiles, util::plural("file", doneFiles));
+
+	// every job is done by now (and so is the renderer), so this is safe.
+	if(driver::isStopping())
+	{
+		util::flush_log();
+		exit(-1);
+	}
 }
 
 
@@ -41,6 +57,30 @@ namespace driver
 	{
 		bool ok = true;
 
+		// with several jobs, print each file's log in one piece once it's done.
+		util::begin_log_block(filepath.filename().string(), /* buffered: */ config::getJobCount() > 1);
+		defer(util::end_log_block());
+
+		// whatever this file staged can be synced and renamed once we're done with it.
+		defer(staging::release());
+
+		// with '--resume', pick up from wherever an earlier run got to.
+		auto done = journal::beginFile(filepath);
+		bool muxed = config::isMuxing() && done.muxed;
+		bool tagged = config::isTagging() && done.tagged && (done.renamed || !config::shouldRenameFiles());
+
+		if((muxed || !config::isMuxing()) && (tagged || !config::isTagging()))
+		{
+			util::log("%s: already done", filepath.filename().string());
+			stats::addSkippedFile();
+			return true;
+		}
+
+		stats::beginFile(filepath.filename().string());
+
+		trace::begin(filepath.filename().string(), "file");
+		defer(trace::end({ { "ok", ok ? "true" : "false" } }));
+
 		util::log("%s", filepath.filename().string());
 		util::indent_log();
 
@@ -51,7 +91,15 @@ namespace driver
 			util::info("muxing");
 			util::indent_log();
 
-			ok &= mux::muxOneFile(targetFile);
+			if(muxed)
+			{
+				util::log("already muxed to '%s'", done.output.filename().string());
+				targetFile = done.output;
+			}
+			else
+			{
+				ok &= mux::muxOneFile(targetFile);
+			}
 
 			util::unindent_log();
 		}
@@ -61,13 +109,19 @@ namespace driver
 			util::info("tagging");
 			util::indent_log();
 
+			// tagged, but not renamed; tagging again is cheap (the metadata is cached), and renames it.
+			if(!config::isMuxing() && done.tagged)
+				targetFile = done.output;
+
 			ok &= tag::tagOneFile(targetFile);
 
 			util::unindent_log();
 		}
 
+		stats::endFile(ok);
+
 		util::unindent_log();
-		zpr::println("");
+		util::write_log(util::LogLevel::Raw, "");
 		return ok;
 	}
 
@@ -108,12 +162,14 @@ namespace driver
 			{
 				util::error("skipping nonexistent file '%s'", filepath.string());
 				if(config::shouldStopOnError()) exit(-1);
+				stats::addSkippedFile();
 				continue;
 			}
 			else if(filepath.extension() != ".mkv")
 			{
 				util::error("ignoring non-mkv file (extension was '%s')", filepath.extension().string());
 				if(config::shouldStopOnError()) exit(-1);
+				stats::addSkippedFile();
 				continue;
 			}
 
@@ -124,6 +180,7 @@ namespace driver
 				{
 					util::error("skipping input file overlapping with output folder");
 					if(config::shouldStopOnError()) exit(-1);
+					stats::addSkippedFile();
 					continue;
 				}
 			}
@@ -134,6 +191,7 @@ namespace driver
 					util::lowercase(n).find("creditless") != std::string::npos))
 			{
 				util::log("skipping file '%s'", filepath.filename().string());
+				stats::addSkippedFile();
 				continue;
 			}
 
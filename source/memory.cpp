@@ -0,0 +1,138 @@
+// memory.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <set>
+#include <mutex>
+#include <atomic>
+
+#include "defs.h"
+
+// a rough account of the memory each running job holds, for '--max-memory'. jobs are only started while
+// the total of their estimates (or what they are really using, if that is more) fits in the budget. only
+// the big things are tracked -- the interleave queue, buffered subtitle packets, and parsed json responses.
+namespace memory
+{
+	// libavformat's probe and io buffers, the stream info, tag xml, and so on; none of these are tracked.
+	static constexpr uint64_t BASE_ESTIMATE = 48 * 1024 * 1024;
+
+	// with no interleave limit, assume the queue could hold this much of the file at once.
+	static constexpr uint64_t UNBOUNDED_INTERLEAVE = 512 * 1024 * 1024;
+
+	struct Account
+	{
+		uint64_t estimate = 0;
+
+		std::atomic<int64_t> used = 0;
+		std::atomic<int64_t> peak = 0;
+	};
+
+	static std::mutex lock;
+	static std::set<Account*> accounts;
+
+	static thread_local Account* current = 0;
+
+	static uint64_t charged(const Account* a)
+	{
+		return std::max(a->estimate, static_cast<uint64_t>(std::max(int64_t(0), a->used.load())));
+	}
+
+
+
+
+	uint64_t estimate(const std::fs::path& path)
+	{
+		uint64_t ret = BASE_ESTIMATE;
+		if(!config::isMuxing())
+			return ret;
+
+		if(auto limit = config::getInterleaveBufferSize(); limit > 0)
+		{
+			ret += static_cast<uint64_t>(limit) * 1024 * 1024;
+		}
+		else
+		{
+			// the queue can't hold more than the whole file.
+			std::error_code ec;
+			auto size = std::fs::file_size(path, ec);
+
+			ret += ec ? UNBOUNDED_INTERLEAVE : std::min(static_cast<uint64_t>(size), UNBOUNDED_INTERLEAVE);
+		}
+
+		return ret;
+	}
+
+	bool fits(uint64_t estimate)
+	{
+		auto budget = config::getMemoryBudget();
+		if(budget == 0)
+			return true;
+
+		auto lk = std::unique_lock(lock);
+
+		// one job always runs, even if it alone is over the budget.
+		if(accounts.empty())
+			return true;
+
+		uint64_t total = 0;
+		for(auto a : accounts)
+			total += charged(a);
+
+		return total + estimate <= budget;
+	}
+
+	uint64_t inUse()
+	{
+		auto lk = std::unique_lock(lock);
+
+		uint64_t total = 0;
+		for(auto a : accounts)
+			total += charged(a);
+
+		return total;
+	}
+
+	Account* reserve(uint64_t estimate)
+	{
+		auto a = new Account();
+		a->estimate = estimate;
+
+		auto lk = std::unique_lock(lock);
+		accounts.insert(a);
+
+		return a;
+	}
+
+	uint64_t release(Account* a)
+	{
+		{
+			auto lk = std::unique_lock(lock);
+			accounts.erase(a);
+		}
+
+		auto peak = static_cast<uint64_t>(a->peak.load());
+		delete a;
+
+		return peak;
+	}
+
+	void attach(Account* a)
+	{
+		current = a;
+	}
+
+	void charge(int64_t bytes)
+	{
+		if(!current)
+			return;
+
+		auto now = (current->used += bytes);
+
+		auto peak = current->peak.load();
+		while(now > peak && !current->peak.compare_exchange_weak(peak, now))
+			;
+	}
+
+	Charge::Charge(uint64_t bytes) : bytes(bytes)   { charge(static_cast<int64_t>(bytes)); }
+	Charge::~Charge()                               { charge(-static_cast<int64_t>(this->bytes)); }
+}
@@ -220,6 +220,12 @@ namespace misc
 	{
 		size_t size = (limit == 0 ? options.size() : std::min(limit, options.size()));
 
+		auto console = util::lock_console();
+		progress::clear();
+
+		trace::begin("user input", "wait");
+		defer(trace::end());
+
 		auto more = print_options(options, first, limit);
 
 		zpr::print("%s %s*%s selection [%d - %d, 0 to skip%s]: ", std::string(2 * util::get_log_indent(), ' '),
@@ -251,6 +257,12 @@ namespace misc
 
 	std::vector<size_t> userChoiceMultiple(const std::vector<Option>& options)
 	{
+		auto console = util::lock_console();
+		progress::clear();
+
+		trace::begin("user input", "wait");
+		defer(trace::end());
+
 		print_options(options, 0, options.size());
 
 		auto pad = std::string(2 * util::get_log_indent(), ' ');
@@ -0,0 +1,180 @@
+// benchmark.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <chrono>
+#include <malloc.h>
+
+#include "defs.h"
+
+extern "C" {
+	#include <libavformat/avformat.h>
+}
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	#define HAVE_MALLINFO2 1
+#else
+	#define HAVE_MALLINFO2 0
+#endif
+
+// accounting for '--bench-mux'; this watches the packets going to the interleaver.
+namespace mux::bench
+{
+	// the heap is only sampled every so often; mallinfo2 walks every arena.
+	static constexpr size_t HEAP_SAMPLE_INTERVAL = 1024;
+
+	struct StreamCounts
+	{
+		std::string desc;
+
+		size_t packets = 0;
+		uint64_t bytes = 0;
+	};
+
+	struct Recorder
+	{
+		std::vector<StreamCounts> streams;
+
+		size_t packets = 0;
+		uint64_t bytes = 0;
+		size_t dropped = 0;
+
+		size_t subtitlePackets = 0;
+		uint64_t subtitleBytes = 0;
+
+		size_t baseHeap = 0;
+		size_t peakHeap = 0;
+
+		std::chrono::steady_clock::time_point start;
+	};
+
+	static size_t heap_in_use()
+	{
+	#if HAVE_MALLINFO2
+		auto mi = mallinfo2();
+		return mi.uordblks + mi.hblkhd;
+	#else
+		return 0;
+	#endif
+	}
+
+	static const char* type_name(int type)
+	{
+		switch(type)
+		{
+			case AVMEDIA_TYPE_VIDEO:        return "video";
+			case AVMEDIA_TYPE_AUDIO:        return "audio";
+			case AVMEDIA_TYPE_SUBTITLE:     return "subtitle";
+			case AVMEDIA_TYPE_ATTACHMENT:   return "attachment";
+			default:                        return "other";
+		}
+	}
+
+	static std::string format_size(uint64_t bytes)
+	{
+		if(bytes >= 1024 * 1024)    return zpr::sprint("%.1f MB", bytes / (1024.0 * 1024.0));
+		else if(bytes >= 1024)      return zpr::sprint("%.1f KB", bytes / 1024.0);
+		else                        return zpr::sprint("%d B", bytes);
+	}
+
+
+
+
+	Recorder* begin(AVFormatContext* outctx)
+	{
+		if(!config::isBenchmarkingMux())
+			return nullptr;
+
+		auto r = new Recorder();
+		for(unsigned i = 0; i < outctx->nb_streams; i++)
+		{
+			auto par = outctx->streams[i]->codecpar;
+
+			StreamCounts s;
+			s.desc = zpr::sprint("%s, %s", type_name(par->codec_type), avcodec_get_name(par->codec_id));
+
+			r->streams.push_back(std::move(s));
+		}
+
+		r->baseHeap = heap_in_use();
+		r->peakHeap = r->baseHeap;
+		r->start = std::chrono::steady_clock::now();
+		return r;
+	}
+
+	void subtitleBuffer(Recorder* r, size_t packets, uint64_t bytes)
+	{
+		if(!r)
+			return;
+
+		r->subtitlePackets = std::max(r->subtitlePackets, packets);
+		r->subtitleBytes = std::max(r->subtitleBytes, bytes);
+	}
+
+	void packet(Recorder* r, const AVPacket* pkt)
+	{
+		if(!r)
+			return;
+
+		auto& s = r->streams[pkt->stream_index];
+		s.packets += 1;
+		s.bytes += pkt->size;
+
+		r->packets += 1;
+		r->bytes += pkt->size;
+
+		if(r->packets % HEAP_SAMPLE_INTERVAL == 0)
+			r->peakHeap = std::max(r->peakHeap, heap_in_use());
+	}
+
+	void dropped(Recorder* r)
+	{
+		if(r)
+			r->dropped += 1;
+	}
+
+	void end(Recorder* r, const output::Stats& ws, const interleave::Stats& is)
+	{
+		if(!r)
+			return;
+
+		defer(delete r);
+
+		r->peakHeap = std::max(r->peakHeap, heap_in_use());
+
+		auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - r->start).count();
+		if(secs <= 0)
+			secs = 1e-9;
+
+		util::info("bench: %d packets, %s in %.3f s: %.0f packets/s, %.1f MB/s (%s output, %s written)",
+			r->packets, format_size(r->bytes), secs, r->packets / secs, r->bytes / (1024.0 * 1024.0) / secs,
+			ws.backend, format_size(ws.bytes));
+
+		util::indent_log();
+		for(size_t i = 0; i < r->streams.size(); i++)
+		{
+			auto& s = r->streams[i];
+			util::log("stream %d (%s): %d %s, %s", i, s.desc, s.packets, util::plural("packet", s.packets),
+				format_size(s.bytes));
+		}
+
+		util::log("subtitle buffer: %d %s, %s (peak)", r->subtitlePackets, util::plural("packet", r->subtitlePackets),
+			format_size(r->subtitleBytes));
+
+		util::log("interleave queue: %d %s, %s, %.2f s (max); %d written early", is.peakPackets,
+			util::plural("packet", is.peakPackets), format_size(is.peakBytes), is.peakSpanNs / 1'000'000'000.0,
+			is.deltaFlushes + is.memoryFlushes);
+
+		// this isn't counted, just worked out: every packet read is copied once, and the ones that are
+		// kept are moved into the interleaver.
+		auto copies = 2 * r->packets + r->dropped;
+		util::log("allocations (estimated): %d packet copies (%d dropped)", copies, r->dropped);
+
+		// only meaningful because '--bench-mux' runs one file at a time; mallinfo2 sees the whole process.
+	#if HAVE_MALLINFO2
+		util::log("peak heap: +%s", format_size(r->peakHeap > r->baseHeap ? r->peakHeap - r->baseHeap : 0));
+	#endif
+
+		util::unindent_log();
+	}
+}
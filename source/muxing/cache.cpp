@@ -0,0 +1,377 @@
+// cache.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <mutex>
+#include <fstream>
+
+#include "defs.h"
+
+#include "picojson.h"
+namespace pj = picojson;
+
+namespace mux::cache
+{
+	static constexpr int64_t CACHE_VERSION = 1;
+
+	struct Entry
+	{
+		std::string path;
+		FileInfo info;
+	};
+
+	// files can be processed in parallel (--jobs), so everything below is behind this.
+	static std::mutex lock;
+
+	static bool loaded = false;
+	static bool dirty = false;
+	static std::unordered_map<std::string, Entry> entries;
+
+	// stream selections, keyed by layout signature. these are always remembered for the
+	// duration of the run, but only loaded from and saved to disk if asked to.
+	static bool selectionsLoaded = false;
+	static bool selectionsDirty = false;
+	static std::unordered_map<std::string, std::vector<std::string>> selections;
+
+	static std::fs::path get_cache_path()
+	{
+		if(auto x = config::getStreamCachePath(); !x.empty())
+			return x;
+
+		if(auto x = util::getEnvironmentVar("XDG_CACHE_HOME"); !x.empty())
+			return std::fs::path(x) / "mkvtaginator" / "streams.json";
+
+		if(auto x = util::getEnvironmentVar("HOME"); !x.empty())
+			return std::fs::path(x) / ".cache" / "mkvtaginator" / "streams.json";
+
+		return "";
+	}
+
+	static std::fs::path get_selections_path()
+	{
+		auto path = get_cache_path();
+		if(path.empty())
+			return "";
+
+		return path.parent_path() / "selections.json";
+	}
+
+	static bool read_json(const std::fs::path& path, pj::value* root)
+	{
+		if(path.empty() || !std::fs::exists(path))
+			return false;
+
+		uint8_t* buf = 0; size_t sz = 0;
+		std::tie(buf, sz) = util::readEntireFile(path.string());
+		if(!buf || sz == 0)
+			return false;
+
+		std::string err;
+		pj::parse(*root, buf, buf + sz, &err);
+		delete[] buf;
+
+		if(!err.empty() || !root->is<pj::object>())
+		{
+			util::warn("warn: ignoring malformed cache '%s'", path.string());
+			return false;
+		}
+
+		if(auto& ver = root->get("version"); !ver.is<int64_t>() || ver.get<int64_t>() != CACHE_VERSION)
+			return false;
+
+		return true;
+	}
+
+	static bool write_json(const std::fs::path& path, const pj::value& root)
+	{
+		std::error_code ec;
+		std::fs::create_directories(path.parent_path(), ec);
+
+		// write it somewhere else first, so we never leave a half-written cache behind.
+		auto tmp = path;
+		tmp += ".tmp";
+		{
+			auto out = std::ofstream(tmp, std::ios::binary | std::ios::trunc);
+			if(!out.good())
+			{
+				util::warn("warn: failed to write cache '%s'", path.string());
+				return false;
+			}
+
+			auto str = root.serialise();
+			out.write(str.c_str(), str.size());
+		}
+
+		std::fs::rename(tmp, path, ec);
+		if(ec)
+		{
+			util::warn("warn: failed to write cache '%s'", path.string());
+			return false;
+		}
+
+		return true;
+	}
+
+	static std::string make_key(const std::fs::path& path)
+	{
+		util::FileStat st;
+		if(!util::statFile(path.string(), &st))
+			return "";
+
+		return util::join({ std::to_string(st.dev), std::to_string(st.inode), std::to_string(st.size),
+			std::to_string(st.mtime) }, ":");
+	}
+
+	static pj::value serialise_stream(const StreamInfo& s)
+	{
+		pj::object obj;
+		obj["index"]        = pj::value(static_cast<int64_t>(s.index));
+		obj["type"]         = pj::value(static_cast<int64_t>(s.type));
+		obj["codec"]        = pj::value(s.codec);
+		obj["lang"]         = pj::value(s.lang);
+		obj["title"]        = pj::value(s.title);
+		obj["filename"]     = pj::value(s.filename);
+		obj["bitrate"]      = pj::value(s.bitrate);
+		obj["duration"]     = pj::value(static_cast<int64_t>(s.durationNs));
+		obj["width"]        = pj::value(static_cast<int64_t>(s.width));
+		obj["height"]       = pj::value(static_cast<int64_t>(s.height));
+		obj["fps"]          = pj::value(s.fps);
+		obj["sample_rate"]  = pj::value(static_cast<int64_t>(s.sampleRate));
+		obj["channels"]     = pj::value(static_cast<int64_t>(s.channels));
+		obj["bits"]         = pj::value(static_cast<int64_t>(s.bitsPerSample));
+		obj["layout"]       = pj::value(s.layout);
+		obj["sample_fmt"]   = pj::value(s.sampleFormat);
+
+		return pj::value(obj);
+	}
+
+	static StreamInfo deserialise_stream(const pj::value& v)
+	{
+		auto get_int = [&v](const std::string& key) -> int64_t {
+			auto& x = v.get(key);
+			if(x.is<int64_t>())     return x.get<int64_t>();
+			else if(x.is<double>()) return static_cast<int64_t>(x.get<double>());
+			else                    return 0;
+		};
+
+		auto get_str = [&v](const std::string& key) -> std::string {
+			auto& x = v.get(key);
+			return x.is<std::string>() ? x.get<std::string>() : "";
+		};
+
+		StreamInfo s;
+		s.index         = static_cast<int>(get_int("index"));
+		s.type          = static_cast<int>(get_int("type"));
+		s.codec         = get_str("codec");
+		s.lang          = get_str("lang");
+		s.title         = get_str("title");
+		s.filename      = get_str("filename");
+		s.bitrate       = get_int("bitrate");
+		s.durationNs    = static_cast<uint64_t>(get_int("duration"));
+		s.width         = static_cast<int>(get_int("width"));
+		s.height        = static_cast<int>(get_int("height"));
+		s.fps           = v.get("fps").is<double>() ? v.get("fps").get<double>() : 0;
+		s.sampleRate    = static_cast<int>(get_int("sample_rate"));
+		s.channels      = static_cast<int>(get_int("channels"));
+		s.bitsPerSample = static_cast<int>(get_int("bits"));
+		s.layout        = get_str("layout");
+		s.sampleFormat  = get_str("sample_fmt");
+
+		return s;
+	}
+
+	static void load()
+	{
+		loaded = true;
+
+		pj::value root;
+		if(!read_json(get_cache_path(), &root))
+			return;
+
+		auto& files = root.get("files");
+		if(!files.is<pj::object>())
+			return;
+
+		for(const auto& [ key, val ] : files.get<pj::object>())
+		{
+			if(!val.is<pj::object>() || !val.get("streams").is<pj::array>())
+				continue;
+
+			Entry ent;
+			ent.path = val.get("path").is<std::string>() ? val.get("path").get<std::string>() : "";
+
+			if(auto& dur = val.get("duration"); dur.is<int64_t>())
+				ent.info.durationNs = static_cast<uint64_t>(dur.get<int64_t>());
+
+			for(const auto& s : val.get("streams").get<pj::array>())
+				ent.info.streams.push_back(deserialise_stream(s));
+
+			entries[key] = std::move(ent);
+		}
+	}
+
+	bool lookup(const std::fs::path& path, FileInfo* info)
+	{
+		if(!config::useStreamCache())
+			return false;
+
+		auto lk = std::unique_lock(lock);
+		if(!loaded)
+			load();
+
+		auto key = make_key(path);
+		if(key.empty())
+			return false;
+
+		if(auto it = entries.find(key); it != entries.end())
+		{
+			*info = it->second.info;
+			return true;
+		}
+
+		return false;
+	}
+
+	void store(const std::fs::path& path, const FileInfo& info)
+	{
+		if(!config::useStreamCache())
+			return;
+
+		auto lk = std::unique_lock(lock);
+		if(!loaded)
+			load();
+
+		auto key = make_key(path);
+		if(key.empty())
+			return;
+
+		std::error_code ec;
+		auto abs = std::fs::absolute(path, ec);
+
+		auto entry = Entry();
+		entry.path = (ec ? path : abs).string();
+		entry.info = info;
+
+		entries[key] = std::move(entry);
+		dirty = true;
+	}
+
+	static void load_selections()
+	{
+		selectionsLoaded = true;
+
+		pj::value root;
+		if(!config::shouldRememberSelections() || !read_json(get_selections_path(), &root))
+			return;
+
+		auto& sels = root.get("selections");
+		if(!sels.is<pj::object>())
+			return;
+
+		for(const auto& [ sig, val ] : sels.get<pj::object>())
+		{
+			if(!val.is<pj::array>())
+				continue;
+
+			std::vector<std::string> ids;
+			for(const auto& x : val.get<pj::array>())
+			{
+				if(x.is<std::string>())
+					ids.push_back(x.get<std::string>());
+			}
+
+			// don't clobber anything chosen during this run.
+			selections.emplace(sig, std::move(ids));
+		}
+	}
+
+	bool lookupSelection(const std::string& signature, std::vector<std::string>* ids)
+	{
+		auto lk = std::unique_lock(lock);
+		if(!selectionsLoaded)
+			load_selections();
+
+		if(auto it = selections.find(signature); it != selections.end())
+		{
+			*ids = it->second;
+			return true;
+		}
+
+		return false;
+	}
+
+	void storeSelection(const std::string& signature, const std::vector<std::string>& ids)
+	{
+		auto lk = std::unique_lock(lock);
+		if(!selectionsLoaded)
+			load_selections();
+
+		selections[signature] = ids;
+		selectionsDirty = true;
+	}
+
+	static void save_selections()
+	{
+		if(!selectionsDirty || !config::shouldRememberSelections())
+			return;
+
+		auto path = get_selections_path();
+		if(path.empty())
+			return;
+
+		pj::object sels;
+		for(const auto& [ sig, ids ] : selections)
+		{
+			sels[sig] = pj::value(util::map(ids, [](const std::string& x) -> pj::value {
+				return pj::value(x);
+			}));
+		}
+
+		pj::object root;
+		root["version"] = pj::value(CACHE_VERSION);
+		root["selections"] = pj::value(sels);
+
+		if(write_json(path, pj::value(root)))
+			selectionsDirty = false;
+	}
+
+	static void save_streams()
+	{
+		if(!dirty || !config::useStreamCache())
+			return;
+
+		auto path = get_cache_path();
+		if(path.empty())
+			return;
+
+		pj::object files;
+		for(const auto& [ key, ent ] : entries)
+		{
+			// don't keep entries for files that have since been deleted or changed (eg. tagged in place, which
+			// gives them a new mtime, and so a new key); they'd never be looked up again.
+			if(!ent.path.empty() && make_key(ent.path) != key)
+				continue;
+
+			pj::object obj;
+			obj["path"] = pj::value(ent.path);
+			obj["duration"] = pj::value(static_cast<int64_t>(ent.info.durationNs));
+			obj["streams"] = pj::value(util::map(ent.info.streams, serialise_stream));
+
+			files[key] = pj::value(obj);
+		}
+
+		pj::object root;
+		root["version"] = pj::value(CACHE_VERSION);
+		root["files"] = pj::value(files);
+
+		if(write_json(path, pj::value(root)))
+			dirty = false;
+	}
+
+	void save()
+	{
+		auto lk = std::unique_lock(lock);
+		save_streams();
+		save_selections();
+	}
+}
@@ -0,0 +1,1094 @@
+// checkpoint.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <deque>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "defs.h"
+
+#include "picojson.h"
+namespace pj = picojson;
+
+extern "C" {
+	#include <libavutil/crc.h>
+	#include <libavformat/avformat.h>
+}
+
+// so that a 60 GB remux that dies near the end doesn't have to start over. every '--checkpoint-interval' of
+// output, once a cluster is complete, the partial output is synced, and we save (next to it) how long it is
+// and which packet of each stream was the last one in it. with '--resume', the output is cut back to that
+// length, the muxer writes a fresh header over the old one (which must come out the same size), the input is
+// seeked back a bit, and packets are dropped until each stream gets past the last one already written.
+//
+// to know where the clusters end and which packets are in them, the output is parsed as it is written. the
+// muxer only writes cues for the part it muxed itself, so the ones from before are kept in the checkpoint and
+// put back in front of its own at the end.
+namespace mux::checkpoint
+{
+	static constexpr uint32_t ID_SEGMENT        = 0x18538067;
+	static constexpr uint32_t ID_TRACKS         = 0x1654AE6B;
+	static constexpr uint32_t ID_TRACK_ENTRY    = 0xAE;
+	static constexpr uint32_t ID_TRACK_NUMBER   = 0xD7;
+	static constexpr uint32_t ID_CLUSTER        = 0x1F43B675;
+	static constexpr uint32_t ID_TIMESTAMP      = 0xE7;
+	static constexpr uint32_t ID_SIMPLE_BLOCK   = 0xA3;
+	static constexpr uint32_t ID_BLOCK_GROUP    = 0xA0;
+	static constexpr uint32_t ID_BLOCK          = 0xA1;
+	static constexpr uint32_t ID_CUES           = 0x1C53BB6B;
+	static constexpr uint32_t ID_CUE_POINT      = 0xBB;
+	static constexpr uint32_t ID_CUE_TIME       = 0xB3;
+	static constexpr uint32_t ID_CUE_POSITIONS  = 0xB7;
+	static constexpr uint32_t ID_CUE_TRACK      = 0xF7;
+	static constexpr uint32_t ID_CUE_CLUSTER    = 0xF1;
+	static constexpr uint32_t ID_CUE_RELATIVE   = 0xF0;
+	static constexpr uint32_t ID_CRC32          = 0xBF;
+
+	static constexpr uint64_t UNKNOWN_SIZE = UINT64_MAX;
+
+	// changed whenever what's saved changes meaning; older checkpoints are ignored.
+	static constexpr int64_t VERSION = 1;
+
+	// the demuxer seeks to a keyframe before the timestamp, and the streams in a file are never quite
+	// interleaved evenly, so go back (this, plus the interleave delta) before the earliest stream.
+	static constexpr double SEEK_MARGIN = 10;
+
+	// enough to tell apart the packets of one stream, in the output's time base (before the muxer shifts
+	// anything), which is also how they're seen on the way in when resuming.
+	struct Packet
+	{
+		int64_t dts = AV_NOPTS_VALUE;
+		int64_t pts = AV_NOPTS_VALUE;
+		int64_t size = 0;
+
+		bool operator == (const Packet& p) const { return this->dts == p.dts && this->pts == p.pts && this->size == p.size; }
+	};
+
+	struct Stream
+	{
+		// the matroska track number; 0 for attachments, which aren't tracks.
+		uint64_t track = 0;
+		bool video = false;
+
+		// sparse streams (subtitles) can have long gaps, so they say nothing about where to seek to.
+		bool sparse = false;
+
+		// packets that went to the muxer, but haven't shown up in a finished cluster yet.
+		std::deque<Packet> fed;
+
+		// the last packet that is in a finished cluster.
+		bool haveLast = false;
+		Packet last;
+
+		// block timestamp minus packet pts, from the first block; every other block must agree.
+		bool haveOffset = false;
+		int64_t offset = 0;
+
+		// when resuming: the last packet that is already in the output (which 'last' moves on from), and
+		// whether we've got past it.
+		Packet marker;
+		bool passed = false;
+	};
+
+	struct Block
+	{
+		uint64_t track = 0;
+		int64_t time = 0;
+		bool keyframe = false;
+
+		// from the start of the cluster's data, as the cues want it.
+		uint64_t relative = 0;
+	};
+
+	struct CuePoint
+	{
+		uint64_t time = 0;
+		uint64_t track = 0;
+
+		// relative to the start of the segment's data.
+		uint64_t cluster = 0;
+		uint64_t relative = 0;
+	};
+
+	struct Element
+	{
+		uint32_t id = 0;
+		uint64_t end = 0;
+	};
+
+	struct Tracker
+	{
+		std::fs::path output;
+		std::fs::path file;
+		std::string key;
+		uint64_t interval = 0;
+
+		AVFormatContext* outctx = 0;
+		std::vector<Stream> streams;
+		bool haveVideo = false;
+
+		// if the first packet is negative, the muxer moves everything later by that much (AV_TIME_BASE units).
+		bool haveShift = false;
+		int64_t shift = 0;
+
+		// where the elements we care about are.
+		uint64_t headerEnd = 0;
+		uint64_t segmentData = 0;
+		uint64_t segmentSizePos = 0;
+		size_t segmentSizeLen = 0;
+		uint64_t cuesPos = 0;
+		uint64_t cuesEnd = 0;
+		std::vector<uint64_t> trackNumbers;
+
+		// the parser: 'pos' is where the next byte goes, and bytes before 'skipTo' are of no interest.
+		uint64_t pos = 0;
+		uint64_t skipTo = 0;
+		std::vector<Element> open;
+
+		// the element header being read, or the start of the payload we want.
+		std::vector<uint8_t> buf;
+		bool inPayload = false;
+		size_t need = 0;
+
+		uint32_t id = 0;
+		uint64_t elemStart = 0;
+		uint64_t dataStart = 0;
+		uint64_t dataEnd = 0;
+
+		// the cluster being read.
+		uint64_t clusterPos = 0;
+		uint64_t clusterData = 0;
+		int64_t clusterTime = 0;
+		std::vector<Block> blocks;
+
+		// the end of the last finished cluster, and of the last one a checkpoint was saved at.
+		uint64_t finished = 0;
+		uint64_t saved = 0;
+
+		std::vector<CuePoint> cues;
+
+		// we lost track of what's in the output, so no more checkpoints.
+		bool broken = false;
+
+		// where the output was resumed from (0 if it wasn't), and whether that went wrong.
+		uint64_t resumedAt = 0;
+		bool failed = false;
+	};
+
+	static Packet describe(const AVPacket* pkt)
+	{
+		return Packet { pkt->dts, pkt->pts, pkt->size };
+	}
+
+	// blocks are timestamped with the pts, but the muxer falls back to the dts.
+	static int64_t block_time(const Packet& p)
+	{
+		return p.pts != AV_NOPTS_VALUE ? p.pts : p.dts;
+	}
+
+	static void remove_file(const std::fs::path& path)
+	{
+		std::error_code ec;
+		std::fs::remove(path, ec);
+	}
+
+	static void set_broken(Tracker* t, const std::string& why)
+	{
+		if(t->broken)
+			return;
+
+		t->broken = true;
+
+		// earlier checkpoints might not be right either.
+		remove_file(t->file);
+
+		// after resuming, this means the new part doesn't line up with the old one.
+		if(t->resumedAt > 0)
+		{
+			util::error("resumed output is inconsistent (%s)", why);
+			t->failed = true;
+		}
+		else
+		{
+			util::warn("warn: can't checkpoint this output (%s)", why);
+		}
+	}
+
+	static Stream* stream_for_track(Tracker* t, uint64_t track)
+	{
+		for(auto& s : t->streams)
+		{
+			if(s.track == track && track != 0)
+				return &s;
+		}
+
+		return nullptr;
+	}
+
+
+
+	// the length of an ebml id or size from its first byte; 0 if it isn't valid.
+	static size_t vint_length(uint8_t first)
+	{
+		for(size_t i = 0; i < 8; i++)
+		{
+			if(first & (0x80 >> i))
+				return i + 1;
+		}
+
+		return 0;
+	}
+
+	static uint64_t vint_value(const uint8_t* b, size_t len, bool* unknown = nullptr)
+	{
+		uint64_t mask = (0xFF >> len);
+		uint64_t x = b[0] & mask;
+		bool ones = (x == mask);
+
+		for(size_t i = 1; i < len; i++)
+		{
+			x = (x << 8) | b[i];
+			ones &= (b[i] == 0xFF);
+		}
+
+		if(unknown)
+			*unknown = ones;
+
+		return x;
+	}
+
+	static uint64_t uint_value(const std::vector<uint8_t>& b)
+	{
+		uint64_t x = 0;
+		for(auto c : b)
+			x = (x << 8) | c;
+
+		return x;
+	}
+
+	// reads an element header from the start of 'b'; returns 0 if there isn't all of it yet, or SIZE_MAX if it's garbage.
+	static size_t read_header(const uint8_t* b, size_t len, uint32_t* id, uint64_t* size)
+	{
+		if(len == 0)
+			return 0;
+
+		auto idLen = vint_length(b[0]);
+		if(idLen == 0 || idLen > 4)
+			return SIZE_MAX;
+
+		if(len < idLen + 1)
+			return 0;
+
+		auto sizeLen = vint_length(b[idLen]);
+		if(sizeLen == 0)
+			return SIZE_MAX;
+
+		if(len < idLen + sizeLen)
+			return 0;
+
+		*id = 0;
+		for(size_t i = 0; i < idLen; i++)
+			*id = (*id << 8) | b[i];
+
+		bool unknown = false;
+		*size = vint_value(b + idLen, sizeLen, &unknown);
+
+		if(unknown)
+			*size = UNKNOWN_SIZE;
+
+		return idLen + sizeLen;
+	}
+
+	static void put_id(std::vector<uint8_t>& out, uint32_t id)
+	{
+		for(int i = 3; i >= 0; i--)
+		{
+			if(auto c = (id >> (8 * i)) & 0xFF; c != 0 || i == 0)
+				out.push_back(static_cast<uint8_t>(c));
+		}
+	}
+
+	// 'len' bytes long, or the shortest that fits.
+	static void put_size(std::vector<uint8_t>& out, uint64_t size, size_t len = 0)
+	{
+		if(len == 0)
+		{
+			len = 1;
+			while(len < 8 && size >= (uint64_t(1) << (7 * len)) - 1)
+				len++;
+		}
+
+		for(size_t i = 0; i < len; i++)
+		{
+			auto c = static_cast<uint8_t>((size >> (8 * (len - 1 - i))) & 0xFF);
+			out.push_back(i == 0 ? static_cast<uint8_t>(c | (0x80 >> (len - 1))) : c);
+		}
+	}
+
+	static void put_uint(std::vector<uint8_t>& out, uint32_t id, uint64_t x)
+	{
+		size_t len = 1;
+		while(len < 8 && (x >> (8 * len)) != 0)
+			len++;
+
+		put_id(out, id);
+		put_size(out, len);
+
+		for(size_t i = 0; i < len; i++)
+			out.push_back(static_cast<uint8_t>((x >> (8 * (len - 1 - i))) & 0xFF));
+	}
+
+	static void put_master(std::vector<uint8_t>& out, uint32_t id, const std::vector<uint8_t>& body)
+	{
+		put_id(out, id);
+		put_size(out, body.size());
+		out.insert(out.end(), body.begin(), body.end());
+	}
+
+
+
+	// matches the blocks in a finished cluster up with the packets that went to the muxer, which
+	// arrive in the same order for each track.
+	static void end_cluster(Tracker* t, uint64_t end)
+	{
+		std::vector<bool> cued(t->streams.size());
+		for(auto& b : t->blocks)
+		{
+			auto s = stream_for_track(t, b.track);
+			if(!s || s->fed.empty())
+				return set_broken(t, zpr::sprint("a block in track %d wasn't a packet we wrote", b.track));
+
+			auto p = s->fed.front();
+			s->fed.pop_front();
+
+			auto time = t->clusterTime + b.time;
+			if(!s->haveOffset)
+			{
+				s->haveOffset = true;
+				s->offset = time - block_time(p);
+			}
+			else if(time - block_time(p) != s->offset)
+			{
+				return set_broken(t, zpr::sprint("timestamps in track %d don't match the packets", b.track));
+			}
+
+			s->haveLast = true;
+			s->last = p;
+
+			// the same as the muxer: video keyframes, or the first keyframe of each track in every
+			// cluster if there's no video.
+			auto idx = static_cast<size_t>(s - t->streams.data());
+			if(b.keyframe && time >= 0 && (s->video || (!t->haveVideo && !cued[idx])))
+			{
+				t->cues.push_back(CuePoint { static_cast<uint64_t>(time), b.track, t->clusterPos - t->segmentData,
+					b.relative });
+
+				cued[idx] = true;
+			}
+		}
+
+		t->blocks.clear();
+		t->finished = end;
+	}
+
+	static void end_tracks(Tracker* t)
+	{
+		// tracks are numbered in stream order, leaving out attachments.
+		size_t k = 0;
+		for(size_t i = 0; i < t->streams.size(); i++)
+		{
+			if(t->outctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_ATTACHMENT)
+				continue;
+
+			if(k >= t->trackNumbers.size())
+				return set_broken(t, "fewer tracks than streams");
+
+			t->streams[i].track = t->trackNumbers[k++];
+		}
+	}
+
+	static void end_element(Tracker* t, const Element& e)
+	{
+		if(e.id == ID_CLUSTER)     end_cluster(t, e.end);
+		else if(e.id == ID_TRACKS) end_tracks(t);
+	}
+
+	static void end_payload(Tracker* t)
+	{
+		auto& b = t->buf;
+
+		if(t->id == ID_TRACK_NUMBER)
+		{
+			t->trackNumbers.push_back(uint_value(b));
+		}
+		else if(t->id == ID_TIMESTAMP)
+		{
+			t->clusterTime = static_cast<int64_t>(uint_value(b));
+		}
+		else if(t->id == ID_SIMPLE_BLOCK || t->id == ID_BLOCK)
+		{
+			// the track number, a 16-bit timestamp relative to the cluster, and flags (the top bit is
+			// 'keyframe', but only for simple blocks).
+			auto n = b.empty() ? 0 : vint_length(b[0]);
+			if(n == 0 || b.size() < n + 3)
+				return set_broken(t, "malformed block");
+
+			Block blk;
+			blk.track = vint_value(b.data(), n);
+			blk.time = static_cast<int16_t>((b[n] << 8) | b[n + 1]);
+			blk.keyframe = (t->id == ID_SIMPLE_BLOCK) && (b[n + 2] & 0x80);
+			blk.relative = t->elemStart - t->clusterData;
+
+			t->blocks.push_back(blk);
+		}
+
+		t->buf.clear();
+		t->inPayload = false;
+		t->skipTo = t->dataEnd;
+	}
+
+	static void begin_element(Tracker* t, uint32_t id, uint64_t size, size_t headerLen)
+	{
+		t->id = id;
+		t->elemStart = t->pos - headerLen;
+		t->dataStart = t->pos;
+		t->dataEnd = (size == UNKNOWN_SIZE ? UNKNOWN_SIZE : t->pos + size);
+
+		auto parent = t->open.empty() ? 0 : t->open.back().id;
+
+		auto container = [t]() {
+			t->open.push_back(Element { t->id, t->dataEnd });
+		};
+
+		auto payload = [t, size](size_t max) {
+			t->inPayload = true;
+			t->need = static_cast<size_t>(std::min(size, static_cast<uint64_t>(max)));
+			t->buf.clear();
+		};
+
+		auto skip = [t]() {
+			if(t->dataEnd == UNKNOWN_SIZE)  set_broken(t, "element of unknown size");
+			else                            t->skipTo = t->dataEnd;
+		};
+
+		if(parent == 0)
+		{
+			if(id != ID_SEGMENT)
+				return skip();
+
+			t->segmentData = t->dataStart;
+			t->segmentSizePos = t->elemStart + 4;
+			t->segmentSizeLen = headerLen - 4;
+			container();
+		}
+		else if(parent == ID_SEGMENT)
+		{
+			if(id == ID_CLUSTER)
+			{
+				// newer muxers write whole clusters at once; older ones went back to fill in the size.
+				if(t->dataEnd == UNKNOWN_SIZE)
+					return set_broken(t, "cluster of unknown size");
+
+				if(t->finished == 0 && t->elemStart != t->headerEnd)
+					return set_broken(t, "the first cluster isn't right after the header");
+
+				t->clusterPos = t->elemStart;
+				t->clusterData = t->dataStart;
+				t->clusterTime = 0;
+				t->blocks.clear();
+
+				container();
+			}
+			else if(id == ID_TRACKS)
+			{
+				container();
+			}
+			else
+			{
+				if(id == ID_CUES)
+					t->cuesPos = t->elemStart, t->cuesEnd = t->dataEnd;
+
+				skip();
+			}
+		}
+		else if(parent == ID_TRACKS)
+		{
+			if(id == ID_TRACK_ENTRY)    container();
+			else                        skip();
+		}
+		else if(parent == ID_TRACK_ENTRY)
+		{
+			if(id == ID_TRACK_NUMBER && size <= 8)  payload(8);
+			else                                    skip();
+		}
+		else if(parent == ID_CLUSTER)
+		{
+			if(id == ID_TIMESTAMP && size <= 8)     payload(8);
+			else if(id == ID_SIMPLE_BLOCK)          payload(12);
+			else if(id == ID_BLOCK_GROUP)           container();
+			else                                    skip();
+		}
+		else if(parent == ID_BLOCK_GROUP)
+		{
+			if(id == ID_BLOCK)  payload(12);
+			else                skip();
+		}
+		else
+		{
+			skip();
+		}
+
+		if(t->inPayload && t->need == 0)
+			end_payload(t);
+	}
+
+	static void close_elements(Tracker* t)
+	{
+		while(!t->broken && !t->inPayload && !t->open.empty() && t->open.back().end <= t->pos && t->skipTo <= t->pos)
+		{
+			auto e = t->open.back();
+			t->open.pop_back();
+
+			end_element(t, e);
+		}
+	}
+
+
+
+	static pj::value packet_to_json(const Packet& p)
+	{
+		return pj::value(pj::array { pj::value(p.dts), pj::value(p.pts), pj::value(p.size) });
+	}
+
+	static bool packet_from_json(const pj::value& v, Packet* p)
+	{
+		if(!v.is<pj::array>() || v.get<pj::array>().size() != 3)
+			return false;
+
+		auto& a = v.get<pj::array>();
+		for(auto& x : a)
+		{
+			if(!x.is<int64_t>())
+				return false;
+		}
+
+		*p = Packet { a[0].get<int64_t>(), a[1].get<int64_t>(), a[2].get<int64_t>() };
+		return true;
+	}
+
+	static bool load(Tracker* t)
+	{
+		auto in = std::ifstream(t->file, std::ios::binary);
+		if(!in.good())
+			return false;
+
+		auto contents = std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+		pj::value v;
+		if(!pj::parse(v, contents).empty() || !v.is<pj::object>())
+			return false;
+
+		auto num = [&v](const char* k) -> int64_t {
+			auto& x = v.get(k);
+			return x.is<int64_t>() ? x.get<int64_t>() : -1;
+		};
+
+		if(num("version") != VERSION || !v.get("key").is<std::string>() || v.get("key").get<std::string>() != t->key)
+			return false;
+
+		auto offset = num("offset");
+		auto& sv = v.get("streams");
+		auto& cv = v.get("cues");
+
+		if(offset <= 0 || num("header_end") <= 0 || num("segment_data") <= 0 || num("segment_size_pos") <= 0
+			|| num("segment_size_len") <= 0 || !sv.is<pj::array>() || !cv.is<pj::array>()
+			|| sv.get<pj::array>().size() != t->streams.size())
+		{
+			return false;
+		}
+
+		// the partial output has to still have everything up to the checkpoint.
+		if(util::FileStat st; !util::statFile(t->output.string(), &st) || st.size < static_cast<uint64_t>(offset))
+			return false;
+
+		auto streams = t->streams;
+		for(size_t i = 0; i < streams.size(); i++)
+		{
+			auto& x = sv.get<pj::array>()[i];
+			auto& s = streams[i];
+
+			if(!x.is<pj::object>() || !x.get("track").is<int64_t>())
+				return false;
+
+			s.track = static_cast<uint64_t>(x.get("track").get<int64_t>());
+
+			if(auto& o = x.get("offset"); o.is<int64_t>())
+				s.haveOffset = true, s.offset = o.get<int64_t>();
+
+			if(auto& l = x.get("last"); !l.is<pj::null>())
+			{
+				if(!packet_from_json(l, &s.last))
+					return false;
+
+				s.haveLast = true;
+			}
+
+			s.marker = s.last;
+			s.passed = !s.haveLast;
+		}
+
+		std::vector<CuePoint> cues;
+		for(auto& c : cv.get<pj::array>())
+		{
+			if(!c.is<pj::array>() || c.get<pj::array>().size() != 4)
+				return false;
+
+			auto& a = c.get<pj::array>();
+			if(!a[0].is<int64_t>() || !a[1].is<int64_t>() || !a[2].is<int64_t>() || !a[3].is<int64_t>())
+				return false;
+
+			cues.push_back(CuePoint { static_cast<uint64_t>(a[0].get<int64_t>()), static_cast<uint64_t>(a[1].get<int64_t>()),
+				static_cast<uint64_t>(a[2].get<int64_t>()), static_cast<uint64_t>(a[3].get<int64_t>()) });
+		}
+
+		t->streams = std::move(streams);
+		t->cues = std::move(cues);
+
+		if(auto& x = v.get("shift"); x.is<int64_t>())
+			t->haveShift = true, t->shift = x.get<int64_t>();
+
+		t->headerEnd = static_cast<uint64_t>(num("header_end"));
+		t->segmentData = static_cast<uint64_t>(num("segment_data"));
+		t->segmentSizePos = static_cast<uint64_t>(num("segment_size_pos"));
+		t->segmentSizeLen = static_cast<size_t>(num("segment_size_len"));
+
+		// carry on parsing from inside the segment, at the start of the next cluster.
+		t->resumedAt = static_cast<uint64_t>(offset);
+		t->pos = t->resumedAt;
+		t->finished = t->resumedAt;
+		t->saved = t->resumedAt;
+		t->open.push_back(Element { ID_SEGMENT, UNKNOWN_SIZE });
+
+		return true;
+	}
+
+	// the muxer only knows about the cues for what it wrote since resuming; the rest are put back in front
+	// of them (the cues are the last thing in the file, so they can just grow), and the segment size fixed.
+	static bool merge_cues(Tracker* t, const std::fs::path& path)
+	{
+		std::vector<CuePoint> old;
+		for(auto& c : t->cues)
+		{
+			if(t->segmentData + c.cluster < t->resumedAt)
+				old.push_back(c);
+		}
+
+		if(old.empty())
+			return true;
+
+		int fd = ::open(path.string().c_str(), O_RDWR | O_CLOEXEC);
+		if(fd < 0)
+			return false;
+
+		defer(::close(fd));
+
+		struct stat st;
+		if(fstat(fd, &st) != 0)
+			return false;
+
+		if(t->cuesPos == 0 || t->cuesEnd != static_cast<uint64_t>(st.st_size))
+		{
+			util::warn("warn: the cues only cover the part of the file written after resuming");
+			return true;
+		}
+
+		auto cues = std::vector<uint8_t>(t->cuesEnd - t->cuesPos);
+		if(pread(fd, cues.data(), cues.size(), static_cast<off_t>(t->cuesPos)) != static_cast<ssize_t>(cues.size()))
+			return false;
+
+		std::vector<uint8_t> points;
+		for(auto& c : old)
+		{
+			std::vector<uint8_t> pos;
+			put_uint(pos, ID_CUE_TRACK, c.track);
+			put_uint(pos, ID_CUE_CLUSTER, c.cluster);
+			put_uint(pos, ID_CUE_RELATIVE, c.relative);
+
+			std::vector<uint8_t> point;
+			put_uint(point, ID_CUE_TIME, c.time);
+			put_master(point, ID_CUE_POSITIONS, pos);
+
+			put_master(points, ID_CUE_POINT, point);
+		}
+
+		// then the muxer's own, as they are.
+		bool hadCrc = false;
+
+		uint32_t id = 0;
+		uint64_t size = 0;
+		auto len = read_header(cues.data(), cues.size(), &id, &size);
+		if(len == 0 || len == SIZE_MAX || id != ID_CUES)
+			return false;
+
+		for(size_t i = len; i < cues.size(); )
+		{
+			auto n = read_header(cues.data() + i, cues.size() - i, &id, &size);
+			if(n == 0 || n == SIZE_MAX || size == UNKNOWN_SIZE || size > cues.size() - i - n)
+				return false;
+
+			if(id == ID_CRC32)          hadCrc = true;
+			else if(id == ID_CUE_POINT) points.insert(points.end(), cues.begin() + i, cues.begin() + i + n + size);
+
+			i += n + size;
+		}
+
+		std::vector<uint8_t> body;
+		if(hadCrc)
+		{
+			auto crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE_LE), UINT32_MAX, points.data(), points.size()) ^ UINT32_MAX;
+
+			put_id(body, ID_CRC32);
+			put_size(body, 4);
+			for(int i = 0; i < 4; i++)
+				body.push_back(static_cast<uint8_t>((crc >> (8 * i)) & 0xFF));
+		}
+
+		body.insert(body.end(), points.begin(), points.end());
+
+		// an 8-byte size, like the muxer's.
+		std::vector<uint8_t> elem;
+		put_id(elem, ID_CUES);
+		put_size(elem, body.size(), 8);
+		elem.insert(elem.end(), body.begin(), body.end());
+
+		if(pwrite(fd, elem.data(), elem.size(), static_cast<off_t>(t->cuesPos)) != static_cast<ssize_t>(elem.size()))
+			return false;
+
+		// the segment runs to the end of the file, unless it was left at 'unknown'.
+		uint8_t sz[8];
+		if(t->segmentSizeLen == 8 && pread(fd, sz, 8, static_cast<off_t>(t->segmentSizePos)) == 8)
+		{
+			bool unknown = false;
+			vint_value(sz, 8, &unknown);
+
+			if(!unknown)
+			{
+				std::vector<uint8_t> out;
+				put_size(out, t->cuesPos + elem.size() - t->segmentData, 8);
+
+				if(pwrite(fd, out.data(), out.size(), static_cast<off_t>(t->segmentSizePos)) != 8)
+					return false;
+			}
+		}
+
+		util::log("merged %d %s from before resuming", old.size(), util::plural("cue point", old.size()));
+		return true;
+	}
+
+
+
+
+	Tracker* create(const std::fs::path& output, AVFormatContext* outctx, const std::string& key)
+	{
+		auto file = output.parent_path() / (output.filename().string() + ".checkpoint");
+		auto interval = config::getCheckpointInterval();
+
+		// checkpoints are off by default, since they cost a sync (and parsing the output). but a checkpoint
+		// from a run that had them on can still be resumed from, without saving any more.
+		if(interval == 0 && !(config::isResuming() && std::fs::exists(file)))
+		{
+			remove_file(file);
+			return nullptr;
+		}
+
+		auto t = new Tracker();
+		t->output = output;
+		t->file = file;
+		t->key = key;
+		t->interval = interval;
+		t->outctx = outctx;
+
+		for(unsigned i = 0; i < outctx->nb_streams; i++)
+		{
+			auto type = outctx->streams[i]->codecpar->codec_type;
+
+			Stream s;
+			s.video = (type == AVMEDIA_TYPE_VIDEO);
+			s.sparse = (type == AVMEDIA_TYPE_SUBTITLE || type == AVMEDIA_TYPE_ATTACHMENT);
+
+			t->haveVideo |= s.video;
+			t->streams.push_back(std::move(s));
+		}
+
+		// whatever an old checkpoint was for is about to be overwritten, unless we're continuing it.
+		if(std::fs::exists(file) && (!config::isResuming() || !load(t)))
+		{
+			if(config::isResuming())
+				util::log("ignoring the checkpoint for '%s' (it doesn't match)", output.filename().string());
+
+			remove_file(file);
+		}
+
+		return t;
+	}
+
+	uint64_t resumeOffset(Tracker* t)
+	{
+		return t ? t->resumedAt : 0;
+	}
+
+	int64_t timestampOffset(Tracker* t)
+	{
+		return t && t->resumedAt > 0 && t->haveShift ? t->shift : 0;
+	}
+
+	bool headerWritten(Tracker* t, AVFormatContext* outctx, AVFormatContext* inctx)
+	{
+		if(!t)
+			return true;
+
+		auto end = avio_tell(outctx->pb);
+		if(t->resumedAt == 0)
+		{
+			t->headerEnd = static_cast<uint64_t>(end);
+			return true;
+		}
+
+		if(static_cast<uint64_t>(end) != t->headerEnd)
+		{
+			util::error("the header is %s bytes now, but was %s bytes before", std::to_string(end),
+				std::to_string(t->headerEnd));
+			return false;
+		}
+
+		// the last packet of each stream is known, but not where it is in the input; seek back to before
+		// the earliest of them, and drop packets until we get past them.
+		int64_t earliest = INT64_MAX;
+		for(size_t i = 0; i < t->streams.size(); i++)
+		{
+			auto& s = t->streams[i];
+			if(s.sparse || !s.haveLast || s.last.dts == AV_NOPTS_VALUE)
+				continue;
+
+			earliest = std::min(earliest, av_rescale_q(s.last.dts, outctx->streams[i]->time_base,
+				AVRational { 1, AV_TIME_BASE }));
+		}
+
+		if(earliest == INT64_MAX)
+		{
+			util::error("no stream has a packet to resume from");
+			return false;
+		}
+
+		auto margin = static_cast<int64_t>((SEEK_MARGIN + config::getInterleaveDelta()) * AV_TIME_BASE);
+		if(av_seek_frame(inctx, -1, earliest - margin, AVSEEK_FLAG_BACKWARD) < 0)
+		{
+			util::error("failed to seek the input");
+			return false;
+		}
+
+		return avio_seek(outctx->pb, static_cast<int64_t>(t->resumedAt), SEEK_SET) == static_cast<int64_t>(t->resumedAt);
+	}
+
+	bool skip(Tracker* t, const AVPacket* pkt)
+	{
+		if(!t || t->resumedAt == 0)
+			return false;
+
+		if(t->failed)
+			return true;
+
+		auto& s = t->streams[pkt->stream_index];
+		if(s.passed)
+			return false;
+
+		auto p = describe(pkt);
+		if(p == s.marker)
+		{
+			s.passed = true;
+			return true;
+		}
+
+		if(p.dts == AV_NOPTS_VALUE || s.marker.dts == AV_NOPTS_VALUE || p.dts <= s.marker.dts)
+			return true;
+
+		// we're past it without seeing it. subtitles can have gaps longer than how far back we seeked,
+		// so that's fine for them; for anything else, the packets in between are missing.
+		if(!s.sparse)
+		{
+			util::error("stream %d resumed too late (at dts %s, but the last packet written was at %s)",
+				pkt->stream_index, std::to_string(p.dts), std::to_string(s.marker.dts));
+
+			t->failed = true;
+			return true;
+		}
+
+		s.passed = true;
+		return false;
+	}
+
+	bool failed(Tracker* t)
+	{
+		return t && t->failed;
+	}
+
+	void fed(Tracker* t, const AVPacket* pkt)
+	{
+		if(!t || t->broken)
+			return;
+
+		// the muxer (with the default 'avoid_negative_ts') moves everything later if the first packet is
+		// negative; when resuming, it won't see that packet, so the same shift has to be applied by hand.
+		if(!t->haveShift && pkt->dts != AV_NOPTS_VALUE)
+		{
+			auto tb = t->outctx->streams[pkt->stream_index]->time_base;
+
+			t->haveShift = true;
+			t->shift = pkt->dts < 0 ? av_rescale_q(-pkt->dts, tb, AVRational { 1, AV_TIME_BASE }) : 0;
+		}
+
+		t->streams[pkt->stream_index].fed.push_back(describe(pkt));
+	}
+
+	bool scan(Tracker* t, uint64_t offset, const uint8_t* data, size_t len)
+	{
+		if(!t || t->broken)
+			return false;
+
+		if(offset != t->pos)
+		{
+			set_broken(t, "the output wasn't written in order");
+			return false;
+		}
+
+		auto advance = [&](size_t n) {
+			t->pos += n;
+			data += n;
+			len -= n;
+		};
+
+		while(len > 0 && !t->broken)
+		{
+			close_elements(t);
+
+			if(t->pos < t->skipTo)
+			{
+				advance(static_cast<size_t>(std::min(static_cast<uint64_t>(len), t->skipTo - t->pos)));
+			}
+			else if(t->inPayload)
+			{
+				auto n = std::min(len, t->need - t->buf.size());
+				t->buf.insert(t->buf.end(), data, data + n);
+				advance(n);
+
+				if(t->buf.size() == t->need)
+					end_payload(t);
+			}
+			else
+			{
+				t->buf.push_back(*data);
+				advance(1);
+
+				uint32_t id = 0;
+				uint64_t size = 0;
+
+				if(auto n = read_header(t->buf.data(), t->buf.size(), &id, &size); n == SIZE_MAX)
+				{
+					set_broken(t, "unexpected data in the output");
+				}
+				else if(n > 0)
+				{
+					t->buf.clear();
+					begin_element(t, id, size, n);
+				}
+			}
+		}
+
+		close_elements(t);
+		return !t->broken && t->interval > 0 && t->finished >= t->saved + t->interval;
+	}
+
+	void save(Tracker* t)
+	{
+		if(!t || t->broken)
+			return;
+
+		pj::array streams;
+		for(auto& s : t->streams)
+		{
+			pj::object obj;
+			obj["track"]    = pj::value(static_cast<int64_t>(s.track));
+			obj["offset"]   = s.haveOffset ? pj::value(s.offset) : pj::value();
+			obj["last"]     = s.haveLast ? packet_to_json(s.last) : pj::value();
+
+			streams.push_back(pj::value(obj));
+		}
+
+		pj::array cues;
+		for(auto& c : t->cues)
+		{
+			cues.push_back(pj::value(pj::array { pj::value(static_cast<int64_t>(c.time)), pj::value(static_cast<int64_t>(c.track)),
+				pj::value(static_cast<int64_t>(c.cluster)), pj::value(static_cast<int64_t>(c.relative)) }));
+		}
+
+		pj::object obj;
+		obj["version"]          = pj::value(VERSION);
+		obj["key"]              = pj::value(t->key);
+		obj["offset"]           = pj::value(static_cast<int64_t>(t->finished));
+		obj["header_end"]       = pj::value(static_cast<int64_t>(t->headerEnd));
+		obj["segment_data"]     = pj::value(static_cast<int64_t>(t->segmentData));
+		obj["segment_size_pos"] = pj::value(static_cast<int64_t>(t->segmentSizePos));
+		obj["segment_size_len"] = pj::value(static_cast<int64_t>(t->segmentSizeLen));
+		obj["shift"]            = t->haveShift ? pj::value(t->shift) : pj::value();
+		obj["streams"]          = pj::value(streams);
+		obj["cues"]             = pj::value(cues);
+
+		// written to the side and renamed over, so a crash leaves either the old one or the new one.
+		auto tmp = t->file.string() + ".tmp";
+		auto json = pj::value(obj).serialise();
+
+		int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if(fd < 0)
+			return;
+
+		bool ok = write(fd, json.c_str(), json.size()) == static_cast<ssize_t>(json.size()) && fsync(fd) == 0;
+		ok &= (::close(fd) == 0);
+
+		std::error_code ec;
+		if(ok)
+			std::fs::rename(tmp, t->file, ec);
+
+		if(!ok || ec)
+		{
+			util::warn("warn: failed to save checkpoint");
+			remove_file(tmp);
+			return;
+		}
+
+		t->saved = t->finished;
+	}
+
+	bool finish(Tracker* t, const std::fs::path& output, bool ok)
+	{
+		if(!t)
+			return ok;
+
+		if(ok && t->failed)
+			ok = false;
+
+		if(ok && t->resumedAt > 0 && !merge_cues(t, output))
+		{
+			util::error("failed to fix up the cues");
+			ok = false;
+		}
+
+		remove_file(t->file);
+		delete t;
+
+		return ok;
+	}
+}
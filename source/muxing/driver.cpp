@@ -5,6 +5,7 @@
 #include "defs.h"
 #include <set>
 #include <deque>
+#include <fstream>
 
 // what the fuck? i shouldn't have to do this manually...
 extern "C" {
@@ -14,12 +15,6 @@ extern "C" {
 	#include <libavutil/channel_layout.h>
 }
 
-namespace misc
-{
-	// lmao
-	extern std::unordered_map<std::string, std::vector<std::string>> languageCodeMap;
-}
-
 namespace mux
 {
 	template <typename... Args>
@@ -29,7 +24,7 @@ namespace mux
 		if(config::shouldStopOnError())
 		{
 			util::error("stopping on first error");
-			exit(-1);
+			driver::stop();
 		}
 	}
 
@@ -52,11 +47,83 @@ namespace mux
 		return "";
 	}
 
+	// how many bytes of the file a stream takes up, if we can tell. mkvmerge stores exact numbers in the
+	// track statistics tags (which might have a language suffix, eg. 'NUMBER_OF_BYTES-eng').
+	static uint64_t estimate_stream_size(AVFormatContext* ctx, AVStream* strm)
+	{
+		if(auto x = av_dict_get(strm->metadata, "NUMBER_OF_BYTES", nullptr, AV_DICT_IGNORE_SUFFIX); x && x->value)
+			return strtoull(x->value, nullptr, 10);
+
+		if(ctx->duration <= 0)
+			return 0;
+
+		int64_t bps = strm->codecpar->bit_rate;
+		if(auto x = av_dict_get(strm->metadata, "BPS", nullptr, AV_DICT_IGNORE_SUFFIX); bps <= 0 && x && x->value)
+			bps = strtoll(x->value, nullptr, 10);
+
+		return bps > 0 ? static_cast<uint64_t>(bps / 8.0 * ctx->duration / AV_TIME_BASE) : 0;
+	}
+
+	// the input, minus the streams we're leaving out, plus whatever comes from the subtitle source. this only
+	// needs to be close; the file is truncated to its real size at the end.
+	static uint64_t estimate_output_size(AVFormatContext* inctx, AVFormatContext* ssctx,
+		const std::unordered_map<AVStream*, size_t>& finalStreamMap)
+	{
+		auto size = inctx->pb ? avio_size(inctx->pb) : 0;
+		if(size <= 0)
+			return 0;
+
+		auto est = static_cast<uint64_t>(size);
+		for(unsigned i = 0; i < inctx->nb_streams; i++)
+		{
+			if(finalStreamMap.find(inctx->streams[i]) == finalStreamMap.end())
+				est -= std::min(est, estimate_stream_size(inctx, inctx->streams[i]));
+		}
+
+		for(unsigned i = 0; ssctx && i < ssctx->nb_streams; i++)
+		{
+			if(finalStreamMap.find(ssctx->streams[i]) != finalStreamMap.end())
+				est += estimate_stream_size(ssctx, ssctx->streams[i]);
+		}
+
+		return est;
+	}
+
+
+	// what a checkpoint must have been made from to be resumed: the same inputs (by size and mtime), the same
+	// streams out of them, the same subtitle delay, and the same libavformat (which decides what the header
+	// looks like).
+	static std::string checkpoint_key(AVFormatContext* inctx, AVFormatContext* ssctx,
+		const std::unordered_map<AVStream*, size_t>& finalStreamMap, double subtitleDelay)
+	{
+		std::vector<std::string> parts;
+		for(auto c : { inctx, ssctx })
+		{
+			if(!c)
+				continue;
+
+			if(util::FileStat st; c->url && util::statFile(c->url, &st))
+				parts.push_back(std::to_string(st.size) + ":" + std::to_string(st.mtime));
+
+			for(unsigned i = 0; i < c->nb_streams; i++)
+			{
+				if(auto it = finalStreamMap.find(c->streams[i]); it != finalStreamMap.end())
+					parts.push_back(zpr::sprint("%d>%d", i, it->second));
+			}
+		}
+
+		parts.push_back(zpr::sprint("%.3f", subtitleDelay));
+		parts.push_back(LIBAVFORMAT_IDENT);
+
+		return util::join(parts, ",");
+	}
 
 	// refer: https://github.com/FFmpeg/FFmpeg/blob/10bcc41bb40ba479bfc5ad29b1650a6b335437a8/doc/examples/remuxing.c
 	static bool writeOutput(const std::fs::path& outfile, AVFormatContext* inctx, AVFormatContext* ssctx,
 		const std::vector<AVStream*>& finalStreams, std::unordered_map<AVStream*, size_t>& finalStreamMap, double subtitleDelay)
 	{
+		stats::Scope timer(stats::Stage::Remux);
+
 		AVFormatContext* outctx = 0;
 		if(avformat_alloc_output_context2(&outctx, nullptr, "matroska", outfile.string().c_str()) < 0)
 		{
@@ -88,26 +155,91 @@ namespace mux
 
 		// av_dump_format(outctx, 0, "url", 1);
 
-		// short circuiting. open + write header
-		if(avio_open(&outctx->pb, outfile.string().c_str(), AVIO_FLAG_WRITE) < 0)
+		// short circuiting. open + write header. the output only gets its real name once it's
+		// complete and on disk; see staging.
+		bool toFile = !(config::isBenchmarkingMux() && config::getOutputFolder().empty());
+		auto tmpfile = staging::tempPath(outfile);
+
+		// with '--resume', an earlier run might have got partway through this already.
+		auto tracker = toFile ? checkpoint::create(tmpfile, outctx, checkpoint_key(inctx, ssctx, finalStreamMap, subtitleDelay))
+			: nullptr;
+
+		auto resumeFrom = checkpoint::resumeOffset(tracker);
+
+		auto writer = !toFile ? output::openNull()
+			: resumeFrom > 0 ? output::reopen(tmpfile, resumeFrom, tracker)
+			: output::open(tmpfile, estimate_output_size(inctx, ssctx, finalStreamMap), tracker);
+
+		if(!writer)
 		{
 			error("failed to open output file for writing");
+			checkpoint::finish(tracker, tmpfile, false);
 			return false;
 		}
 
-		outctx->max_interleave_delta = 0;
+		outctx->pb = output::getContext(writer);
+		outctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+		outctx->output_ts_offset = checkpoint::timestampOffset(tracker);
+
 		if(avformat_write_header(outctx, nullptr) < 0)
 		{
 			error("failed to write header");
+			output::close(writer);
+			staging::discard(tmpfile);
+			checkpoint::finish(tracker, tmpfile, false);
+			return false;
+		}
+
+		if(!checkpoint::headerWritten(tracker, outctx, inctx))
+		{
+			// the checkpoint is gone now, so the next run starts over.
+			error("could not resume '%s'", outfile.filename().string());
+			output::close(writer);
+			staging::discard(tmpfile);
+			checkpoint::finish(tracker, tmpfile, false);
 			return false;
 		}
 
+		if(resumeFrom > 0)
+			util::log("resuming from %.1f MB", resumeFrom / (1024.0 * 1024.0));
+
+		// every packet is tallied on the way in, and again when the muxer takes it from the interleaver.
+		verify::Tally readTally;
+		verify::Tally muxedTally;
+
+		// we do our own interleaving, so the memory it takes can be bounded.
+		auto interleaver = interleave::create(outctx, config::getInterleaveDelta(),
+			static_cast<uint64_t>(config::getInterleaveBufferSize()) * 1024 * 1024, &muxedTally, tracker);
+
 		// start copying, i guess.
 		int64_t maxPts = 0;
 		size_t frameCount = 0;
 
-		auto copy_frames = [&maxPts, &frameCount, &finalStreamMap, subtitleDelay](AVFormatContext* inctx, AVFormatContext* ssctx,
-			AVFormatContext* outctx)
+		// progress goes by how far into the inputs we are, since streams that are left out still have to be
+		// read through; going by what's written, the eta would never get there.
+		uint64_t totalBytes = 0;
+		for(auto c : { inctx, ssctx })
+		{
+			if(c && c->pb)
+				totalBytes += static_cast<uint64_t>(std::max(int64_t(0), avio_size(c->pb)));
+		}
+
+		auto input_position = [inctx, ssctx]() -> uint64_t {
+			uint64_t ret = 0;
+			for(auto c : { inctx, ssctx })
+			{
+				if(c && c->pb)
+					ret += static_cast<uint64_t>(std::max(int64_t(0), avio_tell(c->pb)));
+			}
+
+			return ret;
+		};
+
+		progress::Job* job = 0;
+		auto recorder = bench::begin(outctx);
+
+		auto copy_frames = [&maxPts, &frameCount, &finalStreamMap, &job, &outfile, &readTally, interleaver, recorder,
+			tracker, totalBytes, input_position, subtitleDelay](AVFormatContext* inctx, AVFormatContext* ssctx, AVFormatContext* outctx)
 		{
 			// is this even advisable??? subtitle files should be small, right??
 			std::deque<AVPacket*> ss_pkts;
@@ -127,21 +259,9 @@ namespace mux
 						continue;
 					}
 
-					auto ts = (pkt.pts * ssstrm->time_base.num / ssstrm->time_base.den) * 1000 * 1000 * 1000;
-
 					ss_pkts.push_back(av_packet_clone(&pkt));
 					av_packet_unref(&pkt);
-
-					if(!config::disableProgress())
-					{
-						fprintf(stderr, "%s", zpr::sprint("\x1b[2K\r%s %s*%s time: %s\r", std::string(2 * util::get_log_indent(), ' '),
-							COLOUR_MAGENTA_BOLD, COLOUR_RESET, util::uglyPrintTime(ts, /* ms: */ false)
-						).c_str());
-					}
 				}
-
-				if(!config::disableProgress())
-					fprintf(stderr, "\n");
 			}
 
 			// sort the packets by pts?
@@ -149,7 +269,23 @@ namespace mux
 				return a->dts < b->dts;
 			});
 
-			auto copy_packet = [&frameCount, &maxPts, &finalStreamMap, subtitleDelay](AVFormatContext* outctx, AVStream* istrm, AVPacket* pkt) {
+			uint64_t ss_bytes = 0;
+			for(auto p : ss_pkts)
+				ss_bytes += p->size;
+
+			bench::subtitleBuffer(recorder, ss_pkts.size(), ss_bytes);
+
+			// they are freed as they are written, but most of them only near the end.
+			auto ss_memory = memory::Charge(ss_bytes + ss_pkts.size() * sizeof(AVPacket));
+
+			// only start showing progress after the subtitles were fetched, so it doesn't get in the way of the logging.
+			// (when resuming, the part of the input that was seeked past is already done.)
+			job = progress::begin(outfile.filename().string(), totalBytes, input_position(),
+				inctx->duration > 0 ? static_cast<uint64_t>(inctx->duration) * (1000 * 1000 * 1000 / AV_TIME_BASE) : 0);
+
+			auto copy_packet = [&frameCount, &maxPts, &finalStreamMap, &job, &readTally, interleaver, recorder, tracker, input_position,
+				subtitleDelay](
+				AVFormatContext* outctx, AVStream* istrm, AVPacket* pkt) {
 
 				// looks like we're re-using the same packet.
 				pkt->stream_index = finalStreamMap[istrm];
@@ -192,22 +328,23 @@ namespace mux
 					pkt->dts = 0;
 				}
 
-				if(av_interleaved_write_frame(outctx, pkt) < 0)
-					util::error("frame error");
+				// when resuming, everything up to the checkpoint is already there.
+				if(checkpoint::skip(tracker, pkt))
+					return;
 
+				verify::add(readTally, pkt);
+				bench::packet(recorder, pkt);
 
-				if(!config::disableProgress())
-				{
-					fprintf(stderr, "%s", zpr::sprint("\x1b[2K\r%s %s*%s time: %s\r", std::string(2 * util::get_log_indent(), ' '),
-						COLOUR_MAGENTA_BOLD, COLOUR_RESET, util::uglyPrintTime(ts, /* ms: */ false)
-					).c_str());
-				}
+				if(!interleave::write(interleaver, pkt))
+					util::error("frame error");
+
+				progress::update(job, input_position(), 1, ts);
 
 				frameCount++;
 			};
 
 			int64_t prevDts = 0;
-			while(true)
+			while(!checkpoint::failed(tracker))
 			{
 				AVPacket* pkt = 0;
 				AVStream* istrm = 0;
@@ -239,7 +376,8 @@ namespace mux
 
 				if(finalStreamMap.find(istrm) == finalStreamMap.end())
 				{
-					av_packet_unref(pkt);
+					bench::dropped(recorder);
+					av_packet_free(&pkt);
 					continue;
 				}
 
@@ -249,6 +387,8 @@ namespace mux
 				av_packet_free(&pkt);
 			}
 
+			progress::end(job);
+			job = 0;
 
 			// welp.
 			if(ss_pkts.size() > 0)
@@ -264,22 +404,112 @@ namespace mux
 
 		copy_frames(inctx, ssctx, outctx);
 
-		if(!config::disableProgress())
-			fprintf(stderr, "\n");
+		interleave::Stats is;
+		bool wroteAll = interleave::finish(interleaver, &is);
 
 		// ok, write the trailer
 		av_write_trailer(outctx);
 
 		// close the output
-		avio_closep(&outctx->pb);
+		output::Stats ws;
+		bool ok = output::close(writer, &ws) && wroteAll;
+
+		ok = checkpoint::finish(tracker, tmpfile, ok);
+
+		outctx->pb = nullptr;
 		avformat_free_context(outctx);
 
+		for(auto c : { inctx, ssctx })
+		{
+			if(c && c->pb)
+				stats::addBytesRead(static_cast<uint64_t>(c->pb->bytes_read));
+		}
+
+		stats::addBytesWritten(ws.bytes);
+		stats::addRemux(ws.bytes, timer.elapsed());
+		stats::addPackets(frameCount);
+		stats::addInterleaveBuffer(is.peakBytes);
+
+		bench::end(recorder, ws, is);
+
+		// nothing is read back, so this only checks that every packet we read made it through the interleaver
+		// and was taken by the muxer; what the muxer made of them is up to it (the writer only checks that the
+		// file came out as long as what it was given). the file was hashed as it was written.
+		bool verified = ok && verify::compare(readTally, muxedTally);
+		auto checksum = ws.checksummed ? zpr::sprint("%08x", ws.checksum) : "";
+
+		stats::setVerified(verified, checksum);
+		if(verified)
+		{
+			size_t packets = 0;
+			for(auto& s : muxedTally)
+				packets += s.packets;
+
+			util::log("interleaver passed on all %d %s in %d %s%s", packets, util::plural("packet", packets),
+				muxedTally.size(), util::plural("stream", muxedTally.size()),
+				checksum.empty() ? "" : zpr::sprint(" (crc32c %s)", checksum));
+		}
+
+		// the tagger edits the file in place afterwards, so a checksum written now would be wrong.
+		if(verified && !checksum.empty() && config::shouldWriteChecksumFile() && !config::isTagging()
+			&& !config::isBenchmarkingMux())
+		{
+			auto out = std::ofstream(outfile.string() + ".crc32c", std::ios::binary | std::ios::trunc);
+			out << zpr::sprint("%s  %s\n", checksum, outfile.filename().string());
+
+			if(!out.good())
+				util::warn("failed to write checksum file");
+		}
+
+		// good outputs get their name at the next commit; broken ones are removed, and so are benchmark
+		// outputs, which are only there to be written.
+		if(toFile)
+		{
+			if(ok && verified && !config::isBenchmarkingMux())
+			{
+				staging::add(tmpfile, outfile);
+				journal::record(journal::Stage::Muxed, outfile);
+			}
+			else
+			{
+				staging::discard(tmpfile);
+			}
+		}
+
+		util::log("wrote %.1f MB (%s): %d writes, queue depth %.1f avg / %d max, latency %.2f ms avg / %.2f ms max%s",
+			ws.bytes / (1024.0 * 1024.0), ws.backend, ws.writes, ws.avgQueueDepth, ws.maxQueueDepth,
+			ws.avgLatencyNs / 1'000'000.0, ws.maxLatencyNs / 1'000'000.0, ws.preallocated == 0 ? ""
+				: zpr::sprint(", %.1f MB preallocated", ws.preallocated / (1024.0 * 1024.0)));
+
+		util::log("interleaving: peak %.1f MB / %d packets / %.2f s buffered%s", is.peakBytes / (1024.0 * 1024.0),
+			is.peakPackets, is.peakSpanNs / 1'000'000'000.0, (is.deltaFlushes + is.memoryFlushes) == 0 ? ""
+				: zpr::sprint(", %d written early (%d over time, %d over memory)", is.deltaFlushes + is.memoryFlushes,
+					is.deltaFlushes, is.memoryFlushes));
+
+		if(!ok)
+		{
+			error("failed to write output file");
+			return false;
+		}
+		else if(!verified)
+		{
+			error("packets were lost between the input and the muxer");
+			return false;
+		}
+
 		return true;
 	}
 
-	static std::vector<AVStream*> select_streams(AVFormatContext* ctx, const std::vector<AVStream*>& strms, const std::string& type)
+	static FileInfo describe_streams(AVFormatContext* ctx)
 	{
-		auto print_stream_heading = [](AVFormatContext* ctx, AVStream* strm, bool idx = true) -> std::pair<std::string, std::string> {
+		FileInfo ret;
+		if(ctx->duration > 0)
+			ret.durationNs = static_cast<uint64_t>(ctx->duration) * (1000 * 1000 * 1000 / AV_TIME_BASE);
+
+		for(unsigned int i = 0; i < ctx->nb_streams; i++)
+		{
+			auto strm = ctx->streams[i];
+			auto cp = strm->codecpar;
 
 			auto duration_to_ns = [&ctx, &strm]() -> uint64_t {
 
@@ -292,18 +522,124 @@ namespace mux
 				else        dur = (strm->time_base.num * x / strm->time_base.den);
 
 				dur *= (1000.0 * 1000.0 * 1000.0);
-				return static_cast<uint64_t>(dur);
+				return static_cast<uint64_t>(std::max(0.0, dur));
 			};
 
-			auto cp = strm->codecpar;
+			StreamInfo si;
+			si.index        = strm->index;
+			si.type         = cp->codec_type;
+			si.codec        = avcodec_get_name(cp->codec_id);
+			si.lang         = dict_get_value(strm->metadata, "language");
+			si.title        = dict_get_value(strm->metadata, "title");
+			si.filename     = dict_get_value(strm->metadata, "filename");
+			si.durationNs   = duration_to_ns();
 
-			auto lang = dict_get_value(strm->metadata, "language");
+			if(auto br = cp->bit_rate; br > 0 && br != INT64_MIN)
+				si.bitrate = br;
+
+			if(cp->codec_type == AVMEDIA_TYPE_VIDEO)
+			{
+				// without a full probe, we might only have the average frame rate (or nothing at all).
+				auto fps = strm->r_frame_rate.den > 0 ? strm->r_frame_rate : strm->avg_frame_rate;
+
+				si.width = cp->width;
+				si.height = cp->height;
+
+				if(fps.num > 0 && fps.den > 0)
+					si.fps = static_cast<double>(fps.num) / static_cast<double>(fps.den);
+			}
+			else if(cp->codec_type == AVMEDIA_TYPE_AUDIO)
+			{
+				char buf[64] = { 0 };
+#if LIBAVUTIL_VERSION_MAJOR >= 57 // FFmpeg 6.0+ uses AVChannelLayout
+				av_channel_layout_describe(&cp->ch_layout, buf, 63);
+				si.channels = cp->ch_layout.nb_channels;
+#else
+				av_get_channel_layout_string(buf, 63, cp->channels, cp->channel_layout);
+				si.channels = cp->channels;
+#endif
+				si.layout = buf;
+				si.sampleRate = cp->sample_rate;
+				si.bitsPerSample = cp->bits_per_raw_sample;
+
+				// the sample format is only known after decoding, so it's missing with the fast probe.
+				if(auto fmt = av_get_sample_fmt_name(static_cast<AVSampleFormat>(cp->format)); fmt)
+					si.sampleFormat = fmt;
+			}
+
+			ret.streams.push_back(std::move(si));
+		}
+
+		return ret;
+	}
+
+	static std::string stream_id(const StreamInfo* strm)
+	{
+		return zpr::sprint("%d:%d", strm->source, strm->index);
+	}
+
+	// releases from the same group tend to have the same streams in every episode, so the
+	// selection is keyed on everything the user would look at when choosing.
+	static std::string layout_signature(const std::vector<const FileInfo*>& infos)
+	{
+		uint64_t hash = 0xcbf29ce484222325;
+		auto add = [&hash](const std::string& s) {
+			for(char c : s)
+				hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+
+			// separator, so "ab"+"c" and "a"+"bc" differ.
+			hash = (hash ^ 0xff) * 0x100000001b3;
+		};
+
+		for(auto info : infos)
+		{
+			for(const auto& s : info->streams)
+			{
+				add(zpr::sprint("%d:%d", s.source, s.type));
+				add(s.codec);
+				add(s.lang);
+				add(s.title);
+			}
+		}
+
+		return zpr::sprint("%016llx", hash);
+	}
+
+	static std::vector<const StreamInfo*> select_streams(const std::vector<const StreamInfo*>& strms, const std::string& type,
+		const std::string& signature)
+	{
+		auto key = zpr::sprint("%s:%s", signature, type);
+		if(std::vector<std::string> ids; cache::lookupSelection(key, &ids))
+		{
+			std::vector<const StreamInfo*> ret;
+			for(const auto& id : ids)
+			{
+				if(auto it = std::find_if(strms.begin(), strms.end(), [&id](auto s) { return stream_id(s) == id; });
+					it != strms.end())
+				{
+					ret.push_back(*it);
+				}
+			}
+
+			// if the candidates changed (eg. different language preferences), just ask again.
+			if(ret.size() == ids.size())
+			{
+				util::log("using remembered %s selection: %s", type, util::listToString(ret, [](auto x) -> auto {
+					return std::to_string(x->index);
+				}));
+
+				return ret;
+			}
+		}
+
+		auto print_stream_heading = [](const StreamInfo* strm, bool idx = true) -> std::pair<std::string, std::string> {
+
+			auto lang = strm->lang;
 			if(lang.empty()) lang = "und";
 
-			auto codec = avcodec_get_name(cp->codec_id);
-			auto title = zpr::sprint("%s", codec);
+			auto title = strm->codec;
 			auto subtitle = zpr::sprint("%s%s, %s", idx ? zpr::sprint("idx %d, ", strm->index) : "", lang,
-				util::uglyPrintTime(duration_to_ns()));
+				util::uglyPrintTime(strm->durationNs));
 
 			return { title, subtitle };
 		};
@@ -314,60 +650,50 @@ namespace mux
 		{
 			misc::Option opt;
 
-			auto cp = strm->codecpar;
-
-			std::tie(opt.title, opt.subTitle) = print_stream_heading(ctx, strm);
+			std::tie(opt.title, opt.subTitle) = print_stream_heading(strm);
 
-			if(auto name = dict_get_value(strm->metadata, "title"); !name.empty())
+			if(!strm->title.empty())
 			{
 				misc::Option::Info info;
 				info.heading = "name:";
-				info.subheading = dict_get_value(strm->metadata, "title");
+				info.subheading = strm->title;
 
 				opt.infos.push_back(info);
 			}
 
-			if(cp->codec_type == AVMEDIA_TYPE_VIDEO)
+			if(strm->type == AVMEDIA_TYPE_VIDEO)
 			{
 				misc::Option::Info info;
 				info.heading = "res:";
-				info.subheading = zpr::sprint("%dx%d, %.2f fps", cp->width, cp->height,
-					static_cast<double>(strm->r_frame_rate.num) / static_cast<double>(strm->r_frame_rate.den));
+
+				info.subheading = zpr::sprint("%dx%d", strm->width, strm->height);
+				if(strm->fps > 0)
+					info.subheading += zpr::sprint(", %.2f fps", strm->fps);
 
 				opt.infos.push_back(info);
 			}
-			else if(cp->codec_type == AVMEDIA_TYPE_AUDIO)
+			else if(strm->type == AVMEDIA_TYPE_AUDIO)
 			{
 				misc::Option::Info info;
 				info.heading = "res:";
 
-				char buf[64] = { 0 };
-#if LIBAVUTIL_VERSION_MAJOR >= 57 // FFmpeg 6.0+ uses AVChannelLayout
-				av_channel_layout_describe(&cp->ch_layout, buf, 63);
-				int channels = cp->ch_layout.nb_channels;
-#else
-				av_get_channel_layout_string(buf, 63, cp->channels, cp->channel_layout);
-				int channels = cp->channels;
-#endif
-				std::string layout = buf;
+				info.subheading = zpr::sprint("%d Hz, %d ch (%s)", strm->sampleRate, strm->channels, strm->layout);
 
-				std::string format = av_get_sample_fmt_name(static_cast<AVSampleFormat>(cp->format));
+				if(!strm->sampleFormat.empty())
+					info.subheading += zpr::sprint(", %s", strm->sampleFormat);
 
-				info.subheading = zpr::sprint("%d Hz, %d ch (%s), %s", cp->sample_rate,
-					channels, layout, format);
-
-				if(cp->bits_per_raw_sample > 0)
-					info.subheading += zpr::sprint(" (%d-bit)", cp->bits_per_raw_sample);
+				if(strm->bitsPerSample > 0)
+					info.subheading += zpr::sprint(" (%d-bit)", strm->bitsPerSample);
 
 				opt.infos.push_back(info);
 			}
 
-			if(auto br = cp->bit_rate; br > 0 && br != INT64_MIN)
+			if(strm->bitrate > 0)
 			{
 				misc::Option::Info info;
 				info.heading = "bit:";
 
-				auto x = get_prefix(static_cast<double>(br));
+				auto x = get_prefix(static_cast<double>(strm->bitrate));
 				info.subheading = zpr::sprint("%.1f %sb/s", x.first, x.second);
 
 				opt.infos.push_back(info);
@@ -377,9 +703,12 @@ namespace mux
 			opts.push_back(opt);
 		}
 
-		return util::map(misc::userChoiceMultiple(opts), [&strms](size_t x) -> AVStream* {
+		auto ret = util::map(misc::userChoiceMultiple(opts), [&strms](size_t x) -> const StreamInfo* {
 			return strms[x - 1];
 		});
+
+		cache::storeSelection(key, util::map(ret, stream_id));
+		return ret;
 	}
 
 
@@ -393,28 +722,14 @@ namespace mux
 
 	static std::fs::path getExtraSubtitleSource(const std::string& name)
 	{
+		// both of these were checked when parsing the arguments.
 		if(auto manual = config::getManualSubsPath(); !manual.empty())
-		{
-			if(!std::fs::exists(manual))
-			{
-				error("subtitle input '%s' does not exist", manual);
-				config::setManualSubsPath("");
-				return "";
-			}
-
 			return std::fs::path(manual);
-		}
 
 		if(config::getExtraSubsPath().empty())
 			return "";
 
 		std::fs::path path = config::getExtraSubsPath();
-		if(!std::fs::exists(path) || !std::fs::is_directory(path))
-		{
-			error("extra subs directory '%s' does not exist, or is not a directory", path.string());
-			config::setExtraSubsPath("");
-			return "";
-		}
 
 		// get all files:
 		std::vector<std::fs::path> files;
@@ -527,228 +842,311 @@ namespace mux
 
 
 
-	static std::string guessLanguageFromTitle(const std::vector<std::string>& preferredLangs, std::string title)
+	// matroska track headers already carry the codec, language, title, dimensions and sample rate, which is
+	// all we need to select and stream-copy. avformat_find_stream_info reads (and decodes) frames to fill in
+	// the rest, which is slow on cold storage -- so only do that if the headers left something out.
+	static bool have_stream_params(AVFormatContext* ctx)
 	{
-		title = util::lowercase(title);
-
-		for(const auto& lang : preferredLangs)
+		for(unsigned int i = 0; i < ctx->nb_streams; i++)
 		{
-			auto names = misc::languageCodeMap[lang];
-			for(const auto& x : names)
-			{
-				auto lx = util::lowercase(x);
-				if(title.find(lx) != std::string::npos)
-					return lang;
-			}
+			auto strm = ctx->streams[i];
+			auto cp = strm->codecpar;
+
+			if(cp->codec_type == AVMEDIA_TYPE_ATTACHMENT || (strm->disposition & AV_DISPOSITION_ATTACHED_PIC))
+				continue;
+
+			if(cp->codec_id == AV_CODEC_ID_NONE)
+				return false;
+
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+			int channels = cp->ch_layout.nb_channels;
+#else
+			int channels = cp->channels;
+#endif
+
+			if(cp->codec_type == AVMEDIA_TYPE_VIDEO && (cp->width <= 0 || cp->height <= 0))
+				return false;
+
+			if(cp->codec_type == AVMEDIA_TYPE_AUDIO && (cp->sample_rate <= 0 || channels <= 0))
+				return false;
 		}
 
-		return "";
+		return true;
 	}
 
+	static bool probe_streams(AVFormatContext* ctx)
+	{
+		if(config::useFastProbe() && ctx->iformat && strstr(ctx->iformat->name, "matroska") && have_stream_params(ctx))
+			return true;
 
-	bool muxOneFile(std::fs::path& inputfile)
+		return avformat_find_stream_info(ctx, nullptr) >= 0;
+	}
+
+
+	static AVFormatContext* open_input(const std::fs::path& path)
 	{
+		stats::Scope timer(stats::Stage::Probe);
+
 		// the entire state is stored in 'ctx', i think -- we just call more functions
 		// to populate the fields inside.
 		auto ctx = avformat_alloc_context();
-		if(avformat_open_input(&ctx, inputfile.string().c_str(), nullptr, nullptr) < 0)
+		if(avformat_open_input(&ctx, path.string().c_str(), nullptr, nullptr) < 0)
 		{
-			error("failed to open input file '%s'", inputfile.string());
-			return false;
+			error("failed to open input file '%s'", path.string());
+			return nullptr;
 		}
 
 		// get the stream info.
-		if(avformat_find_stream_info(ctx, nullptr) < 0)
+		if(!probe_streams(ctx))
 		{
 			error("failed to read streams");
 			avformat_close_input(&ctx);
+			return nullptr;
+		}
+
+		return ctx;
+	}
+
+	static void close_input(AVFormatContext* ctx)
+	{
+		if(ctx)
+		{
+			avformat_close_input(&ctx);
+			avformat_free_context(ctx);
+		}
+	}
+
+	// if we have the stream table cached, we don't need to open the file at all (unless we're actually muxing,
+	// but that can happen later). otherwise, open it, describe the streams, and hand back the context.
+	static bool get_file_info(const std::fs::path& path, FileInfo* info, AVFormatContext** ctx)
+	{
+		*ctx = nullptr;
+		if(cache::lookup(path, info))
+		{
+			stats::addCacheHit();
+			return true;
+		}
+
+		stats::addCacheMiss();
+		if(*ctx = open_input(path); !*ctx)
 			return false;
+
+		*info = describe_streams(*ctx);
+		cache::store(path, *info);
+
+		return true;
+	}
+
+	// the cached table must still line up with what's actually in the file.
+	static bool matches_file_info(AVFormatContext* ctx, const FileInfo& info)
+	{
+		if(ctx->nb_streams != info.streams.size())
+			return false;
+
+		for(const auto& si : info.streams)
+		{
+			if(si.index < 0 || static_cast<unsigned int>(si.index) >= ctx->nb_streams)
+				return false;
+
+			auto strm = ctx->streams[si.index];
+			if(strm->codecpar->codec_type != si.type || avcodec_get_name(strm->codecpar->codec_id) != si.codec)
+				return false;
 		}
 
-		std::string ss_filename;
-		AVFormatContext* ssctx = 0;
-		if(auto ss = getExtraSubtitleSource(inputfile.filename().stem().string()); !ss.empty())
+		return true;
+	}
+
+
+	void pickStreams(const FileInfo& info, const std::vector<std::string>& preferredAudioLangs,
+		const std::vector<std::string>& preferredSubtitleLangs, std::vector<const StreamInfo*>& selectedStreams,
+		std::vector<const StreamInfo*>& videoStrms, std::vector<const StreamInfo*>& audioStrms,
+		std::vector<const StreamInfo*>& subtitleStrms, StreamLangMap& audioStreamLangs, StreamLangMap& subtitleStreamLangs)
+	{
+		bool preferSDH      = config::isPreferSDHSubs();
+		bool preferSigns    = config::isPreferSignSongSubs();
+		bool preferTextSubs = config::isPreferTextSubs();
+
+		for(const auto& si : info.streams)
 		{
-			ssctx = avformat_alloc_context();
-			if(avformat_open_input(&ssctx, ss.string().c_str(), nullptr, nullptr) < 0)
+			auto strm = &si;
+			if(strm->type == AVMEDIA_TYPE_VIDEO)
+			{
+				// if this is a picture, then add it as an attachment.
+				if(util::match(strm->codec, "mjpeg", "png"))
+				{
+					selectedStreams.push_back(strm);
+				}
+				else
+				{
+					// always select video.
+					// we could end up with more than once, since there might be cover art
+					// and images are encoded as video, lmao.
+					videoStrms.push_back(strm);
+				}
+			}
+			else if(strm->type == AVMEDIA_TYPE_AUDIO)
+			{
+				// hold off on selecting audio
+				std::string lang = strm->lang;
+				std::string name = strm->title;
+
+				// you motherfucker, releases files properly!!!
+				if(lang.empty()) lang = misc::guessLanguageFromTitle(preferredAudioLangs, name);
+
+				audioStreamLangs[lang].push_back({ strm, util::lowercase(name) });
+			}
+			else if(strm->type == AVMEDIA_TYPE_SUBTITLE)
 			{
-				error("failed to open subtitle file '%s'", ss.string());
-				avformat_free_context(ssctx);
-				ssctx = nullptr;
+				// hold off on selecting subs
+				std::string lang = strm->lang;
+				std::string name = strm->title;
+
+				// you motherfucker, releases files properly!!!
+				if(lang.empty()) lang = misc::guessLanguageFromTitle(preferredSubtitleLangs, name);
+
+				subtitleStreamLangs[lang].push_back({ strm, util::lowercase(name) });
 			}
 			else
 			{
-				if(avformat_find_stream_info(ssctx, nullptr))
-				{
-					avformat_close_input(&ssctx);
+				// select everything else (attachments, fonts, cover art, etc.)
+				selectedStreams.push_back(strm);
+			}
+		}
 
-					error("failed to read streams");
-					avformat_free_context(ssctx);
-					ssctx = nullptr;
-				}
-				else
+		// select audio streams
+		for(const auto& lang : preferredAudioLangs)
+		{
+			if(auto it = audioStreamLangs.find(lang); it != audioStreamLangs.end())
+			{
+				bool found = false;
+
+				auto strms = it->second;
+				for(const auto& [ strm, name ] : strms)
 				{
-					ss_filename = ss;
+					// if there's commentary, don't select it.
+					if(name.find("commentary") != std::string::npos || name.find("director") != std::string::npos)
+						continue;
+
+					// idk what else to filter on, so just include it.
+					audioStrms.push_back(strm);
+					found = true;
 				}
+
+				// note: we put this here, so we select all audio of a given language,
+				// but not more than one language.
+				if(found)
+					break;
 			}
 		}
 
 
+		// select subtitle streams
+		for(const auto& lang : preferredSubtitleLangs)
+		{
+			if(auto it = subtitleStreamLangs.find(lang); it != subtitleStreamLangs.end())
+			{
+				bool found = false;
 
+				auto strms = it->second;
+				for(const auto& [ strm, name ] : strms)
+				{
+					// if there's commentary, don't select it.
+					if(name.find("commentary") != std::string::npos || name.find("director") != std::string::npos)
+						continue;
 
+					// if you don't prefer SDH, don't use SDH.
+					if(name.find("sdh") != std::string::npos && !preferSDH)
+						continue;
 
+					// if you don't prefer sign/song subs, then don't. (this assumes nobody puts
+					// the words "signs" or "songs" in the name...)
+					else if((name.find("signs") != std::string::npos || name.find("songs") != std::string::npos) && !preferSigns)
+						continue;
 
+					// if you prefer text subs, make sure it's ass or srt.
+					else if(preferTextSubs && !util::match(strm->codec, "ssa", "ass", "mov_text", "srt", "subrip"))
+						continue;
 
+					// ok then, it *should* be ok?
+					subtitleStrms.push_back(strm);
+					found = true;
+				}
 
+				if(found)
+					break;
+			}
+		}
+	}
 
+	bool muxOneFile(std::fs::path& inputfile)
+	{
+		trace::begin("mux", "driver");
+		defer(trace::end());
 
-		auto preferredAudioLangs    = config::getAudioLangs();
-		auto preferredSubtitleLangs = config::getSubtitleLangs();
-		bool onlyOneStream          = config::isPreferOneStream();
+		FileInfo mainInfo;
+		AVFormatContext* ctx = 0;
+		if(!get_file_info(inputfile, &mainInfo, &ctx))
+			return false;
 
+		std::fs::path ss_filename;
+		FileInfo ssInfo;
+		AVFormatContext* ssctx = 0;
+		bool haveSubsSource = false;
 
-		std::set<AVStream*> selectedStreams;
+		if(auto ss = getExtraSubtitleSource(inputfile.filename().stem().string()); !ss.empty())
+		{
+			if(get_file_info(ss, &ssInfo, &ssctx))
+			{
+				ss_filename = ss;
+				haveSubsSource = true;
 
-		std::vector<AVStream*> videoStrms;
-		std::vector<AVStream*> audioStrms;
-		std::vector<AVStream*> subtitleStrms;
+				for(auto& si : ssInfo.streams)
+					si.source = 1;
+			}
+		}
 
-		using StreamLangMap_t = std::unordered_map<std::string, std::vector<std::pair<AVStream*, std::string>>>;
-		StreamLangMap_t audioStreamLangs;
-		StreamLangMap_t subtitleStreamLangs;
+		defer(close_input(ctx));
+		defer(close_input(ssctx));
 
-		util::log("found %d %s", ctx->nb_streams, util::plural("stream", ctx->nb_streams));
 
 
-		auto pick_streams = [&preferredAudioLangs, &preferredSubtitleLangs](AVFormatContext* ctx, std::set<AVStream*>& selectedStreams,
-			std::vector<AVStream*>& videoStrms, std::vector<AVStream*>& audioStrms, std::vector<AVStream*>& subtitleStrms,
-			StreamLangMap_t& audioStreamLangs, StreamLangMap_t& subtitleStreamLangs)
-		{
-			bool preferSDH      = config::isPreferSDHSubs();
-			bool preferSigns    = config::isPreferSignSongSubs();
-			bool preferTextSubs = config::isPreferTextSubs();
 
-			for(unsigned int i = 0; i < ctx->nb_streams; i++)
-			{
-				auto strm = ctx->streams[i];
-				if(strm->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
-				{
-					// if this is a picture, then add it as an attachment.
-					if(util::match(avcodec_get_name(strm->codecpar->codec_id), std::string("mjpeg"), std::string("png")))
-					{
-						selectedStreams.insert(strm);
-					}
-					else
-					{
-						// always select video.
-						// we could end up with more than once, since there might be cover art
-						// and images are encoded as video, lmao.
-						videoStrms.push_back(strm);
-					}
-				}
-				else if(strm->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
-				{
-					// hold off on selecting audio
-					std::string lang = dict_get_value(strm->metadata, "language");
-					std::string name = dict_get_value(strm->metadata, "title");
 
-					// you motherfucker, releases files properly!!!
-					if(lang.empty()) lang = guessLanguageFromTitle(preferredAudioLangs, name);
 
-					audioStreamLangs[lang].push_back({ strm, util::lowercase(name) });
-				}
-				else if(strm->codecpar->codec_type == AVMEDIA_TYPE_SUBTITLE)
-				{
-					// hold off on selecting subs
-					std::string lang = dict_get_value(strm->metadata, "language");
-					std::string name = dict_get_value(strm->metadata, "title");
 
-					// you motherfucker, releases files properly!!!
-					if(lang.empty()) lang = guessLanguageFromTitle(preferredSubtitleLangs, name);
 
-					subtitleStreamLangs[lang].push_back({ strm, util::lowercase(name) });
-				}
-				else
-				{
-					// select everything else (attachments, fonts, cover art, etc.)
-					selectedStreams.insert(strm);
-				}
-			}
 
-			// select audio streams
-			for(const auto& lang : preferredAudioLangs)
-			{
-				if(auto it = audioStreamLangs.find(lang); it != audioStreamLangs.end())
-				{
-					bool found = false;
 
-					auto strms = it->second;
-					for(const auto& [ strm, name ] : strms)
-					{
-						// if there's commentary, don't select it.
-						if(name.find("commentary") != std::string::npos || name.find("director") != std::string::npos)
-							continue;
+		auto preferredAudioLangs    = config::getAudioLangs();
+		auto preferredSubtitleLangs = config::getSubtitleLangs();
+		bool onlyOneStream          = config::isPreferOneStream();
 
-						// idk what else to filter on, so just include it.
-						audioStrms.push_back(strm);
-						found = true;
-					}
+		auto signature = layout_signature(haveSubsSource
+			? std::vector<const FileInfo*> { &mainInfo, &ssInfo }
+			: std::vector<const FileInfo*> { &mainInfo });
 
-					// note: we put this here, so we select all audio of a given language,
-					// but not more than one language.
-					if(found)
-						break;
-				}
-			}
 
+		std::vector<const StreamInfo*> selectedStreams;
 
-			// select subtitle streams
-			for(const auto& lang : preferredSubtitleLangs)
-			{
-				if(auto it = subtitleStreamLangs.find(lang); it != subtitleStreamLangs.end())
-				{
-					bool found = false;
+		std::vector<const StreamInfo*> videoStrms;
+		std::vector<const StreamInfo*> audioStrms;
+		std::vector<const StreamInfo*> subtitleStrms;
 
-					auto strms = it->second;
-					for(const auto& [ strm, name ] : strms)
-					{
-						// if there's commentary, don't select it.
-						if(name.find("commentary") != std::string::npos || name.find("director") != std::string::npos)
-							continue;
-
-						// if you don't prefer SDH, don't use SDH.
-						if(name.find("sdh") != std::string::npos && !preferSDH)
-							continue;
-
-						// if you don't prefer sign/song subs, then don't. (this assumes nobody puts
-						// the words "signs" or "songs" in the name...)
-						else if((name.find("signs") != std::string::npos || name.find("songs") != std::string::npos) && !preferSigns)
-							continue;
-
-						// if you prefer text subs, make sure it's ass or srt.
-						else if(preferTextSubs && !util::match(strm->codecpar->codec_id,
-							AV_CODEC_ID_SSA, AV_CODEC_ID_ASS, AV_CODEC_ID_MOV_TEXT, AV_CODEC_ID_SRT, AV_CODEC_ID_SUBRIP))
-							continue;
-
-						// ok then, it *should* be ok?
-						subtitleStrms.push_back(strm);
-						found = true;
-					}
+		StreamLangMap audioStreamLangs;
+		StreamLangMap subtitleStreamLangs;
+
+		util::log("found %d %s", mainInfo.streams.size(), util::plural("stream", mainInfo.streams.size()));
 
-					if(found)
-						break;
-				}
-			}
-		};
 
 		{
 			// pick streams from the primary source.
-			pick_streams(ctx, selectedStreams, videoStrms, audioStrms, subtitleStrms, audioStreamLangs, subtitleStreamLangs);
+			pickStreams(mainInfo, preferredAudioLangs, preferredSubtitleLangs, selectedStreams, videoStrms, audioStrms,
+				subtitleStrms, audioStreamLangs, subtitleStreamLangs);
 
 
-			if(ssctx)
+			if(haveSubsSource)
 			{
-				util::log("using '%s' for subtitles", ss_filename);
+				util::log("using '%s' for subtitles", ss_filename.string());
 				if(!subtitleStrms.empty() || !subtitleStreamLangs.empty())
 				{
 					util::warn("ignoring all subtitle streams from input file due to override");
@@ -758,14 +1156,14 @@ namespace mux
 				}
 
 				// pick streams from the secondary source.
-				std::vector<AVStream*> ss_videoStrms;
-				std::vector<AVStream*> ss_audioStrms;
-				StreamLangMap_t ss_audioStreamLangs;
+				std::vector<const StreamInfo*> ss_videoStrms;
+				std::vector<const StreamInfo*> ss_audioStrms;
+				StreamLangMap ss_audioStreamLangs;
 
 				// we use fresh copies of lists for audio and video, since we will just discard them.
 				// use the main list for subtitles & attachments.
-				pick_streams(ssctx, selectedStreams, ss_videoStrms, ss_audioStrms, subtitleStrms, ss_audioStreamLangs,
-					subtitleStreamLangs);
+				pickStreams(ssInfo, preferredAudioLangs, preferredSubtitleLangs, selectedStreams, ss_videoStrms,
+					ss_audioStrms, subtitleStrms, ss_audioStreamLangs, subtitleStreamLangs);
 			}
 		}
 
@@ -821,7 +1219,7 @@ namespace mux
 					util::warn("warn: multiple video streams found");
 
 				else
-					videoStrms = select_streams(ctx, videoStrms, "video");
+					videoStrms = select_streams(videoStrms, "video", signature);
 			}
 
 			if(audioStrms.size() > 1)
@@ -830,7 +1228,7 @@ namespace mux
 					util::warn("warn: multiple audio streams found");
 
 				else
-					audioStrms = select_streams(ctx, audioStrms, "audio");
+					audioStrms = select_streams(audioStrms, "audio", signature);
 			}
 
 			if(subtitleStrms.size() > 1)
@@ -839,98 +1237,90 @@ namespace mux
 					util::warn("warn: multiple subtitle streams found");
 
 				else
-					subtitleStrms = select_streams(ctx, subtitleStrms, "subtitle");
+					subtitleStrms = select_streams(subtitleStrms, "subtitle", signature);
 			}
 		}
 
 		// the final order.
-		std::vector<AVStream*> finalStreams;
-		std::unordered_map<AVStream*, size_t> finalStreamMap;
+		std::vector<const StreamInfo*> finalInfos;
 
 		// video, audio, subtitle, attachments.
-		finalStreams.insert(finalStreams.end(), videoStrms.begin(), videoStrms.end());
-		finalStreams.insert(finalStreams.end(), audioStrms.begin(), audioStrms.end());
-		finalStreams.insert(finalStreams.end(), subtitleStrms.begin(), subtitleStrms.end());
-		finalStreams.insert(finalStreams.end(), selectedStreams.begin(), selectedStreams.end());
-
-		for(size_t i = 0; i < finalStreams.size(); i++)
-			finalStreamMap[finalStreams[i]] = i;
+		finalInfos.insert(finalInfos.end(), videoStrms.begin(), videoStrms.end());
+		finalInfos.insert(finalInfos.end(), audioStrms.begin(), audioStrms.end());
+		finalInfos.insert(finalInfos.end(), subtitleStrms.begin(), subtitleStrms.end());
+		finalInfos.insert(finalInfos.end(), selectedStreams.begin(), selectedStreams.end());
 
-		util::log("selected %d streams: %s", finalStreams.size(), util::listToString(finalStreams, [](auto x) -> auto {
+		util::log("selected %d streams: %s", finalInfos.size(), util::listToString(finalInfos, [](auto x) -> auto {
 			return std::to_string(x->index);
 		}));
 
 		util::indent_log();
-		for(auto strm : finalStreams)
+		for(auto strm : finalInfos)
 		{
-			auto lang = dict_get_value(strm->metadata, "language");
-			auto name = dict_get_value(strm->metadata, "title");
-
-			auto filename = dict_get_value(strm->metadata, "filename");
+			auto& lang = strm->lang;
+			auto& name = strm->title;
+			auto& filename = strm->filename;
 
 			std::string type;
-			if(strm->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)        type = "vid";
-			if(strm->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)        type = "aud";
-			if(strm->codecpar->codec_type == AVMEDIA_TYPE_SUBTITLE)     type = "sub";
-			if(strm->codecpar->codec_type == AVMEDIA_TYPE_ATTACHMENT)   type = "att";
+			if(strm->type == AVMEDIA_TYPE_VIDEO)        type = "vid";
+			if(strm->type == AVMEDIA_TYPE_AUDIO)        type = "aud";
+			if(strm->type == AVMEDIA_TYPE_SUBTITLE)     type = "sub";
+			if(strm->type == AVMEDIA_TYPE_ATTACHMENT)   type = "att";
 
 			if(!type.empty())
 				type = zpr::sprint("%s%s:%s ", COLOUR_GREY_BOLD, type, COLOUR_RESET);
 
 			util::info("%2d%s: %s%s%s%s%s", strm->index, lang.empty() ? "" : zpr::sprint(" (%s)", lang),
-				type, COLOUR_BLACK_BOLD, avcodec_get_name(strm->codecpar->codec_id), COLOUR_RESET,
-				strm->codecpar->codec_type == AVMEDIA_TYPE_ATTACHMENT
+				type, COLOUR_BLACK_BOLD, strm->codec, COLOUR_RESET,
+				strm->type == AVMEDIA_TYPE_ATTACHMENT
 					? filename.empty() ? "" : zpr::sprint(" - %s", filename)
 					: name.empty() ? "" : zpr::sprint(" - %s", name));
 		}
 		util::unindent_log();
 
-		// make the output file
-		assert(!config::getOutputFolder().empty());
-		auto outfile = std::fs::canonical(std::fs::path(config::getOutputFolder())) / inputfile.filename();
+		// make the output file (benchmarks without an output folder don't write one at all)
+		assert(!config::getOutputFolder().empty() || config::isBenchmarkingMux());
+		auto outfile = config::getOutputFolder().empty()
+			? inputfile.filename()
+			: std::fs::canonical(std::fs::path(config::getOutputFolder())) / inputfile.filename();
 
 		util::log("output: '%s'", outfile.string());
+		auto sourcefile = inputfile;
 		inputfile = outfile;
 
 
 		if(auto d = config::getSubtitleDelay(); d != 0)
 			util::log("subtitle delay: %.3f s", d);
 
-		// make the output file:
-		if(!config::isDryRun())
-		{
-			if(!writeOutput(outfile, ctx, ssctx, finalStreams, finalStreamMap, config::getSubtitleDelay()))
-				return false;
-		}
-
-
+		// with a dry run, we can stop here -- the stream tables might have come from the cache,
+		// in which case we never even opened the file.
+		if(config::isDryRun())
+			return true;
 
+		// make the output file:
+		if(!ctx && !(ctx = open_input(sourcefile)))
+			return false;
 
-		avformat_close_input(&ctx);
-		avformat_free_context(ctx);
+		if(haveSubsSource && !ssctx && !(ssctx = open_input(ss_filename)))
+			return false;
 
-		if(ssctx)
+		if(!matches_file_info(ctx, mainInfo) || (ssctx && !matches_file_info(ssctx, ssInfo)))
 		{
-			avformat_close_input(&ssctx);
-			avformat_free_context(ssctx);
+			error("streams in '%s' do not match the cached stream information", sourcefile.filename().string());
+			return false;
 		}
 
-		return true;
-	}
-}
-
-
-
-
-
-
-
-
-
-
-
-
-
+		std::vector<AVStream*> finalStreams;
+		std::unordered_map<AVStream*, size_t> finalStreamMap;
 
+		for(auto si : finalInfos)
+			finalStreams.push_back((si->source == 0 ? ctx : ssctx)->streams[si->index]);
 
+		for(size_t i = 0; i < finalStreams.size(); i++)
+			finalStreamMap[finalStreams[i]] = i;
 
+		// note: 'inputfile' stays the final name, which the tagger needs; the file itself is found
+		// with staging::resolve() until it is renamed.
+		return writeOutput(outfile, ctx, ssctx, finalStreams, finalStreamMap, config::getSubtitleDelay());
+	}
+}
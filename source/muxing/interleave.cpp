@@ -0,0 +1,174 @@
+// interleave.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <deque>
+
+#include "defs.h"
+
+extern "C" {
+	#include <libavformat/avformat.h>
+}
+
+// packets are put in dts order here, and handed to the muxer with av_write_frame. libavformat's own
+// interleaving (with max_interleave_delta = 0) waits until every stream has a packet queued, with no
+// limit -- so a sparse subtitle track, or a stream that starts late, could make it hold on to hundreds
+// of megabytes of audio and video. here, the queue is bounded in time and in bytes, and sparse streams
+// (subtitles) never hold the others back.
+namespace mux::interleave
+{
+	struct Stream
+	{
+		bool sparse = false;
+		AVRational timeBase;
+
+		// { packet, dts in AV_TIME_BASE units }
+		std::deque<std::pair<AVPacket*, int64_t>> queue;
+	};
+
+	struct Interleaver
+	{
+		AVFormatContext* outctx = 0;
+
+		int64_t maxDelta = 0;
+		uint64_t maxBytes = 0;
+
+		std::vector<Stream> streams;
+
+		// the number of non-sparse streams, and how many of them have something queued.
+		size_t denseStreams = 0;
+		size_t denseQueued = 0;
+
+		size_t queuedPackets = 0;
+		uint64_t queuedBytes = 0;
+		int64_t newestDts = INT64_MIN;
+
+		bool failed = false;
+		Stats stats;
+
+		verify::Tally* muxed = 0;
+		checkpoint::Tracker* tracker = 0;
+	};
+
+	static Stream* oldest(Interleaver* il)
+	{
+		Stream* ret = 0;
+		for(auto& s : il->streams)
+		{
+			if(!s.queue.empty() && (!ret || s.queue.front().second < ret->queue.front().second))
+				ret = &s;
+		}
+
+		return ret;
+	}
+
+	// writes out the oldest packets, for as long as that is safe (or needed).
+	static void release(Interleaver* il, bool flush)
+	{
+		while(il->queuedPackets > 0)
+		{
+			auto s = oldest(il);
+			auto [ pkt, dts ] = s->queue.front();
+
+			// every stream that matters has something queued, so nothing older can still arrive.
+			bool ready = flush || il->denseQueued == il->denseStreams;
+
+			if(!ready)
+			{
+				// a limit of 0 means no limit.
+				if(il->maxDelta > 0 && il->newestDts - dts > il->maxDelta)          il->stats.deltaFlushes += 1;
+				else if(il->maxBytes > 0 && il->queuedBytes > il->maxBytes)         il->stats.memoryFlushes += 1;
+				else                                                                break;
+			}
+
+			s->queue.pop_front();
+			if(s->queue.empty() && !s->sparse)
+				il->denseQueued -= 1;
+
+			il->queuedPackets -= 1;
+			il->queuedBytes -= pkt->size;
+			memory::charge(-static_cast<int64_t>(pkt->size + sizeof(AVPacket)));
+
+			checkpoint::fed(il->tracker, pkt);
+
+			// the muxer doesn't take the packet, so it's still all there afterwards.
+			if(!il->failed && av_write_frame(il->outctx, pkt) < 0)
+				il->failed = true;
+			else if(!il->failed && il->muxed)
+				verify::add(*il->muxed, pkt);
+
+			av_packet_free(&pkt);
+		}
+	}
+
+
+
+
+	Interleaver* create(AVFormatContext* outctx, double maxDeltaSecs, uint64_t maxBytes, verify::Tally* muxed,
+		checkpoint::Tracker* tracker)
+	{
+		auto il = new Interleaver();
+		il->outctx = outctx;
+		il->muxed = muxed;
+		il->tracker = tracker;
+		il->maxDelta = static_cast<int64_t>(maxDeltaSecs * AV_TIME_BASE);
+		il->maxBytes = maxBytes;
+
+		for(unsigned i = 0; i < outctx->nb_streams; i++)
+		{
+			auto type = outctx->streams[i]->codecpar->codec_type;
+
+			Stream s;
+			s.timeBase = outctx->streams[i]->time_base;
+
+			// attachments have no packets at all, so they can't be waited on either.
+			s.sparse = (type == AVMEDIA_TYPE_SUBTITLE || type == AVMEDIA_TYPE_ATTACHMENT);
+			if(!s.sparse)
+				il->denseStreams += 1;
+
+			il->streams.push_back(std::move(s));
+		}
+
+		return il;
+	}
+
+	bool write(Interleaver* il, AVPacket* pkt)
+	{
+		auto& s = il->streams[pkt->stream_index];
+		auto dts = av_rescale_q(pkt->dts, s.timeBase, AVRational { 1, AV_TIME_BASE });
+
+		auto copy = av_packet_alloc();
+		av_packet_move_ref(copy, pkt);
+
+		if(s.queue.empty() && !s.sparse)
+			il->denseQueued += 1;
+
+		s.queue.push_back({ copy, dts });
+
+		il->queuedPackets += 1;
+		il->queuedBytes += copy->size;
+		memory::charge(static_cast<int64_t>(copy->size + sizeof(AVPacket)));
+		il->newestDts = std::max(il->newestDts, dts);
+
+		il->stats.peakPackets = std::max(il->stats.peakPackets, il->queuedPackets);
+		il->stats.peakBytes = std::max(il->stats.peakBytes, il->queuedBytes);
+		il->stats.peakSpanNs = std::max(il->stats.peakSpanNs,
+			static_cast<uint64_t>(std::max(int64_t(0), il->newestDts - oldest(il)->queue.front().second))
+				* (1000 * 1000 * 1000 / AV_TIME_BASE));
+
+		release(il, /* flush: */ false);
+		return !il->failed;
+	}
+
+	bool finish(Interleaver* il, Stats* stats)
+	{
+		release(il, /* flush: */ true);
+
+		auto ok = !il->failed;
+		if(stats)
+			*stats = il->stats;
+
+		delete il;
+		return ok;
+	}
+}
@@ -2,401 +2,623 @@
 // Copyright (c) 2019, zhiayang
 // Licensed under the Apache License Version 2.0.
 
-#include <string>
-#include <vector>
-#include <unordered_map>
+#include <array>
+#include <mutex>
+
+#include "defs.h"
 
 namespace misc
 {
+	struct Language
+	{
+		std::string_view code;
+
+		// already lowercase, since they're only used to match against stream titles.
+		std::string_view names[4];
+	};
+
 	// from https://en.wikipedia.org/wiki/List_of_ISO_639-2_codes
 	// but only the "Living" languages. who tf gonna make subtitles in old english?
-	std::unordered_map<std::string, std::vector<std::string>> languageCodeMap = {
-		{ "aar", { "Afar" } },
-		{ "abk", { "Abkhazian" } },
-		{ "ace", { "Achinese" } },
-		{ "ach", { "Acoli" } },
-		{ "ada", { "Adangme" } },
-		{ "ady", { "Adyghe", "Adygei" } },
-		{ "afr", { "Afrikaans" } },
-		{ "ain", { "Ainu" } },
-		{ "aka", { "Akan" } },
-		{ "ale", { "Aleut" } },
-		{ "alt", { "Southern Altai" } },
-		{ "amh", { "Amharic" } },
-		{ "anp", { "Angika" } },
-		{ "ara", { "Arabic" } },
-		{ "arg", { "Aragonese" } },
-		{ "arm", { "Armenian" } },
-		{ "arn", { "Mapudungun", "Mapuche" } },
-		{ "arp", { "Arapaho" } },
-		{ "arw", { "Arawak" } },
-		{ "asm", { "Assamese" } },
-		{ "ast", { "Asturian", "Bable", "Leonese", "Asturleonese" } },
-		{ "ava", { "Avaric" } },
-		{ "awa", { "Awadhi" } },
-		{ "aym", { "Aymara" } },
-		{ "aze", { "Azerbaijani" } },
-		{ "bak", { "Bashkir" } },
-		{ "bal", { "Baluchi" } },
-		{ "bam", { "Bambara" } },
-		{ "ban", { "Balinese" } },
-		{ "baq", { "Basque" } },
-		{ "bas", { "Basa" } },
-		{ "bej", { "Beja", "Bedawiyet" } },
-		{ "bel", { "Belarusian" } },
-		{ "bem", { "Bemba" } },
-		{ "ben", { "Bengali" } },
-		{ "bho", { "Bhojpuri" } },
-		{ "bik", { "Bikol" } },
-		{ "bin", { "Bini", "Edo" } },
-		{ "bis", { "Bislama" } },
-		{ "bla", { "Siksika" } },
-		{ "bos", { "Bosnian" } },
-		{ "bra", { "Braj" } },
-		{ "bre", { "Breton" } },
-		{ "bua", { "Buriat" } },
-		{ "bug", { "Buginese" } },
-		{ "bul", { "Bulgarian" } },
-		{ "byn", { "Blin", "Bilin" } },
-		{ "cad", { "Caddo" } },
-		{ "car", { "Galibi Carib" } },
-		{ "cat", { "Catalan", "Valencian" } },
-		{ "ceb", { "Cebuano" } },
-		{ "ces", { "Czech" } },
-		{ "cha", { "Chamorro" } },
-		{ "che", { "Chechen" } },
-		{ "chk", { "Chuukese" } },
-		{ "chm", { "Mari" } },
-		{ "chn", { "Chinook jargon" } },
-		{ "cho", { "Choctaw" } },
-		{ "chp", { "Chipewyan", "Dene Suline" } },
-		{ "chr", { "Cherokee" } },
-		{ "chv", { "Chuvash" } },
-		{ "chy", { "Cheyenne" } },
-		{ "cnr", { "Montenegrin" } },
-		{ "cor", { "Cornish" } },
-		{ "cos", { "Corsican" } },
-		{ "cre", { "Cree" } },
-		{ "crh", { "Crimean Tatar", "Crimean Turkish" } },
-		{ "csb", { "Kashubian" } },
-		{ "cze", { "Czech" } },
-		{ "dak", { "Dakota" } },
-		{ "dan", { "Danish" } },
-		{ "dar", { "Dargwa" } },
-		{ "del", { "Delaware" } },
-		{ "den", { "Slave (Athapascan)" } },
-		{ "deu", { "German" } },
-		{ "dgr", { "Dogrib" } },
-		{ "din", { "Dinka" } },
-		{ "div", { "Divehi", "Dhivehi", "Maldivian" } },
-		{ "doi", { "Dogri" } },
-		{ "dsb", { "Lower Sorbian" } },
-		{ "dua", { "Duala" } },
-		{ "dyu", { "Dyula" } },
-		{ "dzo", { "Dzongkha" } },
-		{ "efi", { "Efik" } },
-		{ "eka", { "Ekajuk" } },
-		{ "eng", { "English" } },
-		{ "est", { "Estonian" } },
-		{ "eus", { "Basque" } },
-		{ "ewe", { "Ewe" } },
-		{ "ewo", { "Ewondo" } },
-		{ "fan", { "Fang" } },
-		{ "fao", { "Faroese" } },
-		{ "fat", { "Fanti" } },
-		{ "fij", { "Fijian" } },
-		{ "fil", { "Filipino", "Pilipino" } },
-		{ "fin", { "Finnish" } },
-		{ "fon", { "Fon" } },
-		{ "fra", { "French" } },
-		{ "fre", { "French" } },
-		{ "frr", { "Northern Frisian" } },
-		{ "frs", { "Eastern Frisian" } },
-		{ "fry", { "Western Frisian" } },
-		{ "ful", { "Fulah" } },
-		{ "fur", { "Friulian" } },
-		{ "gaa", { "Ga" } },
-		{ "gay", { "Gayo" } },
-		{ "gba", { "Gbaya" } },
-		{ "ger", { "German" } },
-		{ "gil", { "Gilbertese" } },
-		{ "gla", { "Gaelic", "Scottish Gaelic" } },
-		{ "gle", { "Irish" } },
-		{ "glg", { "Galician" } },
-		{ "glv", { "Manx" } },
-		{ "gon", { "Gondi" } },
-		{ "gor", { "Gorontalo" } },
-		{ "grb", { "Grebo" } },
-		{ "gre", { "Greek" } },
-		{ "ell", { "Greek" } },
-		{ "grn", { "Guarani" } },
-		{ "gsw", { "Swiss German", "Alemannic", "Alsatian" } },
-		{ "guj", { "Gujarati" } },
-		{ "gwi", { "Gwich'in" } },
-		{ "hai", { "Haida" } },
-		{ "hat", { "Haitian", "Haitian Creole" } },
-		{ "hau", { "Hausa" } },
-		{ "haw", { "Hawaiian" } },
-		{ "heb", { "Hebrew" } },
-		{ "her", { "Herero" } },
-		{ "hil", { "Hiligaynon" } },
-		{ "hin", { "Hindi" } },
-		{ "hmn", { "Hmong", "Mong" } },
-		{ "hmo", { "Hiri Motu" } },
-		{ "hrv", { "Croatian" } },
-		{ "hsb", { "Upper Sorbian" } },
-		{ "hun", { "Hungarian" } },
-		{ "hup", { "Hupa" } },
-		{ "hye", { "Armenian" } },
-		{ "iba", { "Iban" } },
-		{ "ibo", { "Igbo" } },
-		{ "iii", { "Sichuan Yi", "Nuosu" } },
-		{ "iku", { "Inuktitut" } },
-		{ "ilo", { "Iloko" } },
-		{ "ind", { "Indonesian" } },
-		{ "inh", { "Ingush" } },
-		{ "ipk", { "Inupiaq" } },
-		{ "isl", { "Icelandic" } },
-		{ "ice", { "Icelandic" } },
-		{ "ita", { "Italian" } },
-		{ "jav", { "Javanese" } },
-		{ "jpn", { "Japanese" } },
-		{ "jpr", { "Judeo-Persian" } },
-		{ "jrb", { "Judeo-Arabic" } },
-		{ "kaa", { "Kara-Kalpak" } },
-		{ "kab", { "Kabyle" } },
-		{ "kac", { "Kachin; Jingpho" } },
-		{ "kal", { "Kalaallisut", "Greenlandic" } },
-		{ "kam", { "Kamba" } },
-		{ "kan", { "Kannada" } },
-		{ "kas", { "Kashmiri" } },
-		{ "kat", { "Georgian" } },
-		{ "geo", { "Georgian" } },
-		{ "kau", { "Kanuri" } },
-		{ "kaz", { "Kazakh" } },
-		{ "kbd", { "Kabardian" } },
-		{ "kha", { "Khasi" } },
-		{ "khm", { "Central Khmer" } },
-		{ "kik", { "Kikuyu", "Gikuyu" } },
-		{ "kin", { "Kinyarwanda" } },
-		{ "kir", { "Kirghiz", "Kyrgyz" } },
-		{ "kmb", { "Kimbundu" } },
-		{ "kok", { "Konkani" } },
-		{ "kom", { "Komi" } },
-		{ "kon", { "Kongo" } },
-		{ "kor", { "Korean" } },
-		{ "kos", { "Kosraean" } },
-		{ "kpe", { "Kpelle" } },
-		{ "krc", { "Karachay-Balkar" } },
-		{ "krl", { "Karelian" } },
-		{ "kru", { "Kurukh" } },
-		{ "kua", { "Kuanyama", "Kwanyama" } },
-		{ "kum", { "Kumyk" } },
-		{ "kur", { "Kurdish" } },
-		{ "kut", { "Kutenai" } },
-		{ "lad", { "Ladino" } },
-		{ "lah", { "Lahnda" } },
-		{ "lam", { "Lamba" } },
-		{ "lao", { "Lao" } },
-		{ "lav", { "Latvian" } },
-		{ "lez", { "Lezghian" } },
-		{ "lim", { "Limburgan", "Limburger", "Limburgish" } },
-		{ "lin", { "Lingala" } },
-		{ "lit", { "Lithuanian" } },
-		{ "lol", { "Mongo" } },
-		{ "loz", { "Lozi" } },
-		{ "ltz", { "Luxembourgish", "Letzeburgesch" } },
-		{ "lua", { "Luba-Lulua" } },
-		{ "lub", { "Luba-Katanga" } },
-		{ "lug", { "Ganda" } },
-		{ "lun", { "Lunda" } },
-		{ "luo", { "Luo (Kenya and Tanzania)" } },
-		{ "lus", { "Lushai" } },
-		{ "mad", { "Madurese" } },
-		{ "mag", { "Magahi" } },
-		{ "mah", { "Marshallese" } },
-		{ "mai", { "Maithili" } },
-		{ "mak", { "Makasar" } },
-		{ "mal", { "Malayalam" } },
-		{ "man", { "Mandingo" } },
-		{ "mar", { "Marathi" } },
-		{ "mas", { "Masai" } },
-		{ "mdf", { "Moksha" } },
-		{ "mdr", { "Mandar" } },
-		{ "men", { "Mende" } },
-		{ "mic", { "Mi'kmaq", "Micmac" } },
-		{ "min", { "Minangkabau" } },
-		{ "mkd", { "Macedonian" } },
-		{ "mac", { "Macedonian" } },
-		{ "mlg", { "Malagasy" } },
-		{ "mlt", { "Maltese" } },
-		{ "mnc", { "Manchu" } },
-		{ "mni", { "Manipuri" } },
-		{ "moh", { "Mohawk" } },
-		{ "mon", { "Mongolian" } },
-		{ "mos", { "Mossi" } },
-		{ "mri", { "Maori" } },
-		{ "mao", { "Maori" } },
-		{ "msa", { "Malay" } },
-		{ "may", { "Malay" } },
-		{ "mus", { "Creek" } },
-		{ "mwl", { "Mirandese" } },
-		{ "mwr", { "Marwari" } },
-		{ "mya", { "Burmese" } },
-		{ "bur", { "Burmese" } },
-		{ "myv", { "Erzya" } },
-		{ "nap", { "Neapolitan" } },
-		{ "nau", { "Nauru" } },
-		{ "nav", { "Navajo", "Navaho" } },
-		{ "nbl", { "Ndebele", "South Ndebele" } },
-		{ "nde", { "Ndebele", "North Ndebele" } },
-		{ "ndo", { "Ndonga" } },
-		{ "nds", { "Low German", "Low Saxon", "German", "Saxon" } },
-		{ "nep", { "Nepali" } },
-		{ "new", { "Nepal Bhasa; Newari" } },
-		{ "nia", { "Nias" } },
-		{ "niu", { "Niuean" } },
-		{ "nld", { "Dutch", "Flemish" } },
-		{ "dut", { "Dutch", "Flemish" } },
-		{ "nno", { "Norwegian Nynorsk", "Nynorsk", "Norwegian" } },
-		{ "nob", { "Bokmål", "Norwegian", "Norwegian Bokmål" } },
-		{ "nog", { "Nogai" } },
-		{ "nor", { "Norwegian" } },
-		{ "nqo", { "N'Ko" } },
-		{ "nso", { "Pedi; Sepedi; Northern Sotho" } },
-		{ "nya", { "Chichewa", "Chewa", "Nyanja" } },
-		{ "nym", { "Nyamwezi" } },
-		{ "nyn", { "Nyankole" } },
-		{ "nyo", { "Nyoro" } },
-		{ "nzi", { "Nzima" } },
-		{ "oci", { "Occitan", "Provençal" } },
-		{ "oji", { "Ojibwa" } },
-		{ "ori", { "Oriya" } },
-		{ "orm", { "Oromo" } },
-		{ "osa", { "Osage" } },
-		{ "oss", { "Ossetian; Ossetic" } },
-		{ "pag", { "Pangasinan" } },
-		{ "pam", { "Pampanga; Kapampangan" } },
-		{ "pan", { "Panjabi; Punjabi" } },
-		{ "pap", { "Papiamento" } },
-		{ "pau", { "Palauan" } },
-		{ "per", { "Persian" } },
-		{ "fas", { "Persian" } },
-		{ "pol", { "Polish" } },
-		{ "pon", { "Pohnpeian" } },
-		{ "por", { "Portuguese" } },
-		{ "pus", { "Pushto; Pashto" } },
-		{ "que", { "Quechua" } },
-		{ "raj", { "Rajasthani" } },
-		{ "rap", { "Rapanui" } },
-		{ "rar", { "Rarotongan; Cook Islands Maori" } },
-		{ "roh", { "Romansh" } },
-		{ "rom", { "Romany" } },
-		{ "rum", { "Romanian", "Moldavian", "Moldovan"	} },
-		{ "ron", { "Romanian", "Moldavian", "Moldovan"	} },
-		{ "run", { "Rundi" } },
-		{ "rup", { "Aromanian", "Arumanian", "Macedo-Romanian" } },
-		{ "rus", { "Russian" } },
-		{ "sad", { "Sandawe" } },
-		{ "sag", { "Sango" } },
-		{ "sah", { "Yakut" } },
-		{ "sas", { "Sasak" } },
-		{ "sat", { "Santali" } },
-		{ "scn", { "Sicilian" } },
-		{ "sco", { "Scots" } },
-		{ "sel", { "Selkup" } },
-		{ "shn", { "Shan" } },
-		{ "sid", { "Sidamo" } },
-		{ "sin", { "Sinhala", "Sinhalese" } },
-		{ "slo", { "Slovak" } },
-		{ "slk", { "Slovak" } },
-		{ "slv", { "Slovenian" } },
-		{ "sma", { "Southern Sami" } },
-		{ "sme", { "Northern Sami" } },
-		{ "smj", { "Lule Sami" } },
-		{ "smn", { "Inari Sami" } },
-		{ "smo", { "Samoan" } },
-		{ "sms", { "Skolt Sami" } },
-		{ "sna", { "Shona" } },
-		{ "snd", { "Sindhi" } },
-		{ "snk", { "Soninke" } },
-		{ "som", { "Somali" } },
-		{ "sot", { "Sotho, Southern" } },
-		{ "spa", { "Spanish; Castilian" } },
-		{ "sqi", { "Albanian" } },
-		{ "alb", { "Albanian" } },
-		{ "srd", { "Sardinian" } },
-		{ "srn", { "Sranan Tongo" } },
-		{ "srp", { "Serbian" } },
-		{ "srr", { "Serer" } },
-		{ "ssw", { "Swati" } },
-		{ "suk", { "Sukuma" } },
-		{ "sun", { "Sundanese" } },
-		{ "sus", { "Susu" } },
-		{ "swa", { "Swahili" } },
-		{ "swe", { "Swedish" } },
-		{ "syr", { "Syriac" } },
-		{ "tah", { "Tahitian" } },
-		{ "tam", { "Tamil" } },
-		{ "tat", { "Tatar" } },
-		{ "tel", { "Telugu" } },
-		{ "tem", { "Timne" } },
-		{ "ter", { "Tereno" } },
-		{ "tet", { "Tetum" } },
-		{ "tgk", { "Tajik" } },
-		{ "tgl", { "Tagalog" } },
-		{ "tha", { "Thai" } },
-		{ "tib", { "Tibetan" } },
-		{ "bod", { "Tibetan" } },
-		{ "tig", { "Tigre" } },
-		{ "tir", { "Tigrinya" } },
-		{ "tiv", { "Tiv" } },
-		{ "tkl", { "Tokelau" } },
-		{ "tli", { "Tlingit" } },
-		{ "tmh", { "Tamashek" } },
-		{ "tog", { "Tonga (Nyasa)" } },
-		{ "ton", { "Tonga (Tonga Islands)" } },
-		{ "tpi", { "Tok Pisin" } },
-		{ "tsi", { "Tsimshian" } },
-		{ "tsn", { "Tswana" } },
-		{ "tso", { "Tsonga" } },
-		{ "tuk", { "Turkmen" } },
-		{ "tum", { "Tumbuka" } },
-		{ "tur", { "Turkish" } },
-		{ "tvl", { "Tuvalu" } },
-		{ "twi", { "Twi" } },
-		{ "tyv", { "Tuvinian" } },
-		{ "udm", { "Udmurt" } },
-		{ "uig", { "Uighur", "Uyghur" } },
-		{ "ukr", { "Ukrainian" } },
-		{ "umb", { "Umbundu" } },
-		{ "urd", { "Urdu" } },
-		{ "uzb", { "Uzbek" } },
-		{ "vai", { "Vai" } },
-		{ "ven", { "Venda" } },
-		{ "vie", { "Vietnamese" } },
-		{ "vot", { "Votic" } },
-		{ "wal", { "Wolaitta", "Wolaytta" } },
-		{ "war", { "Waray" } },
-		{ "was", { "Washo" } },
-		{ "wel", { "Welsh" } },
-		{ "cym", { "Welsh" } },
-		{ "wln", { "Walloon" } },
-		{ "wol", { "Wolof" } },
-		{ "xal", { "Kalmyk; Oirat" } },
-		{ "xho", { "Xhosa" } },
-		{ "yao", { "Yao" } },
-		{ "yap", { "Yapese" } },
-		{ "yid", { "Yiddish" } },
-		{ "yor", { "Yoruba" } },
-		{ "zap", { "Zapotec" } },
-		{ "zen", { "Zenaga" } },
-		{ "zgh", { "Standard Moroccan Tamazight" } },
-		{ "zha", { "Zhuang", "Chuang" } },
-		{ "zho", { "Chinese" } },
-		{ "chi", { "Chinese" } },
-		{ "zul", { "Zulu" } },
-		{ "zun", { "Zuni" } },
-		{ "zza", { "Zaza" } },
+	static constexpr Language languages[] = {
+		{ "aar", { "afar" } },
+		{ "abk", { "abkhazian" } },
+		{ "ace", { "achinese" } },
+		{ "ach", { "acoli" } },
+		{ "ada", { "adangme" } },
+		{ "ady", { "adyghe", "adygei" } },
+		{ "afr", { "afrikaans" } },
+		{ "ain", { "ainu" } },
+		{ "aka", { "akan" } },
+		{ "ale", { "aleut" } },
+		{ "alt", { "southern altai" } },
+		{ "amh", { "amharic" } },
+		{ "anp", { "angika" } },
+		{ "ara", { "arabic" } },
+		{ "arg", { "aragonese" } },
+		{ "arm", { "armenian" } },
+		{ "arn", { "mapudungun", "mapuche" } },
+		{ "arp", { "arapaho" } },
+		{ "arw", { "arawak" } },
+		{ "asm", { "assamese" } },
+		{ "ast", { "asturian", "bable", "leonese", "asturleonese" } },
+		{ "ava", { "avaric" } },
+		{ "awa", { "awadhi" } },
+		{ "aym", { "aymara" } },
+		{ "aze", { "azerbaijani" } },
+		{ "bak", { "bashkir" } },
+		{ "bal", { "baluchi" } },
+		{ "bam", { "bambara" } },
+		{ "ban", { "balinese" } },
+		{ "baq", { "basque" } },
+		{ "bas", { "basa" } },
+		{ "bej", { "beja", "bedawiyet" } },
+		{ "bel", { "belarusian" } },
+		{ "bem", { "bemba" } },
+		{ "ben", { "bengali" } },
+		{ "bho", { "bhojpuri" } },
+		{ "bik", { "bikol" } },
+		{ "bin", { "bini", "edo" } },
+		{ "bis", { "bislama" } },
+		{ "bla", { "siksika" } },
+		{ "bos", { "bosnian" } },
+		{ "bra", { "braj" } },
+		{ "bre", { "breton" } },
+		{ "bua", { "buriat" } },
+		{ "bug", { "buginese" } },
+		{ "bul", { "bulgarian" } },
+		{ "byn", { "blin", "bilin" } },
+		{ "cad", { "caddo" } },
+		{ "car", { "galibi carib" } },
+		{ "cat", { "catalan", "valencian" } },
+		{ "ceb", { "cebuano" } },
+		{ "ces", { "czech" } },
+		{ "cha", { "chamorro" } },
+		{ "che", { "chechen" } },
+		{ "chk", { "chuukese" } },
+		{ "chm", { "mari" } },
+		{ "chn", { "chinook jargon" } },
+		{ "cho", { "choctaw" } },
+		{ "chp", { "chipewyan", "dene suline" } },
+		{ "chr", { "cherokee" } },
+		{ "chv", { "chuvash" } },
+		{ "chy", { "cheyenne" } },
+		{ "cnr", { "montenegrin" } },
+		{ "cor", { "cornish" } },
+		{ "cos", { "corsican" } },
+		{ "cre", { "cree" } },
+		{ "crh", { "crimean tatar", "crimean turkish" } },
+		{ "csb", { "kashubian" } },
+		{ "cze", { "czech" } },
+		{ "dak", { "dakota" } },
+		{ "dan", { "danish" } },
+		{ "dar", { "dargwa" } },
+		{ "del", { "delaware" } },
+		{ "den", { "slave (athapascan)" } },
+		{ "deu", { "german" } },
+		{ "dgr", { "dogrib" } },
+		{ "din", { "dinka" } },
+		{ "div", { "divehi", "dhivehi", "maldivian" } },
+		{ "doi", { "dogri" } },
+		{ "dsb", { "lower sorbian" } },
+		{ "dua", { "duala" } },
+		{ "dyu", { "dyula" } },
+		{ "dzo", { "dzongkha" } },
+		{ "efi", { "efik" } },
+		{ "eka", { "ekajuk" } },
+		{ "eng", { "english" } },
+		{ "est", { "estonian" } },
+		{ "eus", { "basque" } },
+		{ "ewe", { "ewe" } },
+		{ "ewo", { "ewondo" } },
+		{ "fan", { "fang" } },
+		{ "fao", { "faroese" } },
+		{ "fat", { "fanti" } },
+		{ "fij", { "fijian" } },
+		{ "fil", { "filipino", "pilipino" } },
+		{ "fin", { "finnish" } },
+		{ "fon", { "fon" } },
+		{ "fra", { "french" } },
+		{ "fre", { "french" } },
+		{ "frr", { "northern frisian" } },
+		{ "frs", { "eastern frisian" } },
+		{ "fry", { "western frisian" } },
+		{ "ful", { "fulah" } },
+		{ "fur", { "friulian" } },
+		{ "gaa", { "ga" } },
+		{ "gay", { "gayo" } },
+		{ "gba", { "gbaya" } },
+		{ "ger", { "german" } },
+		{ "gil", { "gilbertese" } },
+		{ "gla", { "gaelic", "scottish gaelic" } },
+		{ "gle", { "irish" } },
+		{ "glg", { "galician" } },
+		{ "glv", { "manx" } },
+		{ "gon", { "gondi" } },
+		{ "gor", { "gorontalo" } },
+		{ "grb", { "grebo" } },
+		{ "gre", { "greek" } },
+		{ "ell", { "greek" } },
+		{ "grn", { "guarani" } },
+		{ "gsw", { "swiss german", "alemannic", "alsatian" } },
+		{ "guj", { "gujarati" } },
+		{ "gwi", { "gwich'in" } },
+		{ "hai", { "haida" } },
+		{ "hat", { "haitian", "haitian creole" } },
+		{ "hau", { "hausa" } },
+		{ "haw", { "hawaiian" } },
+		{ "heb", { "hebrew" } },
+		{ "her", { "herero" } },
+		{ "hil", { "hiligaynon" } },
+		{ "hin", { "hindi" } },
+		{ "hmn", { "hmong", "mong" } },
+		{ "hmo", { "hiri motu" } },
+		{ "hrv", { "croatian" } },
+		{ "hsb", { "upper sorbian" } },
+		{ "hun", { "hungarian" } },
+		{ "hup", { "hupa" } },
+		{ "hye", { "armenian" } },
+		{ "iba", { "iban" } },
+		{ "ibo", { "igbo" } },
+		{ "iii", { "sichuan yi", "nuosu" } },
+		{ "iku", { "inuktitut" } },
+		{ "ilo", { "iloko" } },
+		{ "ind", { "indonesian" } },
+		{ "inh", { "ingush" } },
+		{ "ipk", { "inupiaq" } },
+		{ "isl", { "icelandic" } },
+		{ "ice", { "icelandic" } },
+		{ "ita", { "italian" } },
+		{ "jav", { "javanese" } },
+		{ "jpn", { "japanese" } },
+		{ "jpr", { "judeo-persian" } },
+		{ "jrb", { "judeo-arabic" } },
+		{ "kaa", { "kara-kalpak" } },
+		{ "kab", { "kabyle" } },
+		{ "kac", { "kachin; jingpho" } },
+		{ "kal", { "kalaallisut", "greenlandic" } },
+		{ "kam", { "kamba" } },
+		{ "kan", { "kannada" } },
+		{ "kas", { "kashmiri" } },
+		{ "kat", { "georgian" } },
+		{ "geo", { "georgian" } },
+		{ "kau", { "kanuri" } },
+		{ "kaz", { "kazakh" } },
+		{ "kbd", { "kabardian" } },
+		{ "kha", { "khasi" } },
+		{ "khm", { "central khmer" } },
+		{ "kik", { "kikuyu", "gikuyu" } },
+		{ "kin", { "kinyarwanda" } },
+		{ "kir", { "kirghiz", "kyrgyz" } },
+		{ "kmb", { "kimbundu" } },
+		{ "kok", { "konkani" } },
+		{ "kom", { "komi" } },
+		{ "kon", { "kongo" } },
+		{ "kor", { "korean" } },
+		{ "kos", { "kosraean" } },
+		{ "kpe", { "kpelle" } },
+		{ "krc", { "karachay-balkar" } },
+		{ "krl", { "karelian" } },
+		{ "kru", { "kurukh" } },
+		{ "kua", { "kuanyama", "kwanyama" } },
+		{ "kum", { "kumyk" } },
+		{ "kur", { "kurdish" } },
+		{ "kut", { "kutenai" } },
+		{ "lad", { "ladino" } },
+		{ "lah", { "lahnda" } },
+		{ "lam", { "lamba" } },
+		{ "lao", { "lao" } },
+		{ "lav", { "latvian" } },
+		{ "lez", { "lezghian" } },
+		{ "lim", { "limburgan", "limburger", "limburgish" } },
+		{ "lin", { "lingala" } },
+		{ "lit", { "lithuanian" } },
+		{ "lol", { "mongo" } },
+		{ "loz", { "lozi" } },
+		{ "ltz", { "luxembourgish", "letzeburgesch" } },
+		{ "lua", { "luba-lulua" } },
+		{ "lub", { "luba-katanga" } },
+		{ "lug", { "ganda" } },
+		{ "lun", { "lunda" } },
+		{ "luo", { "luo (kenya and tanzania)" } },
+		{ "lus", { "lushai" } },
+		{ "mad", { "madurese" } },
+		{ "mag", { "magahi" } },
+		{ "mah", { "marshallese" } },
+		{ "mai", { "maithili" } },
+		{ "mak", { "makasar" } },
+		{ "mal", { "malayalam" } },
+		{ "man", { "mandingo" } },
+		{ "mar", { "marathi" } },
+		{ "mas", { "masai" } },
+		{ "mdf", { "moksha" } },
+		{ "mdr", { "mandar" } },
+		{ "men", { "mende" } },
+		{ "mic", { "mi'kmaq", "micmac" } },
+		{ "min", { "minangkabau" } },
+		{ "mkd", { "macedonian" } },
+		{ "mac", { "macedonian" } },
+		{ "mlg", { "malagasy" } },
+		{ "mlt", { "maltese" } },
+		{ "mnc", { "manchu" } },
+		{ "mni", { "manipuri" } },
+		{ "moh", { "mohawk" } },
+		{ "mon", { "mongolian" } },
+		{ "mos", { "mossi" } },
+		{ "mri", { "maori" } },
+		{ "mao", { "maori" } },
+		{ "msa", { "malay" } },
+		{ "may", { "malay" } },
+		{ "mus", { "creek" } },
+		{ "mwl", { "mirandese" } },
+		{ "mwr", { "marwari" } },
+		{ "mya", { "burmese" } },
+		{ "bur", { "burmese" } },
+		{ "myv", { "erzya" } },
+		{ "nap", { "neapolitan" } },
+		{ "nau", { "nauru" } },
+		{ "nav", { "navajo", "navaho" } },
+		{ "nbl", { "ndebele", "south ndebele" } },
+		{ "nde", { "ndebele", "north ndebele" } },
+		{ "ndo", { "ndonga" } },
+		{ "nds", { "low german", "low saxon", "german", "saxon" } },
+		{ "nep", { "nepali" } },
+		{ "new", { "nepal bhasa; newari" } },
+		{ "nia", { "nias" } },
+		{ "niu", { "niuean" } },
+		{ "nld", { "dutch", "flemish" } },
+		{ "dut", { "dutch", "flemish" } },
+		{ "nno", { "norwegian nynorsk", "nynorsk", "norwegian" } },
+		{ "nob", { "bokmål", "norwegian", "norwegian bokmål" } },
+		{ "nog", { "nogai" } },
+		{ "nor", { "norwegian" } },
+		{ "nqo", { "n'ko" } },
+		{ "nso", { "pedi; sepedi; northern sotho" } },
+		{ "nya", { "chichewa", "chewa", "nyanja" } },
+		{ "nym", { "nyamwezi" } },
+		{ "nyn", { "nyankole" } },
+		{ "nyo", { "nyoro" } },
+		{ "nzi", { "nzima" } },
+		{ "oci", { "occitan", "provençal" } },
+		{ "oji", { "ojibwa" } },
+		{ "ori", { "oriya" } },
+		{ "orm", { "oromo" } },
+		{ "osa", { "osage" } },
+		{ "oss", { "ossetian; ossetic" } },
+		{ "pag", { "pangasinan" } },
+		{ "pam", { "pampanga; kapampangan" } },
+		{ "pan", { "panjabi; punjabi" } },
+		{ "pap", { "papiamento" } },
+		{ "pau", { "palauan" } },
+		{ "per", { "persian" } },
+		{ "fas", { "persian" } },
+		{ "pol", { "polish" } },
+		{ "pon", { "pohnpeian" } },
+		{ "por", { "portuguese" } },
+		{ "pus", { "pushto; pashto" } },
+		{ "que", { "quechua" } },
+		{ "raj", { "rajasthani" } },
+		{ "rap", { "rapanui" } },
+		{ "rar", { "rarotongan; cook islands maori" } },
+		{ "roh", { "romansh" } },
+		{ "rom", { "romany" } },
+		{ "rum", { "romanian", "moldavian", "moldovan" } },
+		{ "ron", { "romanian", "moldavian", "moldovan" } },
+		{ "run", { "rundi" } },
+		{ "rup", { "aromanian", "arumanian", "macedo-romanian" } },
+		{ "rus", { "russian" } },
+		{ "sad", { "sandawe" } },
+		{ "sag", { "sango" } },
+		{ "sah", { "yakut" } },
+		{ "sas", { "sasak" } },
+		{ "sat", { "santali" } },
+		{ "scn", { "sicilian" } },
+		{ "sco", { "scots" } },
+		{ "sel", { "selkup" } },
+		{ "shn", { "shan" } },
+		{ "sid", { "sidamo" } },
+		{ "sin", { "sinhala", "sinhalese" } },
+		{ "slo", { "slovak" } },
+		{ "slk", { "slovak" } },
+		{ "slv", { "slovenian" } },
+		{ "sma", { "southern sami" } },
+		{ "sme", { "northern sami" } },
+		{ "smj", { "lule sami" } },
+		{ "smn", { "inari sami" } },
+		{ "smo", { "samoan" } },
+		{ "sms", { "skolt sami" } },
+		{ "sna", { "shona" } },
+		{ "snd", { "sindhi" } },
+		{ "snk", { "soninke" } },
+		{ "som", { "somali" } },
+		{ "sot", { "sotho, southern" } },
+		{ "spa", { "spanish; castilian" } },
+		{ "sqi", { "albanian" } },
+		{ "alb", { "albanian" } },
+		{ "srd", { "sardinian" } },
+		{ "srn", { "sranan tongo" } },
+		{ "srp", { "serbian" } },
+		{ "srr", { "serer" } },
+		{ "ssw", { "swati" } },
+		{ "suk", { "sukuma" } },
+		{ "sun", { "sundanese" } },
+		{ "sus", { "susu" } },
+		{ "swa", { "swahili" } },
+		{ "swe", { "swedish" } },
+		{ "syr", { "syriac" } },
+		{ "tah", { "tahitian" } },
+		{ "tam", { "tamil" } },
+		{ "tat", { "tatar" } },
+		{ "tel", { "telugu" } },
+		{ "tem", { "timne" } },
+		{ "ter", { "tereno" } },
+		{ "tet", { "tetum" } },
+		{ "tgk", { "tajik" } },
+		{ "tgl", { "tagalog" } },
+		{ "tha", { "thai" } },
+		{ "tib", { "tibetan" } },
+		{ "bod", { "tibetan" } },
+		{ "tig", { "tigre" } },
+		{ "tir", { "tigrinya" } },
+		{ "tiv", { "tiv" } },
+		{ "tkl", { "tokelau" } },
+		{ "tli", { "tlingit" } },
+		{ "tmh", { "tamashek" } },
+		{ "tog", { "tonga (nyasa)" } },
+		{ "ton", { "tonga (tonga islands)" } },
+		{ "tpi", { "tok pisin" } },
+		{ "tsi", { "tsimshian" } },
+		{ "tsn", { "tswana" } },
+		{ "tso", { "tsonga" } },
+		{ "tuk", { "turkmen" } },
+		{ "tum", { "tumbuka" } },
+		{ "tur", { "turkish" } },
+		{ "tvl", { "tuvalu" } },
+		{ "twi", { "twi" } },
+		{ "tyv", { "tuvinian" } },
+		{ "udm", { "udmurt" } },
+		{ "uig", { "uighur", "uyghur" } },
+		{ "ukr", { "ukrainian" } },
+		{ "umb", { "umbundu" } },
+		{ "urd", { "urdu" } },
+		{ "uzb", { "uzbek" } },
+		{ "vai", { "vai" } },
+		{ "ven", { "venda" } },
+		{ "vie", { "vietnamese" } },
+		{ "vot", { "votic" } },
+		{ "wal", { "wolaitta", "wolaytta" } },
+		{ "war", { "waray" } },
+		{ "was", { "washo" } },
+		{ "wel", { "welsh" } },
+		{ "cym", { "welsh" } },
+		{ "wln", { "walloon" } },
+		{ "wol", { "wolof" } },
+		{ "xal", { "kalmyk; oirat" } },
+		{ "xho", { "xhosa" } },
+		{ "yao", { "yao" } },
+		{ "yap", { "yapese" } },
+		{ "yid", { "yiddish" } },
+		{ "yor", { "yoruba" } },
+		{ "zap", { "zapotec" } },
+		{ "zen", { "zenaga" } },
+		{ "zgh", { "standard moroccan tamazight" } },
+		{ "zha", { "zhuang", "chuang" } },
+		{ "zho", { "chinese" } },
+		{ "chi", { "chinese" } },
+		{ "zul", { "zulu" } },
+		{ "zun", { "zuni" } },
+		{ "zza", { "zaza" } },
+	};
+
+	static constexpr size_t NUM_LANGUAGES   = sizeof(languages) / sizeof(languages[0]);
+	static constexpr size_t NUM_CODES       = 26 * 26 * 26;
+	static constexpr uint16_t NO_LANGUAGE   = 0xFFFF;
+
+	// every code is exactly three letters, so this is a perfect (if somewhat sparse) hash.
+	static constexpr int code_hash(std::string_view code)
+	{
+		if(code.size() != 3)
+			return -1;
+
+		int ret = 0;
+		for(char c : code)
+		{
+			if('A' <= c && c <= 'Z')
+				c = static_cast<char>(c - 'A' + 'a');
+
+			if(c < 'a' || c > 'z')
+				return -1;
+
+			ret = (ret * 26) + (c - 'a');
+		}
+
+		return ret;
+	}
+
+	static constexpr std::array<uint16_t, NUM_CODES> make_code_index()
+	{
+		std::array<uint16_t, NUM_CODES> ret = { };
+		for(size_t i = 0; i < NUM_CODES; i++)
+			ret[i] = NO_LANGUAGE;
+
+		for(size_t i = 0; i < NUM_LANGUAGES; i++)
+			ret[code_hash(languages[i].code)] = static_cast<uint16_t>(i);
+
+		return ret;
+	}
+
+	static constexpr auto codeIndex = make_code_index();
+
+	static constexpr bool codes_are_unique()
+	{
+		for(size_t i = 0; i < NUM_LANGUAGES; i++)
+		{
+			if(code_hash(languages[i].code) < 0 || codeIndex[code_hash(languages[i].code)] != i)
+				return false;
+		}
+
+		return true;
+	}
+
+	static_assert(NUM_LANGUAGES < NO_LANGUAGE);
+	static_assert(codes_are_unique(), "language codes must be unique 3-letter codes");
+
+	static const Language* find_language(std::string_view code)
+	{
+		if(auto h = code_hash(code); h >= 0 && codeIndex[h] != NO_LANGUAGE)
+			return &languages[codeIndex[h]];
+
+		return nullptr;
+	}
+
+
+
+
+	// an aho-corasick automaton over the names of every preferred language, so the title only needs
+	// to be scanned once. bytes that don't appear in any name all share class 0, which keeps the
+	// transition table small; uppercase letters get the same class as their lowercase forms.
+	struct LanguageMatcher
+	{
+		LanguageMatcher(const std::vector<std::string>& preferred) : langs(preferred)
+		{
+			for(const auto& lang : this->langs)
+			{
+				if(auto l = find_language(lang); l != nullptr)
+				{
+					for(auto name : l->names)
+					{
+						for(char c : name)
+						{
+							auto& cls = this->classes[static_cast<uint8_t>(c)];
+							if(cls == 0)
+								cls = static_cast<uint8_t>(++this->numClasses);
+						}
+					}
+				}
+			}
+
+			this->numClasses += 1;
+			for(int c = 'A'; c <= 'Z'; c++)
+				this->classes[c] = this->classes[c - 'A' + 'a'];
+
+			// build the trie; a node's priority is the index of the most preferred language ending there.
+			this->add_node();
+			for(size_t i = 0; i < this->langs.size(); i++)
+			{
+				auto l = find_language(this->langs[i]);
+				if(l == nullptr)
+					continue;
+
+				for(auto name : l->names)
+				{
+					if(name.empty())
+						continue;
+
+					int32_t node = 0;
+					for(char c : name)
+					{
+						auto edge = node * this->numClasses + this->classes[static_cast<uint8_t>(c)];
+						if(this->next[edge] < 0)
+						{
+							// careful: add_node() reallocates the table.
+							auto n = this->add_node();
+							this->next[edge] = n;
+						}
+
+						node = this->next[edge];
+					}
+
+					this->priority[node] = std::min(this->priority[node], static_cast<int32_t>(i));
+				}
+			}
+
+			// breadth-first, fill in the failure links and turn the trie into a full transition table.
+			std::vector<int32_t> queue;
+			for(size_t c = 0; c < this->numClasses; c++)
+			{
+				auto& n = this->next[c];
+				if(n < 0)   n = 0;
+				else        queue.push_back(n);
+			}
+
+			for(size_t i = 0; i < queue.size(); i++)
+			{
+				auto node = queue[i];
+				auto f = this->fail[node];
+
+				// a match ending at the failure node also ends here.
+				this->priority[node] = std::min(this->priority[node], this->priority[f]);
+
+				for(size_t c = 0; c < this->numClasses; c++)
+				{
+					auto n = this->next[node * this->numClasses + c];
+					if(n < 0)
+					{
+						this->next[node * this->numClasses + c] = this->next[f * this->numClasses + c];
+					}
+					else
+					{
+						this->fail[n] = this->next[f * this->numClasses + c];
+						queue.push_back(n);
+					}
+				}
+			}
+		}
+
+		std::string match(std::string_view title) const
+		{
+			int32_t node = 0;
+			int32_t best = INT32_MAX;
+
+			for(char c : title)
+			{
+				node = this->next[node * this->numClasses + this->classes[static_cast<uint8_t>(c)]];
+				best = std::min(best, this->priority[node]);
+
+				// can't do better than the first preference.
+				if(best == 0)
+					break;
+			}
+
+			return best == INT32_MAX ? "" : this->langs[best];
+		}
+
+	private:
+		int32_t add_node()
+		{
+			this->next.resize(this->next.size() + this->numClasses, -1);
+			this->fail.push_back(0);
+			this->priority.push_back(INT32_MAX);
+
+			return static_cast<int32_t>(this->fail.size() - 1);
+		}
+
+		std::vector<std::string> langs;
+
+		size_t numClasses = 0;
+		uint8_t classes[256] = { };
+
+		std::vector<int32_t> next;
+		std::vector<int32_t> fail;
+		std::vector<int32_t> priority;
 	};
+
+	std::string guessLanguageFromTitle(const std::vector<std::string>& preferredLangs, std::string_view title)
+	{
+		// there's only ever the audio and subtitle preferences, so just keep a matcher for each list.
+		static std::map<std::vector<std::string>, LanguageMatcher> matchers;
+		static std::mutex lock;
+
+		const LanguageMatcher* matcher = 0;
+		{
+			auto lk = std::unique_lock(lock);
+
+			auto it = matchers.find(preferredLangs);
+			if(it == matchers.end())
+				it = matchers.emplace(preferredLangs, LanguageMatcher(preferredLangs)).first;
+
+			matcher = &it->second;
+		}
+
+		return matcher->match(title);
+	}
 }
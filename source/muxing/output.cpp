@@ -0,0 +1,674 @@
+// output.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "defs.h"
+
+#include <mutex>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__linux__) && defined(HAVE_LIBURING)
+	#include <liburing.h>
+	#define USE_IO_URING 1
+#else
+	#define USE_IO_URING 0
+#endif
+
+extern "C" {
+	#include <libavformat/avformat.h>
+}
+
+// the muxer writes through a custom AVIOContext; filled buffers are handed off to either io_uring
+// or a writer thread, so the muxing thread only ever waits on storage when every buffer is in flight.
+namespace mux::output
+{
+	static constexpr size_t BUFFER_SIZE     = 1024 * 1024;
+	static constexpr size_t BUFFER_COUNT    = 8;
+	static constexpr size_t BUFFER_ALIGN    = 4096;
+	static constexpr int AVIO_BUFFER_SIZE   = 64 * 1024;
+
+	static uint64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	struct Buffer
+	{
+		uint8_t* data = 0;
+
+		size_t size = 0;
+		size_t done = 0;
+		int64_t offset = 0;
+
+		uint64_t submitted = 0;
+	};
+
+	struct Backend
+	{
+		virtual ~Backend() { }
+
+		virtual const char* name() = 0;
+
+		// returns false if the write could not even be queued.
+		virtual bool submit(Buffer* buf) = 0;
+
+		// collects completed buffers into 'done'; if 'wait' is set, blocks until at least one completes.
+		// returns false if any write failed.
+		virtual bool reap(std::vector<Buffer*>& done, bool wait) = 0;
+	};
+
+	struct ThreadBackend : Backend
+	{
+		ThreadBackend(int fd) : fd(fd)
+		{
+			this->worker = std::thread([this]() { this->run(); });
+		}
+
+		~ThreadBackend() override
+		{
+			{
+				auto lk = std::unique_lock(this->lock);
+				this->quit = true;
+			}
+
+			this->cv.notify_all();
+			this->worker.join();
+		}
+
+		const char* name() override { return "thread"; }
+
+		bool submit(Buffer* buf) override
+		{
+			{
+				auto lk = std::unique_lock(this->lock);
+				this->pending.push_back(buf);
+			}
+
+			this->cv.notify_all();
+			return true;
+		}
+
+		bool reap(std::vector<Buffer*>& done, bool wait) override
+		{
+			auto lk = std::unique_lock(this->lock);
+			if(wait)
+				this->cv.wait(lk, [this]() { return !this->completed.empty(); });
+
+			done.insert(done.end(), this->completed.begin(), this->completed.end());
+			this->completed.clear();
+
+			auto ok = !this->failed;
+			this->failed = false;
+
+			return ok;
+		}
+
+	private:
+		void run()
+		{
+			while(true)
+			{
+				Buffer* buf = 0;
+				{
+					auto lk = std::unique_lock(this->lock);
+					this->cv.wait(lk, [this]() { return this->quit || !this->pending.empty(); });
+
+					if(this->pending.empty())
+						return;
+
+					buf = this->pending.front();
+					this->pending.pop_front();
+				}
+
+				bool ok = true;
+				while(buf->done < buf->size)
+				{
+					auto n = pwrite(this->fd, buf->data + buf->done, buf->size - buf->done, buf->offset + buf->done);
+					if(n < 0 && errno == EINTR)
+						continue;
+
+					if(n <= 0)
+					{
+						ok = false;
+						break;
+					}
+
+					buf->done += n;
+				}
+
+				{
+					auto lk = std::unique_lock(this->lock);
+					this->completed.push_back(buf);
+					this->failed |= !ok;
+				}
+
+				this->cv.notify_all();
+			}
+		}
+
+		int fd = -1;
+		bool quit = false;
+		bool failed = false;
+
+		std::mutex lock;
+		std::condition_variable cv;
+
+		std::deque<Buffer*> pending;
+		std::vector<Buffer*> completed;
+
+		std::thread worker;
+	};
+
+	// for benchmarking the muxer without storage: every write completes immediately.
+	struct NullBackend : Backend
+	{
+		const char* name() override { return "null"; }
+
+		bool submit(Buffer* buf) override
+		{
+			buf->done = buf->size;
+			this->completed.push_back(buf);
+			return true;
+		}
+
+		bool reap(std::vector<Buffer*>& done, bool wait) override
+		{
+			done.insert(done.end(), this->completed.begin(), this->completed.end());
+			this->completed.clear();
+			return true;
+		}
+
+	private:
+		std::vector<Buffer*> completed;
+	};
+
+#if USE_IO_URING
+	struct UringBackend : Backend
+	{
+		UringBackend(int fd) : fd(fd) { }
+
+		~UringBackend() override
+		{
+			if(this->ok)
+				io_uring_queue_exit(&this->ring);
+		}
+
+		bool init()
+		{
+			this->ok = (io_uring_queue_init(BUFFER_COUNT, &this->ring, 0) == 0);
+			return this->ok;
+		}
+
+		const char* name() override { return "io_uring"; }
+
+		bool submit(Buffer* buf) override
+		{
+			auto sqe = io_uring_get_sqe(&this->ring);
+			if(!sqe)
+				return false;
+
+			io_uring_prep_write(sqe, this->fd, buf->data + buf->done, buf->size - buf->done, buf->offset + buf->done);
+			io_uring_sqe_set_data(sqe, buf);
+
+			return io_uring_submit(&this->ring) >= 0;
+		}
+
+		bool reap(std::vector<Buffer*>& done, bool wait) override
+		{
+			bool success = true;
+			while(true)
+			{
+				io_uring_cqe* cqe = 0;
+
+				int ret = wait ? io_uring_wait_cqe(&this->ring, &cqe) : io_uring_peek_cqe(&this->ring, &cqe);
+				if(ret == -EINTR)
+					continue;
+
+				// peeking with nothing ready is fine, but if waiting failed, nothing will ever come back.
+				if(ret < 0 || !cqe)
+				{
+					if(wait)
+						success = false;
+
+					break;
+				}
+
+				auto buf = static_cast<Buffer*>(io_uring_cqe_get_data(cqe));
+				auto res = cqe->res;
+				io_uring_cqe_seen(&this->ring, cqe);
+
+				if(res > 0)
+					buf->done += res;
+
+				// short writes just get resubmitted for the remainder.
+				if(res > 0 && buf->done < buf->size)
+				{
+					if(this->submit(buf))
+						continue;
+
+					success = false;
+					buf->done = buf->size;
+				}
+				else if(res <= 0)
+				{
+					success = false;
+					buf->done = buf->size;
+				}
+
+				done.push_back(buf);
+
+				// only block for the first one; pick up whatever else is ready without waiting.
+				wait = false;
+			}
+
+			return success;
+		}
+
+	private:
+		int fd = -1;
+		bool ok = false;
+		io_uring ring;
+	};
+#endif
+
+
+
+
+	struct Writer
+	{
+		int fd = -1;
+		AVIOContext* ctx = 0;
+		Backend* backend = 0;
+
+		std::vector<Buffer*> buffers;
+		std::vector<Buffer*> freeList;
+
+		Buffer* current = 0;
+		size_t inflight = 0;
+
+		// the muxer's view of the file: where the next byte goes, and how big the file is.
+		int64_t pos = 0;
+		int64_t size = 0;
+
+		bool failed = false;
+
+		// crc32c of bytes [0, size) as they will be on disk; off for the null output, or if a
+		// patched region couldn't be read back.
+		bool hashing = false;
+		uint32_t crc = 0;
+
+		checkpoint::Tracker* tracker = 0;
+
+		Stats stats;
+		size_t depthSamples = 0;
+		uint64_t totalLatency = 0;
+	};
+
+	static void collect(Writer* w, bool wait)
+	{
+		// once something failed, the output is lost anyway; don't wait on writes that might never finish.
+		std::vector<Buffer*> done;
+		if(!w->backend->reap(done, wait && !w->failed))
+			w->failed = true;
+
+		auto now = now_ns();
+		for(auto buf : done)
+		{
+			auto lat = now - buf->submitted;
+
+			w->totalLatency += lat;
+			w->stats.maxLatencyNs = std::max(w->stats.maxLatencyNs, lat);
+
+			w->inflight -= 1;
+			w->freeList.push_back(buf);
+		}
+	}
+
+	static void submit_current(Writer* w)
+	{
+		auto buf = w->current;
+		w->current = 0;
+
+		if(!buf)
+			return;
+
+		if(buf->size == 0)
+		{
+			w->freeList.push_back(buf);
+			return;
+		}
+
+		buf->done = 0;
+		buf->submitted = now_ns();
+
+		if(!w->backend->submit(buf))
+		{
+			w->failed = true;
+			w->freeList.push_back(buf);
+			return;
+		}
+
+		w->inflight += 1;
+
+		w->stats.writes += 1;
+		w->stats.bytes += buf->size;
+		w->stats.maxQueueDepth = std::max(w->stats.maxQueueDepth, w->inflight);
+		w->stats.avgQueueDepth += static_cast<double>(w->inflight);
+		w->depthSamples += 1;
+	}
+
+	static void drain(Writer* w)
+	{
+		submit_current(w);
+		while(w->inflight > 0 && !w->failed)
+			collect(w, /* wait: */ true);
+	}
+
+	static Buffer* acquire(Writer* w)
+	{
+		// opportunistically pick up finished writes, but only block if there's nothing free.
+		if(w->inflight > 0)
+			collect(w, /* wait: */ w->freeList.empty());
+
+		if(w->failed || w->freeList.empty())
+			return nullptr;
+
+		auto buf = w->freeList.back();
+		w->freeList.pop_back();
+
+		buf->size = 0;
+		buf->offset = w->pos;
+		return buf;
+	}
+
+	// the muxer only ever goes back to patch in sizes, the seek head and the duration, and by then those
+	// bytes are already on disk (seek() drains everything), so keeping the checksum of the final file
+	// only needs small reads of the bytes being replaced -- never the whole file.
+	static void checksum(Writer* w, const uint8_t* data, size_t len)
+	{
+		if(!w->hashing)
+			return;
+
+		uint8_t tmp[4096];
+
+		// seeking past the end leaves a hole of zeros.
+		if(w->pos > w->size)
+		{
+			memset(tmp, 0, sizeof(tmp));
+			for(auto gap = w->pos - w->size; gap > 0; )
+			{
+				auto n = std::min(static_cast<int64_t>(sizeof(tmp)), gap);
+				w->crc = verify::crc32c(w->crc, tmp, n);
+				gap -= n;
+			}
+		}
+
+		auto pos = w->pos;
+		while(len > 0 && pos < w->size)
+		{
+			auto n = std::min({ len, sizeof(tmp), static_cast<size_t>(w->size - pos) });
+			if(pread(w->fd, tmp, n, pos) != static_cast<ssize_t>(n))
+			{
+				w->hashing = false;
+				return;
+			}
+
+			w->crc = verify::crc32cPatch(w->crc, tmp, data, n, w->size - (pos + n));
+
+			pos += n;
+			data += n;
+			len -= n;
+		}
+
+		w->crc = verify::crc32c(w->crc, data, len);
+	}
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+	static int write_packet(void* opaque, const uint8_t* data, int len)
+#else
+	static int write_packet(void* opaque, uint8_t* data, int len)
+#endif
+	{
+		auto w = static_cast<Writer*>(opaque);
+		if(w->failed)
+			return AVERROR(EIO);
+
+		priority::throttle(len);
+		checksum(w, data, len);
+
+		// only what's appended is new; anything before the end is the muxer patching what it wrote already.
+		bool checkpointDue = false;
+		if(auto end = w->pos + len; w->tracker && end > w->size)
+		{
+			auto from = std::max(w->pos, w->size);
+			checkpointDue = checkpoint::scan(w->tracker, static_cast<uint64_t>(from), data + (from - w->pos),
+				static_cast<size_t>(end - from));
+		}
+
+		size_t remaining = len;
+		while(remaining > 0)
+		{
+			if(!w->current && !(w->current = acquire(w)))
+				return AVERROR(EIO);
+
+			auto buf = w->current;
+			auto n = std::min(remaining, BUFFER_SIZE - buf->size);
+
+			memcpy(buf->data + buf->size, data, n);
+
+			buf->size += n;
+			data += n;
+			remaining -= n;
+
+			w->pos += n;
+			w->size = std::max(w->size, w->pos);
+
+			if(buf->size == BUFFER_SIZE)
+				submit_current(w);
+		}
+
+		// the checkpoint can't say more than what's on disk.
+		if(checkpointDue)
+		{
+			drain(w);
+			if(!w->failed && fdatasync(w->fd) == 0)
+				checkpoint::save(w->tracker);
+		}
+
+		return len;
+	}
+
+	static int64_t seek(void* opaque, int64_t offset, int whence)
+	{
+		auto w = static_cast<Writer*>(opaque);
+
+		whence &= ~AVSEEK_FORCE;
+		if(whence == AVSEEK_SIZE)
+			return w->size;
+
+		int64_t target = 0;
+		if(whence == SEEK_SET)      target = offset;
+		else if(whence == SEEK_CUR) target = w->pos + offset;
+		else if(whence == SEEK_END) target = w->size + offset;
+		else                        return AVERROR(EINVAL);
+
+		if(target < 0)
+			return AVERROR(EINVAL);
+
+		if(target == w->pos)
+			return target;
+
+		// seeks only happen when the muxer back-patches the header and cues, so it's not worth
+		// being clever -- wait for everything in flight, so overlapping writes can't be reordered.
+		drain(w);
+		if(w->failed)
+			return AVERROR(EIO);
+
+		w->pos = target;
+
+		return target;
+	}
+
+
+
+
+	static Writer* make_writer(int fd, Backend* backend)
+	{
+		auto w = new Writer();
+		w->fd = fd;
+		w->backend = backend;
+		w->stats.backend = backend->name();
+		w->hashing = (fd >= 0);
+
+		for(size_t i = 0; i < BUFFER_COUNT; i++)
+		{
+			void* mem = 0;
+			if(posix_memalign(&mem, BUFFER_ALIGN, BUFFER_SIZE) != 0)
+				break;
+
+			auto buf = new Buffer();
+			buf->data = static_cast<uint8_t*>(mem);
+
+			w->buffers.push_back(buf);
+			w->freeList.push_back(buf);
+		}
+
+		auto avbuf = static_cast<uint8_t*>(av_malloc(AVIO_BUFFER_SIZE));
+		if(w->buffers.empty() || !avbuf)
+		{
+			av_free(avbuf);
+			close(w);
+			return nullptr;
+		}
+
+		w->ctx = avio_alloc_context(avbuf, AVIO_BUFFER_SIZE, /* write: */ 1, w, nullptr, &write_packet, &seek);
+		return w;
+	}
+
+	static Backend* make_backend(int fd)
+	{
+	#if USE_IO_URING
+		if(auto ur = new UringBackend(fd); ur->init())  return ur;
+		else                                            delete ur;
+	#endif
+
+		return new ThreadBackend(fd);
+	}
+
+	Writer* open(const std::fs::path& path, uint64_t sizeHint, checkpoint::Tracker* tracker)
+	{
+		// read access is only for the checksum, see checksum().
+		int fd = ::open(path.string().c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if(fd < 0)
+			return nullptr;
+
+		auto w = make_writer(fd, make_backend(fd));
+		if(w)
+			w->tracker = tracker;
+
+	#if defined(__linux__)
+		// KEEP_SIZE, so the file still only appears as big as what was written; close() gives back
+		// whatever was allocated past the end. not every filesystem can do this, which is fine.
+		if(w && sizeHint > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(sizeHint)) == 0)
+			w->stats.preallocated = sizeHint;
+	#endif
+
+		return w;
+	}
+
+	Writer* reopen(const std::fs::path& path, uint64_t length, checkpoint::Tracker* tracker)
+	{
+		int fd = ::open(path.string().c_str(), O_RDWR | O_CLOEXEC);
+		if(fd < 0)
+			return nullptr;
+
+		if(ftruncate(fd, static_cast<off_t>(length)) != 0)
+		{
+			::close(fd);
+			return nullptr;
+		}
+
+		auto w = make_writer(fd, make_backend(fd));
+		if(!w)
+			return nullptr;
+
+		w->size = static_cast<int64_t>(length);
+		w->hashing = false;
+		w->tracker = tracker;
+
+		return w;
+	}
+
+	Writer* openNull()
+	{
+		return make_writer(-1, new NullBackend());
+	}
+
+	AVIOContext* getContext(Writer* w)
+	{
+		return w->ctx;
+	}
+
+	Stats getStats(Writer* w)
+	{
+		auto ret = w->stats;
+		if(w->depthSamples > 0)
+			ret.avgQueueDepth /= static_cast<double>(w->depthSamples);
+
+		if(ret.writes > 0)
+			ret.avgLatencyNs = w->totalLatency / ret.writes;
+
+		ret.checksummed = w->hashing && !w->failed;
+		ret.checksum = w->crc;
+
+		return ret;
+	}
+
+	bool close(Writer* w, Stats* stats)
+	{
+		if(w->ctx)
+		{
+			avio_flush(w->ctx);
+
+			av_freep(&w->ctx->buffer);
+			avio_context_free(&w->ctx);
+		}
+
+		drain(w);
+		delete w->backend;
+
+		// drop the preallocated blocks that weren't needed.
+		if(w->stats.preallocated > static_cast<uint64_t>(w->size) && ftruncate(w->fd, w->size) != 0)
+			w->failed = true;
+
+		// the file should be exactly as long as everything the muxer wrote.
+		if(struct stat st; w->fd >= 0 && (fstat(w->fd, &st) != 0 || st.st_size != w->size))
+			w->failed = true;
+
+		if(stats)
+			*stats = getStats(w);
+
+		for(auto buf : w->buffers)
+		{
+			free(buf->data);
+			delete buf;
+		}
+
+		if(w->fd >= 0 && ::close(w->fd) != 0)
+			w->failed = true;
+
+		auto ok = !w->failed;
+		delete w;
+
+		return ok;
+	}
+}
@@ -0,0 +1,217 @@
+// verify.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include "defs.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+	#include <nmmintrin.h>
+	#define HAVE_SSE42_CRC 1
+#else
+	#define HAVE_SSE42_CRC 0
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+	#include <arm_acle.h>
+	#define HAVE_ARM_CRC 1
+#else
+	#define HAVE_ARM_CRC 0
+#endif
+
+extern "C" {
+	#include <libavformat/avformat.h>
+}
+
+// crc32c (castagnoli) of everything that goes through the muxer, so a remux can be checked without
+// reading the output back. the output file is hashed as it is written (see output.cpp), and the packets
+// going into the interleaver are tallied against the ones the muxer took from it.
+namespace mux::verify
+{
+	// reversed castagnoli polynomial.
+	static constexpr uint32_t POLY = 0x82f63b78;
+
+	struct Tables
+	{
+		uint32_t bytes[256];
+
+		// x^(2^n) mod p, for shifting a crc past n zero bits.
+		uint32_t x2n[32];
+	};
+
+	static uint32_t multmodp(uint32_t a, uint32_t b)
+	{
+		uint32_t m = 1u << 31;
+		uint32_t p = 0;
+
+		while(true)
+		{
+			if(a & m)
+			{
+				p ^= b;
+				if((a & (m - 1)) == 0)
+					break;
+			}
+
+			m >>= 1;
+			b = (b & 1) ? (b >> 1) ^ POLY : b >> 1;
+		}
+
+		return p;
+	}
+
+	static const Tables& tables()
+	{
+		static Tables t = []() -> Tables {
+			Tables t;
+			for(uint32_t i = 0; i < 256; i++)
+			{
+				uint32_t c = i;
+				for(int k = 0; k < 8; k++)
+					c = (c & 1) ? (c >> 1) ^ POLY : c >> 1;
+
+				t.bytes[i] = c;
+			}
+
+			t.x2n[0] = 1u << 30;
+			for(int i = 1; i < 32; i++)
+				t.x2n[i] = multmodp(t.x2n[i - 1], t.x2n[i - 1]);
+
+			return t;
+		}();
+
+		return t;
+	}
+
+	// x^(8 * len) mod p
+	static uint32_t x8nmodp(uint64_t len)
+	{
+		auto& t = tables();
+
+		uint32_t p = 1u << 31;
+		for(int k = 3; len > 0; len >>= 1, k++)
+		{
+			if(len & 1)
+				p = multmodp(t.x2n[k & 31], p);
+		}
+
+		return p;
+	}
+
+	// these work on the raw register, without the inversions before and after.
+	static uint32_t update_table(uint32_t crc, const uint8_t* data, size_t len)
+	{
+		auto& t = tables();
+		for(size_t i = 0; i < len; i++)
+			crc = t.bytes[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+		return crc;
+	}
+
+#if HAVE_SSE42_CRC
+	__attribute__((target("sse4.2")))
+	static uint32_t update_sse42(uint32_t crc, const uint8_t* data, size_t len)
+	{
+		uint64_t c = crc;
+		for(; len >= 8; data += 8, len -= 8)
+		{
+			uint64_t x; memcpy(&x, data, 8);
+			c = _mm_crc32_u64(c, x);
+		}
+
+		auto c32 = static_cast<uint32_t>(c);
+		for(; len > 0; data++, len--)
+			c32 = _mm_crc32_u8(c32, *data);
+
+		return c32;
+	}
+#endif
+
+#if HAVE_ARM_CRC
+	static uint32_t update_arm(uint32_t crc, const uint8_t* data, size_t len)
+	{
+		for(; len >= 8; data += 8, len -= 8)
+		{
+			uint64_t x; memcpy(&x, data, 8);
+			crc = __crc32cd(crc, x);
+		}
+
+		for(; len > 0; data++, len--)
+			crc = __crc32cb(crc, *data);
+
+		return crc;
+	}
+#endif
+
+	static uint32_t update(uint32_t crc, const uint8_t* data, size_t len)
+	{
+	#if HAVE_SSE42_CRC
+		static const bool sse42 = __builtin_cpu_supports("sse4.2");
+		if(sse42)
+			return update_sse42(crc, data, len);
+	#elif HAVE_ARM_CRC
+		return update_arm(crc, data, len);
+	#endif
+
+		return update_table(crc, data, len);
+	}
+
+
+
+
+	uint32_t crc32c(uint32_t crc, const void* data, size_t len)
+	{
+		return ~update(~crc, static_cast<const uint8_t*>(data), len);
+	}
+
+	uint32_t crc32cPatch(uint32_t crc, const void* before, const void* after, size_t len, uint64_t following)
+	{
+		// the crc is linear: the crc of the patched message differs from the old one by the (raw) crc of
+		// old ^ new, followed by the bytes that come after it -- which only shift it along.
+		auto a = static_cast<const uint8_t*>(before);
+		auto b = static_cast<const uint8_t*>(after);
+
+		uint32_t diff = 0;
+		uint8_t tmp[256];
+
+		for(size_t i = 0; i < len; i += sizeof(tmp))
+		{
+			auto n = std::min(sizeof(tmp), len - i);
+			for(size_t k = 0; k < n; k++)
+				tmp[k] = a[i + k] ^ b[i + k];
+
+			diff = update(diff, tmp, n);
+		}
+
+		return crc ^ multmodp(x8nmodp(following), diff);
+	}
+
+	void add(Tally& tally, const AVPacket* pkt)
+	{
+		if(static_cast<size_t>(pkt->stream_index) >= tally.size())
+			tally.resize(pkt->stream_index + 1);
+
+		auto& s = tally[pkt->stream_index];
+		s.packets += 1;
+		s.bytes += pkt->size;
+		s.crc = crc32c(s.crc, pkt->data, pkt->size);
+	}
+
+	bool compare(const Tally& in, const Tally& out)
+	{
+		bool ok = true;
+		for(size_t i = 0; i < std::max(in.size(), out.size()); i++)
+		{
+			auto a = i < in.size() ? in[i] : StreamTally();
+			auto b = i < out.size() ? out[i] : StreamTally();
+
+			if(a.packets != b.packets || a.bytes != b.bytes || a.crc != b.crc)
+			{
+				util::error("stream %d: read %d packets (%d bytes, crc %08x), but muxed %d (%d bytes, crc %08x)",
+					i, a.packets, a.bytes, a.crc, b.packets, b.bytes, b.crc);
+				ok = false;
+			}
+		}
+
+		return ok;
+	}
+}
@@ -0,0 +1,67 @@
+// pagecache.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "defs.h"
+
+// hints for the page cache: start reading the next file before we need it, and don't let finished
+// (multi-gigabyte) files push everything else out of the cache.
+namespace pagecache
+{
+	// enough to cover opening the file and the first few seconds of muxing; the readahead that the
+	// kernel does by itself takes over from there.
+	static constexpr off_t PREFETCH_HEAD = 32 * 1024 * 1024;
+
+	// libavformat reads the cues (and the tags, for mkvmerge files) from the end of the file on open.
+	static constexpr off_t PREFETCH_TAIL = 1024 * 1024;
+
+	// posix_fadvise isn't everywhere (eg. macos), and it's only ever a hint anyway.
+	static void advise(const std::fs::path& path, bool willNeed, off_t head, off_t tail)
+	{
+	#if defined(POSIX_FADV_WILLNEED)
+		int advice = willNeed ? POSIX_FADV_WILLNEED : POSIX_FADV_DONTNEED;
+
+		int fd = ::open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0)
+			return;
+
+		struct stat st;
+		if(fstat(fd, &st) == 0)
+		{
+			if(head <= 0 || st.st_size <= head + tail)
+			{
+				posix_fadvise(fd, 0, 0, advice);
+			}
+			else
+			{
+				posix_fadvise(fd, 0, head, advice);
+				posix_fadvise(fd, st.st_size - tail, tail, advice);
+			}
+		}
+
+		::close(fd);
+	#endif
+	}
+
+
+
+
+	void prefetch(const std::fs::path& path)
+	{
+		// this only starts the reads; it doesn't wait for them.
+		advise(path, /* willNeed: */ true, PREFETCH_HEAD, PREFETCH_TAIL);
+	}
+
+	void drop(const std::fs::path& path)
+	{
+		if(!config::shouldDropPageCache())
+			return;
+
+		// this only drops clean pages, so outputs must be synced first (see staging::commit).
+		advise(path, /* willNeed: */ false, 0, 0);
+	}
+}
@@ -0,0 +1,113 @@
+// priority.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <mutex>
+#include <chrono>
+#include <thread>
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#if defined(__linux__)
+	#include <sys/syscall.h>
+#endif
+
+#include "defs.h"
+
+// '--background' and '--max-rate', for running alongside things that matter more (eg. a media server
+// that is streaming from the same disks).
+namespace priority
+{
+#if defined(__linux__) && defined(SYS_ioprio_set)
+	// from linux/ioprio.h, which glibc doesn't wrap.
+	static constexpr int IOPRIO_WHO_PROCESS = 1;
+	static constexpr int IOPRIO_CLASS_IDLE = 3;
+	static constexpr int IOPRIO_CLASS_SHIFT = 13;
+
+	static bool set_idle_io()
+	{
+		// pid 0 is the calling thread; threads (and processes) started after this inherit it.
+		return syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) == 0;
+	}
+#else
+	static bool set_idle_io()
+	{
+		return false;
+	}
+#endif
+
+	static bool set_idle_cpu()
+	{
+	#if defined(SCHED_IDLE)
+		struct sched_param param = { };
+		if(sched_setscheduler(0, SCHED_IDLE, &param) == 0)
+			return true;
+	#endif
+
+		// without SCHED_IDLE, the lowest nice value is the next best thing.
+		return setpriority(PRIO_PROCESS, 0, 19) == 0;
+	}
+
+
+	// a token bucket shared by every job, refilled at '--max-rate' bytes per second. a caller that
+	// takes more than there is goes into debt, and sleeps until it would have been paid back.
+	static std::mutex lock;
+	static double tokens = 0;
+	static std::chrono::steady_clock::time_point lastRefill;
+	static bool started = false;
+
+	// lets short bursts (eg. the muxer writing a cluster) through without sleeping for each one.
+	static constexpr double BURST_SECONDS = 0.25;
+
+
+
+
+	void enterBackground()
+	{
+		if(!config::isBackgroundMode())
+			return;
+
+		// this has to happen before any threads are started, so they (and the mkvtoolnix programs
+		// we run) inherit it.
+		bool io = set_idle_io();
+		bool cpu = set_idle_cpu();
+
+		if(io && cpu)   util::log("running in the background (idle cpu and io priority)");
+		else if(cpu)    util::warn("warn: could not lower io priority; only running at idle cpu priority");
+		else if(io)     util::warn("warn: could not lower cpu priority; only running at idle io priority");
+		else            util::warn("warn: could not lower cpu or io priority");
+	}
+
+	void throttle(uint64_t bytes)
+	{
+		auto rate = static_cast<double>(config::getMaxRate());
+		if(rate <= 0 || bytes == 0)
+			return;
+
+		double wait = 0;
+		{
+			auto lk = std::unique_lock(lock);
+			auto now = std::chrono::steady_clock::now();
+
+			if(!started)
+			{
+				tokens = rate * BURST_SECONDS;
+				lastRefill = now;
+				started = true;
+			}
+
+			tokens += std::chrono::duration<double>(now - lastRefill).count() * rate;
+			tokens = std::min(tokens, rate * BURST_SECONDS);
+			lastRefill = now;
+
+			tokens -= static_cast<double>(bytes);
+			if(tokens < 0)
+				wait = -tokens / rate;
+		}
+
+		if(wait > 0)
+			std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+	}
+}
@@ -0,0 +1,253 @@
+// progress.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+
+#include "defs.h"
+
+// muxing threads only bump atomic counters; a separate thread redraws the progress lines at a fixed
+// rate, so the cost of formatting and terminal output doesn't scale with the packet rate.
+namespace progress
+{
+	static constexpr auto TICK_INTERVAL = std::chrono::milliseconds(100);
+
+	// smoothing for the rates, per tick.
+	static constexpr double RATE_ALPHA = 0.3;
+
+	struct Job
+	{
+		std::string name;
+		int indent = 0;
+
+		uint64_t totalBytes = 0;
+		uint64_t durationNs = 0;
+
+		// how far into the inputs we are; not what was written, since streams that were left out still
+		// have to be read through.
+		std::atomic<uint64_t> bytes = 0;
+		std::atomic<uint64_t> packets = 0;
+		std::atomic<uint64_t> timeNs = 0;
+
+		// only touched by the renderer.
+		uint64_t lastBytes = 0;
+		uint64_t lastPackets = 0;
+		bool sampled = false;
+		double byteRate = 0;
+		double packetRate = 0;
+	};
+
+	static std::mutex lock;
+	static std::condition_variable cv;
+	static std::thread renderer;
+
+	// bumped whenever the renderer is told to stop, so a renderer that is still on its way out
+	// can't be confused with one started after it.
+	static uint64_t generation = 0;
+	static std::chrono::steady_clock::time_point lastTick;
+
+	static std::vector<Job*> active;
+	static std::vector<Job*> finished;
+
+	// how many lines the last redraw left on screen, that the next one should overwrite. only touched
+	// with the console locked, since anything else printed in between means they're not there anymore.
+	static size_t linesOnScreen = 0;
+
+	// once more than one job is running, lines are labelled until everything finishes.
+	static bool showNames = false;
+
+	static std::string format_rate(double x, const char* unit)
+	{
+		if(x >= 1024.0 * 1024.0)    return zpr::sprint("%.1f M%s/s", x / (1024.0 * 1024.0), unit);
+		else if(x >= 1024.0)        return zpr::sprint("%.1f K%s/s", x / 1024.0, unit);
+		else                        return zpr::sprint("%.0f %s/s", x, unit);
+	}
+
+	static std::string render_line(Job* job, double seconds, bool showName)
+	{
+		auto bytes = job->bytes.load(std::memory_order_relaxed);
+		auto packets = job->packets.load(std::memory_order_relaxed);
+
+		if(seconds > 0)
+		{
+			auto br = (bytes - job->lastBytes) / seconds;
+			auto pr = (packets - job->lastPackets) / seconds;
+
+			// start from the first sample instead of ramping up from zero.
+			if(!job->sampled)
+			{
+				job->byteRate = br;
+				job->packetRate = pr;
+			}
+			else
+			{
+				job->byteRate = (RATE_ALPHA * br) + ((1 - RATE_ALPHA) * job->byteRate);
+				job->packetRate = (RATE_ALPHA * pr) + ((1 - RATE_ALPHA) * job->packetRate);
+			}
+		}
+
+		job->sampled |= (seconds > 0);
+		job->lastBytes = bytes;
+		job->lastPackets = packets;
+
+		auto time = util::uglyPrintTime(job->timeNs.load(std::memory_order_relaxed), /* ms: */ false);
+		if(job->durationNs > 0)
+			time += zpr::sprint(" / %s", util::uglyPrintTime(job->durationNs, /* ms: */ false));
+
+		std::string eta;
+		if(job->totalBytes > bytes && job->byteRate > 0)
+		{
+			auto secs = static_cast<double>(job->totalBytes - bytes) / job->byteRate;
+			eta = zpr::sprint(", eta %s", util::uglyPrintTime(static_cast<uint64_t>(secs * 1'000'000'000.0), /* ms: */ false));
+		}
+
+		return zpr::sprint("\x1b[2K\r%s %s*%s %stime: %s %s(%s, %s%s)%s", std::string(2 * job->indent, ' '),
+			COLOUR_MAGENTA_BOLD, COLOUR_RESET, showName ? zpr::sprint("%s: ", job->name) : "", time, COLOUR_GREY_BOLD,
+			format_rate(job->byteRate, "B"), format_rate(job->packetRate, "pkt"), eta, COLOUR_RESET);
+	}
+
+	// must be called with the lock held.
+	static void redraw()
+	{
+		auto now = std::chrono::steady_clock::now();
+		auto seconds = std::chrono::duration<double>(now - lastTick).count();
+		lastTick = now;
+
+		// jobs that finished since the last tick get drawn one last time at the top, and then
+		// they stay there -- the next redraw starts below them.
+		std::vector<std::string> lines;
+		for(auto job : finished)
+			lines.push_back(render_line(job, seconds, showNames));
+
+		for(auto job : active)
+			lines.push_back(render_line(job, seconds, showNames));
+
+		auto out = util::join(lines, "\n");
+
+		if(!finished.empty())
+		{
+			for(auto job : finished)
+				delete job;
+
+			finished.clear();
+
+			// if nothing else is running, leave the cursor on a fresh line for whatever comes next.
+			if(active.empty())
+				out += "\n";
+		}
+
+		auto console = util::lock_console();
+
+		// go back to the first line of the previous redraw; the cursor is left on the last one.
+		if(linesOnScreen > 1)
+			out = zpr::sprint("\x1b[%dA", linesOnScreen - 1) + out;
+
+		linesOnScreen = active.size();
+
+		fprintf(stderr, "%s", out.c_str());
+		fflush(stderr);
+	}
+
+	static void run(uint64_t gen)
+	{
+		auto lk = std::unique_lock(lock);
+		while(true)
+		{
+			if(cv.wait_for(lk, TICK_INTERVAL, [gen]() { return gen != generation; }))
+				return;
+
+			redraw();
+		}
+	}
+
+
+
+
+	void clear()
+	{
+		if(linesOnScreen == 0)
+			return;
+
+		// erase from the last line up, and leave the cursor at the start of the first.
+		std::string out = "\r\x1b[2K";
+		for(size_t i = 1; i < linesOnScreen; i++)
+			out += "\x1b[1A\x1b[2K";
+
+		linesOnScreen = 0;
+
+		fprintf(stderr, "%s", out.c_str());
+		fflush(stderr);
+	}
+
+	Job* begin(const std::string& name, uint64_t totalBytes, uint64_t doneBytes, uint64_t durationNs)
+	{
+		if(config::disableProgress())
+			return nullptr;
+
+		auto job = new Job();
+		job->name = name;
+		job->indent = util::get_log_indent();
+		job->totalBytes = totalBytes;
+		job->durationNs = durationNs;
+		job->bytes = doneBytes;
+		job->lastBytes = doneBytes;
+
+		auto lk = std::unique_lock(lock);
+		active.push_back(job);
+
+		if(active.size() > 1)
+			showNames = true;
+
+		if(!renderer.joinable())
+		{
+			showNames = false;
+			lastTick = std::chrono::steady_clock::now();
+			renderer = std::thread(run, generation);
+		}
+
+		return job;
+	}
+
+	void update(Job* job, uint64_t position, uint64_t packets, uint64_t timeNs)
+	{
+		if(!job)
+			return;
+
+		job->bytes.store(position, std::memory_order_relaxed);
+		job->packets.fetch_add(packets, std::memory_order_relaxed);
+
+		if(timeNs > job->timeNs.load(std::memory_order_relaxed))
+			job->timeNs.store(timeNs, std::memory_order_relaxed);
+	}
+
+	void end(Job* job)
+	{
+		if(!job)
+			return;
+
+		std::thread stopped;
+		{
+			auto lk = std::unique_lock(lock);
+			active.erase(std::find(active.begin(), active.end(), job));
+			finished.push_back(job);
+
+			// draw the final state now, so it's on screen before anything else gets printed.
+			redraw();
+
+			if(active.empty())
+			{
+				generation += 1;
+				stopped = std::move(renderer);
+			}
+		}
+
+		cv.notify_all();
+
+		if(stopped.joinable())
+			stopped.join();
+	}
+}
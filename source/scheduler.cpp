@@ -0,0 +1,366 @@
+// scheduler.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <set>
+#include <list>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+	#include <sys/ioctl.h>
+	#include <linux/fs.h>
+	#include <linux/fiemap.h>
+#endif
+
+#include "defs.h"
+
+// up to '--jobs' files are processed at once, but only '--jobs-per-device' of them may use the same
+// block device (for reading the input or writing the output) -- several sequential streams on one hdd
+// are slower than one, but jobs on different disks can all run at full speed.
+namespace driver
+{
+	static std::atomic<bool> stopping = false;
+
+	struct Job
+	{
+		std::fs::path path;
+		std::vector<dev_t> devices;
+		bool prefetched = false;
+
+		// for '--order'; UINT64_MAX when we couldn't find out.
+		uint64_t size = 0;
+		uint64_t physical = UINT64_MAX;
+
+		// for '--max-memory'.
+		uint64_t memory = 0;
+		memory::Account* account = 0;
+	};
+
+	struct Running
+	{
+		Job job;
+		std::thread thread;
+
+		bool finished = false;
+		bool ok = false;
+	};
+
+	static bool get_device(const std::fs::path& path, dev_t* dev)
+	{
+		struct stat st;
+		if(stat(path.string().c_str(), &st) != 0)
+			return false;
+
+		*dev = st.st_dev;
+		return true;
+	}
+
+	// the physical offset of the start of the file on its device, from the first extent. this is
+	// only a guess at where the rest of it is, but large files are mostly contiguous anyway.
+	static uint64_t get_physical_offset(const std::fs::path& path)
+	{
+	#if defined(__linux__) && defined(FS_IOC_FIEMAP)
+		int fd = ::open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0)
+			return UINT64_MAX;
+
+		defer(::close(fd));
+
+		// room for exactly one extent.
+		alignas(struct fiemap) uint8_t buf[sizeof(struct fiemap) + sizeof(struct fiemap_extent)] = { };
+		auto fm = reinterpret_cast<struct fiemap*>(buf);
+
+		fm->fm_start = 0;
+		fm->fm_length = FIEMAP_MAX_OFFSET;
+		fm->fm_extent_count = 1;
+
+		// filesystems without extents (eg. tmpfs, most network ones) just fail this.
+		if(ioctl(fd, FS_IOC_FIEMAP, fm) != 0 || fm->fm_mapped_extents == 0)
+			return UINT64_MAX;
+
+		// inline or delayed-allocation extents don't have a real location yet.
+		auto& ext = fm->fm_extents[0];
+		if(ext.fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_DATA_INLINE))
+			return UINT64_MAX;
+
+		return ext.fe_physical;
+	#else
+		(void) path;
+		return UINT64_MAX;
+	#endif
+	}
+
+	// the scheduler picks from the front of the queue first, so this is the order files are started in
+	// (within the limits of '--jobs-per-device').
+	static void order_jobs(std::deque<Job>& queue, const std::string& order)
+	{
+		if(order == "physical")
+		{
+			size_t unknown = 0;
+			for(auto& job : queue)
+			{
+				job.physical = get_physical_offset(job.path);
+				unknown += (job.physical == UINT64_MAX);
+			}
+
+			// offsets on different devices can't be compared, so keep each device's files together.
+			// files we couldn't locate go last, in the order they were given.
+			std::stable_sort(queue.begin(), queue.end(), [](const Job& a, const Job& b) -> bool {
+				bool ua = (a.physical == UINT64_MAX);
+				bool ub = (b.physical == UINT64_MAX);
+
+				if(ua || ub)
+					return !ua && ub;
+
+				auto da = a.devices.empty() ? 0 : a.devices[0];
+				auto db = b.devices.empty() ? 0 : b.devices[0];
+
+				return std::tie(da, a.physical) < std::tie(db, b.physical);
+			});
+
+			if(unknown > 0)
+			{
+				util::warn("could not find the on-disk location of %d %s; %s will be processed last", unknown,
+					util::plural("file", unknown), unknown == 1 ? "it" : "they");
+			}
+		}
+		else if(order == "size" || order == "size-desc")
+		{
+			for(auto& job : queue)
+			{
+				std::error_code ec;
+				job.size = std::fs::file_size(job.path, ec);
+
+				if(ec)
+					job.size = UINT64_MAX;
+			}
+
+			bool desc = (order == "size-desc");
+			std::stable_sort(queue.begin(), queue.end(), [desc](const Job& a, const Job& b) -> bool {
+				return desc ? a.size > b.size : a.size < b.size;
+			});
+		}
+	}
+
+	// the first job that fits under every device's limit (and the memory budget), preferring ones whose
+	// devices are the least busy -- so an idle disk gets work before a busy one gets more.
+	static std::deque<Job>::iterator pick(std::deque<Job>& queue, std::map<dev_t, size_t>& busy, size_t perDevice,
+		bool* heldForMemory = nullptr)
+	{
+		auto best = queue.end();
+		size_t bestLoad = SIZE_MAX;
+
+		for(auto it = queue.begin(); it != queue.end() && bestLoad > 0; ++it)
+		{
+			size_t load = 0;
+			bool fits = true;
+
+			for(auto d : it->devices)
+			{
+				load += busy[d];
+				fits &= (perDevice == 0 || busy[d] < perDevice);
+			}
+
+			if(!fits || load >= bestLoad)
+				continue;
+
+			// a smaller file further back might still fit, so keep looking.
+			if(!memory::fits(it->memory))
+			{
+				if(heldForMemory)
+					*heldForMemory = true;
+
+				continue;
+			}
+
+			best = it, bestLoad = load;
+		}
+
+		return best;
+	}
+
+
+
+
+	size_t processFiles(const std::vector<std::fs::path>& paths)
+	{
+		auto maxJobs = std::max(size_t(1), config::getJobCount());
+		auto perDevice = config::getJobsPerDevice();
+
+		// every muxing job writes to the output folder, so that's one of its devices too.
+		dev_t outputDevice = 0;
+		bool haveOutputDevice = config::isMuxing() && !config::getOutputFolder().empty()
+			&& get_device(config::getOutputFolder(), &outputDevice);
+
+		std::deque<Job> queue;
+		for(const auto& path : paths)
+		{
+			Job job;
+			job.path = path;
+
+			if(dev_t dev; get_device(path, &dev))
+				job.devices.push_back(dev);
+
+			if(haveOutputDevice && !util::contains(job.devices, outputDevice))
+				job.devices.push_back(outputDevice);
+
+			job.memory = memory::estimate(path);
+
+			queue.push_back(std::move(job));
+		}
+
+		order_jobs(queue, config::getFileOrder());
+
+		if(maxJobs > 1)
+		{
+			std::set<dev_t> devices;
+			for(const auto& job : queue)
+				devices.insert(job.devices.begin(), job.devices.end());
+
+			util::info("running %d %s at once (%s per device, %d %s%s)", maxJobs, util::plural("job", maxJobs),
+				perDevice == 0 ? "no limit" : std::to_string(perDevice), devices.size(),
+				util::plural("device", devices.size()), config::getMemoryBudget() == 0 ? ""
+					: zpr::sprint(", %.1f MB of memory", config::getMemoryBudget() / (1024.0 * 1024.0)));
+		}
+
+		std::mutex lock;
+		std::condition_variable cv;
+
+		std::map<dev_t, size_t> busy;
+		std::list<Running> running;
+
+		size_t doneFiles = 0;
+
+		auto finish = [&](const Job& job, bool ok) {
+			for(auto d : job.devices)
+				busy[d] -= 1;
+
+			// so the next estimate can be checked against what jobs really use.
+			if(auto peak = memory::release(job.account); config::getMemoryBudget() > 0 && peak > job.memory)
+			{
+				util::log("'%s' used %.1f MB, more than the %.1f MB expected", job.path.filename().string(),
+					peak / (1024.0 * 1024.0), job.memory / (1024.0 * 1024.0));
+			}
+
+			pagecache::drop(job.path);
+			if(ok) doneFiles += 1;
+
+			staging::commit(/* force: */ false);
+			stats::writeMetrics(/* force: */ false);
+		};
+
+		bool warnedMemory = false;
+		while((!queue.empty() && !stopping) || !running.empty())
+		{
+			while(running.size() < maxJobs && !stopping)
+			{
+				bool heldForMemory = false;
+				auto it = pick(queue, busy, perDevice, &heldForMemory);
+
+				if(it == queue.end())
+				{
+					if(heldForMemory && !warnedMemory)
+					{
+						util::info("only running %d %s for now, to stay under the memory limit (%.1f MB in use)", running.size(),
+							util::plural("job", running.size()), memory::inUse() / (1024.0 * 1024.0));
+						warnedMemory = true;
+					}
+
+					break;
+				}
+
+				auto job = std::move(*it);
+				queue.erase(it);
+
+				for(auto d : job.devices)
+					busy[d] += 1;
+
+				job.account = memory::reserve(job.memory);
+
+				// so the next file's first reads don't have to wait for the disk.
+				if(auto next = pick(queue, busy, perDevice); next != queue.end() && !next->prefetched)
+				{
+					pagecache::prefetch(next->path);
+					next->prefetched = true;
+				}
+
+				// with one job, just do it here; this keeps the console (and prompts) on the main thread.
+				if(maxJobs == 1)
+				{
+					memory::attach(job.account);
+					auto ok = processOneFile(job.path);
+					memory::attach(nullptr);
+
+					finish(job, ok);
+					continue;
+				}
+
+				auto& r = running.emplace_back();
+				r.job = std::move(job);
+				r.thread = std::thread([&r, &lock, &cv]() {
+					memory::attach(r.job.account);
+					auto ok = processOneFile(r.job.path);
+
+					auto lk = std::unique_lock(lock);
+					r.finished = true;
+					r.ok = ok;
+
+					cv.notify_all();
+				});
+			}
+
+			if(running.empty())
+				continue;
+
+			{
+				auto lk = std::unique_lock(lock);
+				cv.wait(lk, [&running]() {
+					return std::any_of(running.begin(), running.end(), [](const Running& r) { return r.finished; });
+				});
+			}
+
+			for(auto it = running.begin(); it != running.end(); )
+			{
+				bool done = false;
+				{
+					auto lk = std::unique_lock(lock);
+					done = it->finished;
+				}
+
+				if(!done)
+				{
+					++it;
+					continue;
+				}
+
+				it->thread.join();
+				finish(it->job, it->ok);
+
+				it = running.erase(it);
+			}
+		}
+
+		if(stopping && !queue.empty())
+			util::warn("stopped with %d %s not processed", queue.size(), util::plural("file", queue.size()));
+
+		return doneFiles;
+	}
+
+	void stop()
+	{
+		stopping = true;
+	}
+
+	bool isStopping()
+	{
+		return stopping;
+	}
+}
@@ -0,0 +1,224 @@
+// staging.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <set>
+#include <mutex>
+#include <chrono>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "defs.h"
+
+// outputs are written under a hidden temporary name in the same folder, and only renamed to their real
+// name once their contents are on disk -- so a crash never leaves a truncated .mkv that looks finished.
+// instead of an fsync per file, the data is flushed with one syncfs() per folder every few files.
+namespace staging
+{
+	struct Pending
+	{
+		std::fs::path temp;
+		std::fs::path final;
+
+		// the job that made it might still be working on it (eg. tagging); it can only be
+		// renamed once that's done.
+		std::thread::id owner;
+		bool released = false;
+	};
+
+	static std::mutex lock;
+	static std::vector<Pending> pending;
+	static bool registered = false;
+
+	// this can run while other jobs are still going (eg. --stop-on-error exits from one of them), so
+	// like any commit, it only touches files whose jobs are done with them.
+	static void commit_at_exit()
+	{
+		commit(/* force: */ true);
+	}
+
+	static bool sync_folder(const std::fs::path& folder, bool data)
+	{
+		int fd = ::open(folder.string().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if(fd < 0)
+			return false;
+
+	#if defined(__linux__)
+		// one syncfs writes back every file in the batch (they're all on this filesystem).
+		bool ok = (data ? syncfs(fd) : fsync(fd)) == 0;
+	#else
+		bool ok = fsync(fd) == 0;
+	#endif
+
+		::close(fd);
+		return ok;
+	}
+
+#if !defined(__linux__)
+	static bool sync_file(const std::fs::path& path)
+	{
+		int fd = ::open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0)
+			return false;
+
+		bool ok = fsync(fd) == 0;
+		::close(fd);
+
+		return ok;
+	}
+#endif
+
+
+
+
+	std::fs::path tempPath(const std::fs::path& final)
+	{
+		// hidden, and without the .mkv extension, so media scanners leave it alone.
+		return final.parent_path() / zpr::sprint(".%s.partial", final.filename().string());
+	}
+
+	void add(const std::fs::path& temp, const std::fs::path& final)
+	{
+		auto lk = std::unique_lock(lock);
+		if(!registered)
+		{
+			// so files that were finished still get their names if we exit early (eg. --stop-on-error).
+			std::atexit(&commit_at_exit);
+			registered = true;
+		}
+
+		pending.push_back({ temp, final, std::this_thread::get_id() });
+	}
+
+	void release()
+	{
+		auto lk = std::unique_lock(lock);
+		for(auto& p : pending)
+		{
+			if(p.owner == std::this_thread::get_id())
+				p.released = true;
+		}
+	}
+
+	void discard(const std::fs::path& temp)
+	{
+		std::error_code ec;
+		std::fs::remove(temp, ec);
+	}
+
+	std::fs::path resolve(const std::fs::path& path)
+	{
+		auto lk = std::unique_lock(lock);
+		for(auto& p : pending)
+		{
+			if(p.final == path)
+				return p.temp;
+		}
+
+		return path;
+	}
+
+	bool rename(const std::fs::path& from, const std::fs::path& to)
+	{
+		{
+			auto lk = std::unique_lock(lock);
+			for(auto& p : pending)
+			{
+				if(p.final == from)
+				{
+					p.final = to;
+					return true;
+				}
+			}
+		}
+
+		std::error_code ec;
+		std::fs::rename(from, to, ec);
+
+		return !ec;
+	}
+
+	bool commit(bool force)
+	{
+		// take the batch out of the list, so other jobs aren't held up while it syncs.
+		std::vector<Pending> batch;
+		{
+			auto lk = std::unique_lock(lock);
+
+			auto ready = std::count_if(pending.begin(), pending.end(), [](const Pending& p) -> bool {
+				return p.released;
+			});
+
+			auto size = config::getSyncBatchSize();
+			if(ready == 0 || (!force && (size == 0 || static_cast<size_t>(ready) < size)))
+				return true;
+
+			auto it = std::stable_partition(pending.begin(), pending.end(), [](const Pending& p) -> bool {
+				return !p.released;
+			});
+
+			batch.assign(std::make_move_iterator(it), std::make_move_iterator(pending.end()));
+			pending.erase(it, pending.end());
+		}
+
+		trace::begin("commit", "driver", { { "files", std::to_string(batch.size()) } });
+		defer(trace::end());
+
+		auto start = std::chrono::steady_clock::now();
+
+		std::set<std::fs::path> folders;
+		for(auto& p : batch)
+			folders.insert(p.temp.parent_path());
+
+		bool ok = true;
+
+	#if defined(__linux__)
+		for(auto& f : folders)
+			ok &= sync_folder(f, /* data: */ true);
+	#else
+		for(auto& p : batch)
+			ok &= sync_file(p.temp);
+	#endif
+
+		// if the data might not be on disk, leave the files where they are; a truncated file
+		// with a temporary name is better than one with a real name.
+		if(!ok)
+		{
+			util::error("failed to sync %d %s; leaving them as '.partial'", batch.size(),
+				util::plural("output", batch.size()));
+
+			return false;
+		}
+
+		for(auto& p : batch)
+		{
+			std::error_code ec;
+			std::fs::rename(p.temp, p.final, ec);
+
+			if(ec)
+			{
+				util::error("failed to rename '%s' to '%s': %s", p.temp.filename().string(),
+					p.final.filename().string(), ec.message());
+				ok = false;
+			}
+			else
+			{
+				journal::committed(p.temp, p.final);
+			}
+
+			// now that it's on disk, it doesn't need to stay in memory.
+			pagecache::drop(ec ? p.temp : p.final);
+		}
+
+		// and make the renames themselves stick.
+		for(auto& f : folders)
+			ok &= sync_folder(f, /* data: */ false);
+
+		auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		util::log("synced %d %s in %.1f ms", batch.size(), util::plural("output", batch.size()), ms);
+
+		return ok;
+	}
+}
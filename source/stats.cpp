@@ -0,0 +1,615 @@
+// stats.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <mutex>
+#include <chrono>
+#include <fstream>
+
+#include "defs.h"
+
+#include "picojson.h"
+namespace pj = picojson;
+
+namespace stats
+{
+	static constexpr size_t NUM_STAGES = static_cast<size_t>(Stage::Count);
+
+	static constexpr const char* STAGE_NAMES[NUM_STAGES] = {
+		"parse", "http", "probe", "remux", "xml", "subprocess", "copy", "rename"
+	};
+
+	struct StageStats
+	{
+		size_t count = 0;
+		uint64_t totalNs = 0;
+	};
+
+	struct FileStats
+	{
+		std::string name;
+		bool ok = false;
+
+		uint64_t startNs = 0;
+		uint64_t wallNs = 0;
+
+		uint64_t bytesRead = 0;
+		uint64_t bytesWritten = 0;
+		uint64_t remuxBytes = 0;
+		uint64_t packets = 0;
+		uint64_t interleavePeak = 0;
+		uint64_t httpBytes = 0;
+
+		// only set when muxing; the checksum is empty if the output wasn't hashed.
+		bool verified = false;
+		std::string checksum;
+		uint64_t cacheHits = 0;
+		uint64_t cacheMisses = 0;
+
+		StageStats stages[NUM_STAGES];
+	};
+
+	static std::mutex lock;
+
+	// every finished file, and every individual stage timing (for the percentiles).
+	static std::vector<FileStats> files;
+	static std::vector<uint64_t> samples[NUM_STAGES];
+
+	static thread_local FileStats* current = 0;
+
+	// for the prometheus metrics; these aren't tied to a particular file.
+	static size_t skippedFiles = 0;
+	static std::vector<double> remuxRates;
+	static std::map<std::string, std::vector<uint64_t>> subprocessTimes;
+	static std::map<std::pair<std::string, std::string>, std::vector<uint64_t>> httpTimes;
+	static std::map<std::tuple<std::string, std::string, long>, uint64_t> httpResponses;
+
+	static uint64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	const char* stageName(Stage stage)
+	{
+		return STAGE_NAMES[static_cast<size_t>(stage)];
+	}
+
+	static std::string format_ns(uint64_t ns)
+	{
+		if(ns >= 1'000'000'000)     return zpr::sprint("%.2f s", ns / 1'000'000'000.0);
+		else if(ns >= 1'000'000)    return zpr::sprint("%.1f ms", ns / 1'000'000.0);
+		else                        return zpr::sprint("%.1f us", ns / 1'000.0);
+	}
+
+	static std::string format_bytes(uint64_t n)
+	{
+		if(n >= 1024 * 1024 * 1024)     return zpr::sprint("%.2f GB", n / (1024.0 * 1024.0 * 1024.0));
+		else if(n >= 1024 * 1024)       return zpr::sprint("%.1f MB", n / (1024.0 * 1024.0));
+		else if(n >= 1024)              return zpr::sprint("%.1f KB", n / 1024.0);
+		else                            return zpr::sprint("%d B", n);
+	}
+
+	// nearest-rank; 'xs' must be sorted.
+	static uint64_t percentile(const std::vector<uint64_t>& xs, double p)
+	{
+		if(xs.empty())
+			return 0;
+
+		auto rank = static_cast<size_t>(std::ceil(p / 100.0 * xs.size()));
+		return xs[std::clamp(rank, size_t(1), xs.size()) - 1];
+	}
+
+	static bool enabled()
+	{
+		return config::shouldShowStats() || !config::getStatsJsonPath().empty();
+	}
+
+
+
+
+	Scope::Scope(Stage stage, const trace::Args& args) : stage(stage), start(now_ns())
+	{
+		trace::begin(STAGE_NAMES[static_cast<size_t>(stage)], "stage", args);
+	}
+
+	uint64_t Scope::elapsed() const
+	{
+		return now_ns() - this->start;
+	}
+
+	Scope::~Scope()
+	{
+		auto dur = now_ns() - this->start;
+		auto idx = static_cast<size_t>(this->stage);
+
+		trace::end();
+
+		if(current)
+		{
+			current->stages[idx].count += 1;
+			current->stages[idx].totalNs += dur;
+		}
+
+		auto lk = std::unique_lock(lock);
+		samples[idx].push_back(dur);
+	}
+
+	void beginFile(const std::string& name)
+	{
+		current = new FileStats();
+		current->name = name;
+		current->startNs = now_ns();
+	}
+
+	void endFile(bool ok)
+	{
+		if(!current)
+			return;
+
+		auto fs = current;
+		current = 0;
+
+		fs->ok = ok;
+		fs->wallNs = now_ns() - fs->startNs;
+
+		if(config::shouldShowStats())
+		{
+			std::vector<std::string> stages;
+			for(size_t i = 0; i < NUM_STAGES; i++)
+			{
+				if(fs->stages[i].count > 0)
+					stages.push_back(zpr::sprint("%s %s", STAGE_NAMES[i], format_ns(fs->stages[i].totalNs)));
+			}
+
+			util::info("stats: %s total (%s)", format_ns(fs->wallNs), util::join(stages, ", "));
+			util::indent_log();
+			util::info("%s read, %s written, %d packets (%s peak interleave buffer)", format_bytes(fs->bytesRead),
+				format_bytes(fs->bytesWritten), fs->packets, format_bytes(fs->interleavePeak));
+			util::info("%d http %s (%s), %d cache %s, %d %s", fs->stages[static_cast<size_t>(Stage::Http)].count,
+				util::plural("request", fs->stages[static_cast<size_t>(Stage::Http)].count), format_bytes(fs->httpBytes),
+				fs->cacheHits, util::plural("hit", fs->cacheHits), fs->cacheMisses, (fs->cacheMisses == 1 ? "miss" : "misses"));
+			util::unindent_log();
+		}
+
+		auto lk = std::unique_lock(lock);
+		files.push_back(std::move(*fs));
+		delete fs;
+	}
+
+	void addBytesRead(uint64_t n)       { if(current) current->bytesRead += n; }
+	void addBytesWritten(uint64_t n)    { if(current) current->bytesWritten += n; }
+	void addPackets(uint64_t n)         { if(current) current->packets += n; }
+	void addInterleaveBuffer(uint64_t n) { if(current) current->interleavePeak = std::max(current->interleavePeak, n); }
+
+	void setVerified(bool verified, const std::string& checksum)
+	{
+		if(!current)
+			return;
+
+		current->verified = verified;
+		current->checksum = checksum;
+	}
+	void addHttpBytes(uint64_t n)       { if(current) current->httpBytes += n; }
+	void addCacheHit()                  { if(current) current->cacheHits += 1; }
+	void addCacheMiss()                 { if(current) current->cacheMisses += 1; }
+
+	void addSkippedFile()
+	{
+		auto lk = std::unique_lock(lock);
+		skippedFiles += 1;
+	}
+
+	void addRemux(uint64_t bytes, uint64_t ns)
+	{
+		if(current)
+			current->remuxBytes += bytes;
+
+		auto lk = std::unique_lock(lock);
+		if(ns > 0)
+			remuxRates.push_back(bytes / (ns / 1'000'000'000.0));
+	}
+
+	void addSubprocess(const std::string& program, uint64_t ns)
+	{
+		auto lk = std::unique_lock(lock);
+		subprocessTimes[program].push_back(ns);
+	}
+
+	// the provider is the host, and the endpoint is the path with any ids replaced, so that
+	// eg. '/series/12345/actors' and '/series/67890/actors' are counted together. the first
+	// segment is left alone, since that's where the api version usually goes (eg. '/3/movie').
+	static std::pair<std::string, std::string> split_url(std::string_view url)
+	{
+		if(auto k = url.find("://"); k != std::string::npos)
+			url.remove_prefix(k + 3);
+
+		url = url.substr(0, url.find_first_of("?#"));
+
+		auto slash = url.find('/');
+		auto host = std::string(url.substr(0, slash));
+
+		if(slash == std::string::npos)
+			return { host, "/" };
+
+		std::string endpoint;
+		for(auto& seg : util::splitString(std::string(url.substr(slash + 1)), '/'))
+		{
+			bool isId = !endpoint.empty() && !seg.empty() && std::all_of(seg.begin(), seg.end(), [](char c) { return '0' <= c && c <= '9'; });
+
+			// imdb ids look like 'tt0123456'.
+			isId |= (seg.size() > 2 && seg.substr(0, 2) == "tt" && std::all_of(seg.begin() + 2, seg.end(), [](char c) {
+				return '0' <= c && c <= '9';
+			}));
+
+			endpoint += "/";
+			endpoint += (isId ? std::string(":id") : std::string(seg));
+		}
+
+		return { host, endpoint.empty() ? "/" : endpoint };
+	}
+
+	void addHttpRequest(const std::string& url, long status, uint64_t ns)
+	{
+		auto [ provider, endpoint ] = split_url(url);
+
+		auto lk = std::unique_lock(lock);
+		httpTimes[{ provider, endpoint }].push_back(ns);
+		httpResponses[{ provider, endpoint, status }] += 1;
+	}
+
+
+
+	static void write_json(const std::string& path)
+	{
+		pj::array fileArr;
+		for(const auto& fs : files)
+		{
+			pj::object stages;
+			for(size_t i = 0; i < NUM_STAGES; i++)
+			{
+				if(fs.stages[i].count == 0)
+					continue;
+
+				pj::object st;
+				st["count"]     = pj::value(static_cast<int64_t>(fs.stages[i].count));
+				st["total_ns"]  = pj::value(static_cast<int64_t>(fs.stages[i].totalNs));
+				stages[STAGE_NAMES[i]] = pj::value(st);
+			}
+
+			pj::object obj;
+			obj["name"]             = pj::value(fs.name);
+			obj["ok"]               = pj::value(fs.ok);
+			obj["wall_ns"]          = pj::value(static_cast<int64_t>(fs.wallNs));
+			obj["bytes_read"]       = pj::value(static_cast<int64_t>(fs.bytesRead));
+			obj["bytes_written"]    = pj::value(static_cast<int64_t>(fs.bytesWritten));
+			obj["packets"]          = pj::value(static_cast<int64_t>(fs.packets));
+			obj["interleave_peak_bytes"] = pj::value(static_cast<int64_t>(fs.interleavePeak));
+			obj["verified"]         = pj::value(fs.verified);
+
+			if(!fs.checksum.empty())
+				obj["crc32c"] = pj::value(fs.checksum);
+			obj["http_bytes"]       = pj::value(static_cast<int64_t>(fs.httpBytes));
+			obj["cache_hits"]       = pj::value(static_cast<int64_t>(fs.cacheHits));
+			obj["cache_misses"]     = pj::value(static_cast<int64_t>(fs.cacheMisses));
+			obj["stages"]           = pj::value(stages);
+
+			fileArr.push_back(pj::value(obj));
+		}
+
+		auto summarise = [](const std::vector<uint64_t>& xs) -> pj::value {
+			uint64_t total = 0;
+			for(auto x : xs)
+				total += x;
+
+			pj::object obj;
+			obj["count"]    = pj::value(static_cast<int64_t>(xs.size()));
+			obj["total_ns"] = pj::value(static_cast<int64_t>(total));
+			obj["p50_ns"]   = pj::value(static_cast<int64_t>(percentile(xs, 50)));
+			obj["p95_ns"]   = pj::value(static_cast<int64_t>(percentile(xs, 95)));
+			obj["p99_ns"]   = pj::value(static_cast<int64_t>(percentile(xs, 99)));
+			return pj::value(obj);
+		};
+
+		pj::object stages;
+		for(size_t i = 0; i < NUM_STAGES; i++)
+		{
+			if(!samples[i].empty())
+				stages[STAGE_NAMES[i]] = summarise(samples[i]);
+		}
+
+		auto walls = util::map(files, [](const FileStats& fs) -> uint64_t { return fs.wallNs; });
+		std::sort(walls.begin(), walls.end());
+
+		pj::object aggregate;
+		aggregate["files"]  = summarise(walls);
+		aggregate["stages"] = pj::value(stages);
+
+		pj::object root;
+		root["version"]     = pj::value(static_cast<int64_t>(1));
+		root["files"]       = pj::value(fileArr);
+		root["aggregate"]   = pj::value(aggregate);
+
+		auto out = std::ofstream(path, std::ios::binary | std::ios::trunc);
+		if(!out.good())
+		{
+			util::error("failed to write stats to '%s'", path);
+			return;
+		}
+
+		auto str = pj::value(root).serialise();
+		out.write(str.c_str(), str.size());
+	}
+
+	void report()
+	{
+		if(!enabled())
+			return;
+
+		auto lk = std::unique_lock(lock);
+		for(auto& xs : samples)
+			std::sort(xs.begin(), xs.end());
+
+		if(config::shouldShowStats() && !files.empty())
+		{
+			uint64_t read = 0;
+			uint64_t written = 0;
+			for(const auto& fs : files)
+			{
+				read += fs.bytesRead;
+				written += fs.bytesWritten;
+			}
+
+			auto walls = util::map(files, [](const FileStats& fs) -> uint64_t { return fs.wallNs; });
+			std::sort(walls.begin(), walls.end());
+
+			util::info("stats: %d %s, %s read, %s written", files.size(), util::plural("file", files.size()),
+				format_bytes(read), format_bytes(written));
+
+			util::indent_log();
+			util::info("%-10s %7s %10s %10s %10s %10s", "stage", "count", "total", "p50", "p95", "p99");
+
+			auto print_row = [](const char* name, const std::vector<uint64_t>& xs) {
+				uint64_t total = 0;
+				for(auto x : xs)
+					total += x;
+
+				util::info("%-10s %7d %10s %10s %10s %10s", name, xs.size(), format_ns(total), format_ns(percentile(xs, 50)),
+					format_ns(percentile(xs, 95)), format_ns(percentile(xs, 99)));
+			};
+
+			print_row("file", walls);
+			for(size_t i = 0; i < NUM_STAGES; i++)
+			{
+				if(!samples[i].empty())
+					print_row(STAGE_NAMES[i], samples[i]);
+			}
+
+			util::unindent_log();
+		}
+
+		if(auto path = config::getStatsJsonPath(); !path.empty())
+			write_json(path);
+	}
+
+
+
+
+	static constexpr auto METRICS_INTERVAL = std::chrono::seconds(60);
+
+	static constexpr double DURATION_BUCKETS[] = {
+		0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300
+	};
+
+	// bytes per second; 1 MB/s up to 4 GB/s.
+	static constexpr double THROUGHPUT_BUCKETS[] = {
+		1 << 20, 4 << 20, 16 << 20, 32 << 20, 64 << 20, 128 << 20, 256 << 20, 512 << 20, 1024.0 * (1 << 20), 4096.0 * (1 << 20)
+	};
+
+	static std::string format_number(double x)
+	{
+		if(x == std::floor(x) && std::abs(x) < 1e15)
+			return zpr::sprint("%lld", static_cast<long long>(x));
+
+		return zpr::sprint("%.9g", x);
+	}
+
+	static std::string escape_label(const std::string& s)
+	{
+		std::string ret;
+		for(char c : s)
+		{
+			if(c == '\\')       ret += "\\\\";
+			else if(c == '"')   ret += "\\\"";
+			else if(c == '\n')  ret += "\\n";
+			else                ret += c;
+		}
+
+		return ret;
+	}
+
+	static std::string labels(const std::vector<std::pair<std::string, std::string>>& xs)
+	{
+		if(xs.empty())
+			return "";
+
+		return zpr::sprint("{%s}", util::join(util::map(xs, [](const auto& x) -> std::string {
+			return zpr::sprint("%s=\"%s\"", x.first, escape_label(x.second));
+		}), ","));
+	}
+
+	static void write_header(std::string& out, const char* name, const char* type, const char* help)
+	{
+		out += zpr::sprint("# HELP mkvtaginator_%s %s\n", name, help);
+		out += zpr::sprint("# TYPE mkvtaginator_%s %s\n", name, type);
+	}
+
+	static void write_value(std::string& out, const char* name, const std::vector<std::pair<std::string, std::string>>& ls,
+		double value)
+	{
+		out += zpr::sprint("mkvtaginator_%s%s %s\n", name, labels(ls), format_number(value));
+	}
+
+	template <size_t N>
+	static void write_histogram(std::string& out, const char* name, std::vector<std::pair<std::string, std::string>> ls,
+		const std::vector<double>& xs, const double (&buckets)[N])
+	{
+		double sum = 0;
+		for(auto x : xs)
+			sum += x;
+
+		auto bucket_name = zpr::sprint("%s_bucket", name);
+		for(auto le : buckets)
+		{
+			auto n = std::count_if(xs.begin(), xs.end(), [le](double x) { return x <= le; });
+
+			ls.emplace_back("le", format_number(le));
+			write_value(out, bucket_name.c_str(), ls, static_cast<double>(n));
+			ls.pop_back();
+		}
+
+		ls.emplace_back("le", "+Inf");
+		write_value(out, bucket_name.c_str(), ls, static_cast<double>(xs.size()));
+		ls.pop_back();
+
+		write_value(out, zpr::sprint("%s_sum", name).c_str(), ls, sum);
+		write_value(out, zpr::sprint("%s_count", name).c_str(), ls, static_cast<double>(xs.size()));
+	}
+
+	static std::vector<double> to_seconds(const std::vector<uint64_t>& xs)
+	{
+		return util::map(xs, [](uint64_t x) -> double { return x / 1'000'000'000.0; });
+	}
+
+	// must be called with the lock held.
+	static std::string format_metrics()
+	{
+		std::string out;
+
+		size_t ok = 0;
+		size_t failed = 0;
+		uint64_t read = 0;
+		uint64_t written = 0;
+		uint64_t remuxed = 0;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t interleavePeak = 0;
+
+		for(const auto& fs : files)
+		{
+			interleavePeak = std::max(interleavePeak, fs.interleavePeak);
+			(fs.ok ? ok : failed) += 1;
+			read += fs.bytesRead;
+			written += fs.bytesWritten;
+			remuxed += fs.remuxBytes;
+			hits += fs.cacheHits;
+			misses += fs.cacheMisses;
+		}
+
+		write_header(out, "files_total", "counter", "Input files, by result.");
+		write_value(out, "files_total", { { "result", "ok" } }, ok);
+		write_value(out, "files_total", { { "result", "failed" } }, failed);
+		write_value(out, "files_total", { { "result", "skipped" } }, skippedFiles);
+
+		write_header(out, "read_bytes_total", "counter", "Bytes read from input files.");
+		write_value(out, "read_bytes_total", { }, read);
+
+		write_header(out, "written_bytes_total", "counter", "Bytes written to output files.");
+		write_value(out, "written_bytes_total", { }, written);
+
+		write_header(out, "remuxed_bytes_total", "counter", "Bytes written by the muxer.");
+		write_value(out, "remuxed_bytes_total", { }, remuxed);
+
+		write_header(out, "remux_throughput_bytes_per_second", "histogram", "Muxer output rate, per file.");
+		write_histogram(out, "remux_throughput_bytes_per_second", { }, remuxRates, THROUGHPUT_BUCKETS);
+
+		write_header(out, "interleave_buffer_peak_bytes", "gauge", "Most packet data buffered for interleaving by any one file.");
+		write_value(out, "interleave_buffer_peak_bytes", { }, interleavePeak);
+
+		write_header(out, "cache_hits_total", "counter", "Stream-info and metadata cache hits.");
+		write_value(out, "cache_hits_total", { }, hits);
+
+		write_header(out, "cache_misses_total", "counter", "Stream-info and metadata cache misses.");
+		write_value(out, "cache_misses_total", { }, misses);
+
+		write_header(out, "cache_hit_ratio", "gauge", "Fraction of cache lookups that hit.");
+		write_value(out, "cache_hit_ratio", { }, hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0);
+
+		write_header(out, "stage_duration_seconds", "histogram", "Time spent in each stage of processing.");
+		for(size_t i = 0; i < NUM_STAGES; i++)
+			write_histogram(out, "stage_duration_seconds", { { "stage", STAGE_NAMES[i] } }, to_seconds(samples[i]), DURATION_BUCKETS);
+
+		write_header(out, "http_request_duration_seconds", "histogram", "Metadata request latency, by provider and endpoint.");
+		for(const auto& [ key, xs ] : httpTimes)
+		{
+			write_histogram(out, "http_request_duration_seconds", { { "provider", key.first }, { "endpoint", key.second } },
+				to_seconds(xs), DURATION_BUCKETS);
+		}
+
+		std::map<std::string, uint64_t> rateLimited;
+
+		write_header(out, "http_responses_total", "counter", "Metadata responses, by provider, endpoint and status code.");
+		for(const auto& [ key, n ] : httpResponses)
+		{
+			auto& [ provider, endpoint, status ] = key;
+			write_value(out, "http_responses_total", { { "provider", provider }, { "endpoint", endpoint },
+				{ "code", std::to_string(status) } }, n);
+
+			rateLimited[provider] += (status == 429 ? n : 0);
+		}
+
+		write_header(out, "http_rate_limited_total", "counter", "Metadata requests rejected with 429 (too many requests).");
+		for(const auto& [ provider, n ] : rateLimited)
+			write_value(out, "http_rate_limited_total", { { "provider", provider } }, n);
+
+		write_header(out, "subprocess_duration_seconds", "histogram", "Time spent waiting for mkvtoolnix, by program.");
+		for(const auto& [ program, xs ] : subprocessTimes)
+			write_histogram(out, "subprocess_duration_seconds", { { "program", program } }, to_seconds(xs), DURATION_BUCKETS);
+
+		auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+		write_header(out, "last_update_timestamp_seconds", "gauge", "When these metrics were written.");
+		write_value(out, "last_update_timestamp_seconds", { }, static_cast<double>(now));
+
+		return out;
+	}
+
+	void writeMetrics(bool force)
+	{
+		static std::chrono::steady_clock::time_point lastWrite;
+
+		auto path = config::getMetricsPath();
+		if(path.empty())
+			return;
+
+		std::string text;
+		{
+			auto lk = std::unique_lock(lock);
+
+			auto now = std::chrono::steady_clock::now();
+			if(!force && now - lastWrite < METRICS_INTERVAL)
+				return;
+
+			lastWrite = now;
+			text = format_metrics();
+		}
+
+		// the textfile collector might read it at any time, so it must never see a partial file.
+		auto tmp = path + ".tmp";
+		{
+			auto out = std::ofstream(tmp, std::ios::binary | std::ios::trunc);
+			if(!out.good())
+			{
+				util::error("failed to write metrics to '%s'", path);
+				return;
+			}
+
+			out.write(text.c_str(), text.size());
+		}
+
+		std::error_code ec;
+		std::fs::rename(tmp, path, ec);
+		if(ec)
+			util::error("failed to write metrics to '%s'", path);
+	}
+}
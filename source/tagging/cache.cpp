@@ -2,19 +2,31 @@
 // Copyright (c) 2019, zhiayang
 // Licensed under the Apache License Version 2.0.
 
+#include <mutex>
+
 #include "defs.h"
 
 namespace tag::cache
 {
+	// files can be tagged in parallel (--jobs).
+	static std::mutex lock;
+
 	static std::unordered_map<std::string, std::string> seriesIdCache;
 
 	std::string getSeriesId(const std::string& name)
 	{
-		return seriesIdCache[name];
+		auto lk = std::unique_lock(lock);
+
+		auto ret = seriesIdCache[name];
+		if(ret.empty()) stats::addCacheMiss();
+		else            stats::addCacheHit();
+
+		return ret;
 	}
 
 	void setSeriesId(const std::string& name, const std::string& id)
 	{
+		auto lk = std::unique_lock(lock);
 		seriesIdCache[name] = id;
 	}
 
@@ -25,16 +37,23 @@ namespace tag::cache
 
 	SeriesMetadata getSeriesMeta(const std::string& id)
 	{
+		auto lk = std::unique_lock(lock);
 		return metaCache[id];
 	}
 
 	void addSeriesMeta(const std::string& id, const SeriesMetadata& meta)
 	{
+		auto lk = std::unique_lock(lock);
 		metaCache[id] = meta;
 	}
 
 	bool haveSeriesMeta(const std::string& id)
 	{
-		return metaCache.find(id) != metaCache.end();
+		auto lk = std::unique_lock(lock);
+		auto ret = (metaCache.find(id) != metaCache.end());
+		if(ret) stats::addCacheHit();
+		else    stats::addCacheMiss();
+
+		return ret;
 	}
 }
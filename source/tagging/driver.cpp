@@ -3,6 +3,7 @@
 // Licensed under the Apache License Version 2.0.
 
 #include <regex>
+#include <atomic>
 #include <fstream>
 
 #include "defs.h"
@@ -20,6 +21,14 @@ namespace tag
 	static constexpr const char* MKVEXTRACT_PROGRAM     = "mkvextract";
 	static constexpr const char* MKVPROPEDIT_PROGRAM    = "mkvpropedit";
 
+	// temporary files go in the current folder; several files can be tagged at once (--jobs),
+	// so each one gets its own names.
+	static std::string temp_name(const std::string& name)
+	{
+		static std::atomic<uint64_t> counter = 0;
+		return zpr::sprint(".tmp-mkvinator-%d-%s", counter++, name);
+	}
+
 	template <typename... Args>
 	static void error(const std::string& fmt, Args&&... args)
 	{
@@ -27,7 +36,7 @@ namespace tag
 		if(config::shouldStopOnError())
 		{
 			util::error("stopping on first error");
-			exit(-1);
+			driver::stop();
 		}
 	}
 
@@ -51,14 +60,18 @@ namespace tag
 		TmpAttachment attachment;
 
 		std::string sout;
+		{
+			stats::Scope timer(stats::Stage::Subprocess, { { "program", MKVMERGE_PROGRAM } });
 
-		tinyproclib::Process proc(zpr::sprint("%s --identify \"%s\"", MKVMERGE_PROGRAM, filepath.string()), "",
-			[&sout](const char* bytes, size_t n) {
-				sout += std::string(bytes, n);
-			}
-		);
+			tinyproclib::Process proc(zpr::sprint("%s --identify \"%s\"", MKVMERGE_PROGRAM, filepath.string()), "",
+				[&sout](const char* bytes, size_t n) {
+					sout += std::string(bytes, n);
+				}
+			);
 
-		proc.get_exit_status();
+			proc.get_exit_status();
+			stats::addSubprocess(MKVMERGE_PROGRAM, timer.elapsed());
+		}
 
 		auto lines = util::splitString(sout);
 		for(const auto& l : lines)
@@ -74,7 +87,7 @@ namespace tag
 				attachment.id = std::stoi(sm[1]);
 				attachment.mime = sm[2];
 				attachment.name = sm[3];
-				attachment.extractedFile = ".tmp-mkvinator-attachment-file";
+				attachment.extractedFile = temp_name("attachment-file");
 
 				// if this is already a cover image, then just replace it -- we don't need to extract and
 				// reattach it. prevents cover art from spamming the file when you run mkvtaginator multiple times.
@@ -86,10 +99,13 @@ namespace tag
 				else if(!config::isDryRun())
 				{
 					// extract it.
+					stats::Scope timer(stats::Stage::Subprocess, { { "program", MKVEXTRACT_PROGRAM } });
 					tinyproclib::Process proc(zpr::sprint("%s -q \"%s\" attachments %d:%s", MKVEXTRACT_PROGRAM,
 						filepath.string(), attachment.id, attachment.extractedFile));
 
 					proc.get_exit_status();
+					stats::addSubprocess(MKVEXTRACT_PROGRAM, timer.elapsed());
+
 					cleanupList.push_back(attachment.extractedFile);
 				}
 
@@ -108,7 +124,10 @@ namespace tag
 		// try tv series
 		if(!config::disableSeriesSearch() && (!config::getManualSeriesId().empty() || config::getManualMovieId().empty()))
 		{
-			auto [ series, season, episode, title ] = parseTVShow(filepath.stem().string());
+			auto [ series, season, episode, title ] = [&filepath]() {
+				stats::Scope timer(stats::Stage::Parse);
+				return parseTVShow(filepath.stem().string());
+			}();
 
 			// for this, we need season/episode info, so even if you give the series id there's no point.
 			if(!series.empty())
@@ -134,7 +153,10 @@ namespace tag
 				util::info("tv: %s S%02dE%02d%s", metadata.seriesMeta.dbName, metadata.seasonNumber,
 					metadata.episodeNumber, metadata.dbName.empty() ? "" : zpr::sprint(" - %s", metadata.dbName));
 
-				auto xml = serialiseMetadata(metadata);
+				auto xml = [&metadata]() {
+					stats::Scope timer(stats::Stage::Xml);
+					return serialiseMetadata(metadata);
+				}();
 
 				coverArtNames.insert(coverArtNames.begin(), "season");
 				coverArtNames.insert(coverArtNames.begin(), "Season");
@@ -153,7 +175,7 @@ namespace tag
 
 				return {
 					static_cast<GenericMetadata>(metadata),
-					zpr::sprint(".tmp-mkvinator-tags-s%02d-e%02d.xml", metadata.seasonNumber, metadata.episodeNumber),
+					temp_name(zpr::sprint("tags-s%02d-e%02d.xml", metadata.seasonNumber, metadata.episodeNumber)),
 					xml
 				};
 			}
@@ -163,7 +185,10 @@ namespace tag
 		if(!config::disableMovieSearch() && (!config::getManualMovieId().empty() || config::getManualSeriesId().empty()))
 		{
 			// try movie
-			auto [ title, year ] = parseMovie(filepath.stem().string());
+			auto [ title, year ] = [&filepath]() {
+				stats::Scope timer(stats::Stage::Parse);
+				return parseMovie(filepath.stem().string());
+			}();
 
 			// for movies, as long as we have the ID it's ok.
 			if(title.empty() && config::getManualMovieId().empty())
@@ -181,10 +206,14 @@ namespace tag
 			metadata.normalTitle = zpr::sprint("%s", metadata.title);
 			metadata.canonicalTitle = zpr::sprint("%s (%d)", metadata.title, metadata.year);
 
-			auto xml = serialiseMetadata(metadata);
+			auto xml = [&metadata]() {
+				stats::Scope timer(stats::Stage::Xml);
+				return serialiseMetadata(metadata);
+			}();
+
 			return {
 				static_cast<GenericMetadata>(metadata),
-				zpr::sprint(".tmp-mkvinator-tags-movie-%s.xml", metadata.id),
+				temp_name(zpr::sprint("tags-movie-%s.xml", metadata.id)),
 				xml
 			};
 		}
@@ -196,6 +225,8 @@ namespace tag
 
 	static void writeXML(const std::string& path, tinyxml2::XMLDocument* xml)
 	{
+		stats::Scope timer(stats::Stage::Xml);
+
 		auto printer = new tinyxml2::XMLPrinter();
 		xml->Print(printer);
 
@@ -328,14 +359,34 @@ namespace tag
 
 		if(!config::isDryRun())
 		{
+			// muxed earlier in this run, and not renamed yet.
+			if(staging::resolve(outpath) != outpath)
+			{
+				util::log("updating existing output in-place");
+				return outpath.string();
+			}
+
 			if(std::fs::exists(outpath) && config::shouldDeleteExistingOutput() && !std::fs::equivalent(outpath, filepath))
 				std::fs::remove(outpath);
 
 			if(!std::fs::exists(outpath))
 			{
 				util::log("copying output file");
-				auto x = std::fs::copy_file(filepath, outpath);
-				if(!x)
+
+				// like the muxer's outputs, copies only get their real name once they're on disk.
+				stats::Scope timer(stats::Stage::Copy);
+
+				auto tmppath = staging::tempPath(outpath);
+				auto x = std::fs::copy_file(filepath, tmppath, std::fs::copy_options::overwrite_existing);
+				if(x)
+				{
+					staging::add(tmppath, outpath);
+
+					auto size = util::getFileSize(filepath.string());
+					stats::addBytesRead(size);
+					stats::addBytesWritten(size);
+				}
+				else
 				{
 					error("%serror:%s failed to copy file to '%s'", outpath.string(),
 						COLOUR_RED_BOLD, COLOUR_RESET);
@@ -358,14 +409,19 @@ namespace tag
 
 	bool tagOneFile(const std::fs::path& filepath)
 	{
-		std::fs::path inputFile = filepath;
+		trace::begin("tag", "driver");
+		defer(trace::end());
+
+		// 'filepath' is the name the file will have, which might not be where it is yet (see staging).
+		std::fs::path inputFile = staging::resolve(filepath);
+		std::fs::path finalFile = filepath;
 
 
 
 		std::vector<std::string> arguments;
 		std::vector<std::string> filesToCleanup;
 
-		auto firstAttachment = extractFirstAttachmentIfNecessary(filepath, filesToCleanup);
+		auto firstAttachment = extractFirstAttachmentIfNecessary(inputFile, filesToCleanup);
 
 		arguments.push_back(MKVPROPEDIT_PROGRAM);
 		arguments.push_back(zpr::sprint("\"%s\"", inputFile.string()));
@@ -378,7 +434,9 @@ namespace tag
 		};
 
 		// get the metadata
+		trace::begin("metadata", "driver");
 		auto [ meta, xmlname, xml ] = getMetadataXML(filepath, coverArtNames);
+		trace::end();
 		{
 			if(!xml) return false;
 
@@ -416,8 +474,9 @@ namespace tag
 		{
 			if(auto outfile = createOutputFile(filepath, out); !outfile.empty())
 			{
-				arguments[1] = zpr::sprint("\"%s\"", outfile);
-				inputFile = outfile;
+				finalFile = outfile;
+				inputFile = staging::resolve(outfile);
+				arguments[1] = zpr::sprint("\"%s\"", inputFile.string());
 			}
 			else
 			{
@@ -438,6 +497,7 @@ namespace tag
 			std::string sout;
 			std::string serr;
 
+			stats::Scope timer(stats::Stage::Subprocess, { { "program", MKVPROPEDIT_PROGRAM } });
 			tinyproclib::Process proc(cmdline, "", [&sout](const char* bytes, size_t n) {
 				sout += std::string(bytes, n);
 			}, [&serr](const char* bytes, size_t n) {
@@ -446,6 +506,7 @@ namespace tag
 
 			// note: this waits for the process to finish.
 			int status = proc.get_exit_status();
+			stats::addSubprocess(MKVPROPEDIT_PROGRAM, timer.elapsed());
 
 			if(status != 0)
 			{
@@ -456,16 +517,21 @@ namespace tag
 				if(!serr.empty()) util::error("%s\n", serr);
 
 				if(config::shouldStopOnError())
-					exit(-1);
+				{
+					util::error("stopping on first error");
+					driver::stop();
+				}
 
 				return false;
 			}
+
+			journal::record(journal::Stage::Tagged, finalFile);
 		}
 
 		// finally, after all this, we can rename the file.
 		if(config::shouldRenameFiles())
 		{
-			auto path = inputFile;
+			auto path = finalFile;
 
 			auto newname = meta.canonicalTitle;
 			if(!config::shouldRenameWithoutEpisodeTitle() && !meta.episodeTitle.empty())
@@ -478,7 +544,15 @@ namespace tag
 			if(!config::isDryRun())
 			{
 				util::log("renaming file: '%s'", newpath.filename().string());
-				std::fs::rename(path, newpath);
+
+				stats::Scope timer(stats::Stage::Rename);
+				if(!staging::rename(path, newpath))
+				{
+					error("failed to rename '%s'", path.filename().string());
+					return false;
+				}
+
+				journal::record(journal::Stage::Renamed, newpath);
 			}
 			else
 			{
@@ -0,0 +1,276 @@
+// http.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <atomic>
+#include <fstream>
+
+#include "defs.h"
+#include "cpr/cpr.h"
+
+#include "picojson.h"
+namespace pj = picojson;
+
+// all the metadata providers go through here, so requests can be timed and counted in one place.
+namespace tag::http
+{
+	static cpr::Header make_header(const Params& headers)
+	{
+		cpr::Header ret;
+		for(const auto& [ k, v ] : headers)
+			ret[k] = v;
+
+		return ret;
+	}
+
+	static Response make_response(const cpr::Response& r)
+	{
+		stats::addHttpBytes(r.text.size());
+		trace::instant("response", "http", {
+			{ "status", std::to_string(r.status_code) },
+			{ "bytes", std::to_string(r.text.size()) }
+		});
+
+		Response ret;
+		ret.status_code = r.status_code;
+		ret.url = r.url;
+		ret.text = r.text;
+
+		return ret;
+	}
+
+	// with an api base url, 'https://api.tvmaze.com/shows/1' becomes '<base>/api.tvmaze.com/shows/1'.
+	static std::string rewrite_url(const std::string& url)
+	{
+		auto base = config::getApiBaseUrl();
+		if(base.empty())
+			return url;
+
+		auto host = url.find("://");
+		host = (host == std::string::npos ? 0 : host + 3);
+
+		if(base.back() == '/')
+			base.pop_back();
+
+		return zpr::sprint("%s/%s", base, url.substr(host));
+	}
+
+	static constexpr int64_t CASSETTE_VERSION = 1;
+
+	// parameters and fields that hold credentials; these never make it into a cassette, and don't
+	// take part in matching, so a recording can be replayed with any key (or none).
+	static bool is_secret(const std::string& key)
+	{
+		return util::match(key, "api_key", "apikey", "userkey", "username", "token");
+	}
+
+	// a cassette is one recorded request/response pair, in its own file (so the directory can be
+	// diffed, edited, or added to by hand). the filename is the host and path, and a hash of the
+	// normalised request: method, url, and the non-secret parameters (sorted) or json body.
+	struct Cassette
+	{
+		std::string key;
+		std::string url;
+		std::fs::path path;
+	};
+
+	static Cassette make_cassette(const std::string& dir, const char* method, const std::string& url, const Params& params,
+		const std::string& body)
+	{
+		auto ps = util::filter(params, [](const auto& p) -> bool { return !is_secret(p.first); });
+		std::stable_sort(ps.begin(), ps.end(), [](const auto& a, const auto& b) -> bool { return a.first < b.first; });
+
+		auto query = util::join(util::map(ps, [](const auto& p) -> std::string {
+			return zpr::sprint("%s=%s", p.first, p.second);
+		}), "&");
+
+		Cassette ret;
+		ret.url = query.empty() ? url : zpr::sprint("%s?%s", url, query);
+		ret.key = zpr::sprint("%s %s", method, ret.url);
+
+		if(!body.empty())
+		{
+			// json bodies are re-serialised without their secrets (and with sorted keys).
+			pj::value v;
+			if(pj::parse(v, body).empty() && v.is<pj::object>())
+			{
+				auto obj = v.get<pj::object>();
+				for(auto it = obj.begin(); it != obj.end(); )
+					it = is_secret(it->first) ? obj.erase(it) : std::next(it);
+
+				ret.key += " " + pj::value(obj).serialise();
+			}
+			else
+			{
+				ret.key += " " + body;
+			}
+		}
+
+		// fnv-1a
+		uint64_t hash = 0xcbf29ce484222325;
+		for(unsigned char c : ret.key)
+			hash = (hash ^ c) * 0x100000001b3;
+
+		auto name = url.substr(url.find("://") == std::string::npos ? 0 : url.find("://") + 3);
+		for(char& c : name)
+		{
+			if(!isalnum(c) && c != '.')
+				c = '-';
+		}
+
+		ret.path = std::fs::path(dir) / zpr::sprint("%s-%016llx.json", name.substr(0, 96),
+			static_cast<unsigned long long>(hash));
+
+		return ret;
+	}
+
+	static bool replay(const Cassette& cas, Response* resp)
+	{
+		if(!std::fs::exists(cas.path))
+			return false;
+
+		uint8_t* buf = 0; size_t sz = 0;
+		std::tie(buf, sz) = util::readEntireFile(cas.path.string());
+		if(!buf)
+			return false;
+
+		pj::value root;
+		std::string err;
+		pj::parse(root, buf, buf + sz, &err);
+		delete[] buf;
+
+		// cassettes can be edited by hand, so check everything that's read out of one.
+		if(!err.empty() || !root.is<pj::object>() || !root.get("version").is<int64_t>()
+			|| root.get("version").get<int64_t>() != CASSETTE_VERSION
+			|| !root.get("status").is<int64_t>() || !root.get("text").is<std::string>())
+		{
+			util::warn("warn: ignoring malformed cassette '%s'", cas.path.string());
+			return false;
+		}
+
+		resp->status_code = static_cast<long>(root.get("status").get<int64_t>());
+		resp->url = cas.url;
+		resp->text = root.get("text").get<std::string>();
+		return true;
+	}
+
+	static void record(const Cassette& cas, const cpr::Response& r)
+	{
+		// don't keep anything transient; a replay should see what a working server would say.
+		if(r.status_code == 0 || r.status_code == 429 || r.status_code >= 500)
+			return;
+
+		// responses can have secrets too (eg. the tvdb login token).
+		auto text = r.text;
+		if(pj::value v; pj::parse(v, text).empty() && v.is<pj::object>())
+		{
+			auto& obj = v.get<pj::object>();
+			bool redacted = false;
+			for(auto& [ k, x ] : obj)
+			{
+				if(is_secret(k) && x.is<std::string>())
+				{
+					x = pj::value("redacted");
+					redacted = true;
+				}
+			}
+
+			if(redacted)
+				text = v.serialise();
+		}
+
+		pj::object root;
+		root["version"] = pj::value(CASSETTE_VERSION);
+		root["request"] = pj::value(cas.key);
+		root["status"]  = pj::value(static_cast<int64_t>(r.status_code));
+		root["text"]    = pj::value(text);
+
+		std::error_code ec;
+		std::fs::create_directories(cas.path.parent_path(), ec);
+
+		// jobs might be recording the same request at once; each writes its own file and renames it over.
+		static std::atomic<uint64_t> counter = 0;
+
+		auto tmp = cas.path;
+		tmp += zpr::sprint(".%d.tmp", counter++);
+		{
+			auto out = std::ofstream(tmp, std::ios::binary | std::ios::trunc);
+			if(!out.good())
+			{
+				util::warn("warn: failed to write cassette '%s'", cas.path.string());
+				return;
+			}
+
+			auto str = pj::value(root).serialise(/* prettify: */ true);
+			out.write(str.c_str(), str.size());
+		}
+
+		std::fs::rename(tmp, cas.path, ec);
+		if(ec)
+			util::warn("warn: failed to write cassette '%s'", cas.path.string());
+	}
+
+	// with both a replay and a record directory, requests that weren't recorded go to the network (and
+	// get recorded); with only a replay directory, they fail without touching the network.
+	template <typename Fn>
+	static Response perform(const char* method, const std::string& url, const Params& params, const std::string& body,
+		Fn&& request)
+	{
+		auto replayDir = config::getHttpReplayPath();
+		auto recordDir = config::getHttpRecordPath();
+
+		if(!replayDir.empty())
+		{
+			auto cas = make_cassette(replayDir, method, url, params, body);
+
+			Response ret;
+			if(replay(cas, &ret))
+			{
+				stats::addHttpBytes(ret.text.size());
+				trace::instant("replay", "http", {
+					{ "status", std::to_string(ret.status_code) },
+					{ "bytes", std::to_string(ret.text.size()) }
+				});
+
+				return ret;
+			}
+
+			if(recordDir.empty())
+			{
+				util::error("no recorded response for '%s' (%s)", cas.key, cas.path.filename().string());
+
+				ret.url = cas.url;
+				return ret;
+			}
+		}
+
+		stats::Scope timer(stats::Stage::Http, { { "method", method }, { "url", url } });
+
+		auto r = request();
+		stats::addHttpRequest(url, r.status_code, timer.elapsed());
+
+		if(!recordDir.empty())
+			record(make_cassette(recordDir, method, url, params, body), r);
+
+		return make_response(r);
+	}
+
+	Response get(const std::string& url, const Params& params, const Params& headers)
+	{
+		// only the url goes in the trace; the parameters have api keys in them.
+		return perform("GET", url, params, "", [&]() -> cpr::Response {
+			cpr::Parameters ps;
+			for(const auto& [ k, v ] : params)
+				ps.AddParameter(cpr::Parameter(k, v));
+
+			return cpr::Get(cpr::Url(rewrite_url(url)), ps, make_header(headers));
+		});
+	}
+
+	Response post(const std::string& url, const std::string& body, const Params& headers)
+	{
+		return perform("POST", url, { }, body, [&]() -> cpr::Response {
+			return cpr::Post(cpr::Url(rewrite_url(url)), cpr::Body(body), make_header(headers));
+		});
+	}
+}
@@ -2,9 +2,9 @@
 // Copyright (c) 2019, zhiayang
 // Licensed under the Apache License Version 2.0.
 
+#include <mutex>
 #include <regex>
 
-#include "cpr/cpr.h"
 #include "defs.h"
 #include "picojson.h"
 
@@ -19,6 +19,8 @@ namespace tag::moviedb
 		moviedb::login();
 
 		MovieMetadata ret;
+		if(getToken().empty())
+			return ret;
 
 		std::string movieId;
 
@@ -27,14 +29,14 @@ namespace tag::moviedb
 			// note: there's no need to cache this, since we don't do multiple movies
 			// with the same title (what's the point of that?) unlike tv shows.
 
-			auto r = cpr::Get(
-				cpr::Url(zpr::sprint("%s/search/movie", API_URL)),
-				cpr::Parameters({
+			auto r = http::get(
+				zpr::sprint("%s/search/movie", API_URL),
+				{
 					{ "api_key", getToken() },
 					{ "query", title },
 					// { "year", year },
-					{ "include_adult", true }
-				})
+					{ "include_adult", "true" }
+				}
 			);
 
 			if(r.status_code != 200)
@@ -47,6 +49,7 @@ namespace tag::moviedb
 				goto fail;
 			}
 
+			auto mem = memory::Charge(memory::jsonSize(r.text.size()));
 			pj::value resp;
 			pj::parse(resp, r.text);
 
@@ -99,14 +102,15 @@ namespace tag::moviedb
 						misc::Option::Info info;
 						info.heading = "aliases:";
 
-						auto r = cpr::Get(
-							cpr::Url(zpr::sprint("%s/movie/%s/alternative_titles", API_URL, id)),
-							cpr::Parameters({{ "api_key", getToken() }})
+						auto r = http::get(
+							zpr::sprint("%s/movie/%s/alternative_titles", API_URL, id),
+							{{ "api_key", getToken() }}
 						);
 
 						// ignore errors here since it's not important.
 						if(r.status_code == 200)
 						{
+							auto mem = memory::Charge(memory::jsonSize(r.text.size()));
 							pj::value resp;
 							pj::parse(resp, r.text);
 
@@ -174,9 +178,9 @@ namespace tag::moviedb
 
 		ret.id = movieId;
 		{
-			auto r = cpr::Get(
-				cpr::Url(zpr::sprint("%s/movie/%s", API_URL, movieId)),
-				cpr::Parameters({{ "api_key", getToken() }})
+			auto r = http::get(
+				zpr::sprint("%s/movie/%s", API_URL, movieId),
+				{{ "api_key", getToken() }}
 			);
 
 			if(r.status_code != 200)
@@ -189,6 +193,7 @@ namespace tag::moviedb
 				goto fail;
 			}
 
+			auto mem = memory::Charge(memory::jsonSize(r.text.size()));
 			pj::value data;
 			pj::parse(data, r.text);
 
@@ -217,9 +222,9 @@ namespace tag::moviedb
 
 			// actors is a separate thing:
 			{
-				auto r = cpr::Get(
-					cpr::Url(zpr::sprint("%s/movie/%s/credits", API_URL, movieId)),
-					cpr::Parameters({{ "api_key", getToken() }})
+				auto r = http::get(
+					zpr::sprint("%s/movie/%s/credits", API_URL, movieId),
+					{{ "api_key", getToken() }}
 				);
 
 				if(r.status_code != 200)
@@ -234,6 +239,7 @@ namespace tag::moviedb
 				}
 				else
 				{
+					auto mem = memory::Charge(memory::jsonSize(r.text.size()));
 					pj::value data;
 					pj::parse(data, r.text);
 
@@ -306,25 +312,38 @@ namespace tag::moviedb
 
 
 
+	// files can be tagged in parallel (--jobs).
+	static std::mutex tokenLock;
 	static std::string authToken;
+
 	static void setToken(const std::string& token)
 	{
+		auto lk = std::unique_lock(tokenLock);
 		authToken = token;
 	}
 
 	std::string getToken()
 	{
+		auto lk = std::unique_lock(tokenLock);
 		return authToken;
 	}
 
 	void login()
 	{
 		auto key = config::getMovieDBApiKey();
+
+		// replayed requests don't need (or check) a key.
+		if(key.empty() && !config::getHttpReplayPath().empty())
+			key = "replay";
+
 		if(key.empty())
 		{
 			util::error("%serror:%s missing api-key for TheMovieDB (use '--moviedb-api <api_key>', see '--help')",
 				COLOUR_RED_BOLD, COLOUR_RESET);
-			exit(-1);
+
+			// other jobs might be running, so this can't just exit; without a key, this file fails.
+			driver::stop();
+			return;
 		}
 
 		// there's actually no need to login, lmao.
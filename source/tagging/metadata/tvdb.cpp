@@ -2,9 +2,9 @@
 // Copyright (c) 2019, zhiayang
 // Licensed under the Apache License Version 2.0.
 
+#include <mutex>
 #include <regex>
 
-#include "cpr/cpr.h"
 #include "defs.h"
 #include "picojson.h"
 
@@ -42,10 +42,10 @@ namespace tag::tvdb
 			}
 			else
 			{
-				auto r = cpr::Get(
-					cpr::Url(zpr::sprint("%s/search/series", API_URL)),
-					cpr::Parameters({{ "name", name }}),
-					cpr::Header({{ "Authorization", zpr::sprint("Bearer %s", getToken()) }})
+				auto r = http::get(
+					zpr::sprint("%s/search/series", API_URL),
+					{{ "name", name }},
+					{{ "Authorization", zpr::sprint("Bearer %s", getToken()) }}
 				);
 
 				if(r.status_code != 200)
@@ -58,6 +58,7 @@ namespace tag::tvdb
 					goto fail;
 				}
 
+				auto mem = memory::Charge(memory::jsonSize(r.text.size()));
 				pj::value resp;
 				pj::parse(resp, r.text);
 
@@ -162,9 +163,9 @@ namespace tag::tvdb
 		{
 			ret.id = seriesId;
 
-			auto r = cpr::Get(
-				cpr::Url(zpr::sprint("%s/series/%s", API_URL, seriesId)),
-				cpr::Header({{ "Authorization", zpr::sprint("Bearer %s", getToken()) }})
+			auto r = http::get(
+				zpr::sprint("%s/series/%s", API_URL, seriesId), { },
+				{{ "Authorization", zpr::sprint("Bearer %s", getToken()) }}
 			);
 
 			if(r.status_code != 200)
@@ -178,6 +179,7 @@ namespace tag::tvdb
 			}
 
 
+			auto mem = memory::Charge(memory::jsonSize(r.text.size()));
 			pj::value resp;
 			pj::parse(resp, r.text);
 			auto data = resp.get("data");
@@ -191,9 +193,9 @@ namespace tag::tvdb
 
 			// actors come from elsewhere:
 			{
-				auto r = cpr::Get(
-					cpr::Url(zpr::sprint("%s/series/%s/actors", API_URL, seriesId)),
-					cpr::Header({{ "Authorization", zpr::sprint("Bearer %s", getToken()) }})
+				auto r = http::get(
+					zpr::sprint("%s/series/%s/actors", API_URL, seriesId), { },
+					{{ "Authorization", zpr::sprint("Bearer %s", getToken()) }}
 				);
 
 				if(r.status_code != 200)
@@ -208,6 +210,7 @@ namespace tag::tvdb
 				}
 				else
 				{
+					auto mem = memory::Charge(memory::jsonSize(r.text.size()));
 					pj::value data;
 					pj::parse(data, r.text);
 					data = data.get("data");
@@ -241,18 +244,20 @@ namespace tag::tvdb
 
 
 		EpisodeMetadata ret;
+		if(getToken().empty())
+			return ret;
 		ret.seriesMeta = fetchSeriesMetadata(series, manualSeriesId);
 		if(!ret.seriesMeta.valid)
 			return ret;
 
 		{
-			auto r = cpr::Get(
-				cpr::Url(zpr::sprint("%s/series/%s/episodes/query", API_URL, ret.seriesMeta.id)),
-				cpr::Header({{ "Authorization", zpr::sprint("Bearer %s", getToken()) }}),
-				cpr::Parameters({
+			auto r = http::get(
+				zpr::sprint("%s/series/%s/episodes/query", API_URL, ret.seriesMeta.id),
+				{
 					{ "airedSeason", std::to_string(season) },
 					{ "airedEpisode", std::to_string(episode) }
-				})
+				},
+				{{ "Authorization", zpr::sprint("Bearer %s", getToken()) }}
 			);
 
 			if(r.status_code != 200)
@@ -266,6 +271,7 @@ namespace tag::tvdb
 			}
 
 
+			auto mem = memory::Charge(memory::jsonSize(r.text.size()));
 			pj::value resp;
 			pj::parse(resp, r.text);
 
@@ -320,34 +326,51 @@ namespace tag::tvdb
 
 
 
+	// files can be tagged in parallel (--jobs).
+	static std::mutex tokenLock;
 	static std::string authToken;
+
 	static void setToken(const std::string& token)
 	{
+		auto lk = std::unique_lock(tokenLock);
 		authToken = token;
 	}
 
 	std::string getToken()
 	{
+		auto lk = std::unique_lock(tokenLock);
 		return authToken;
 	}
 
 	void login()
 	{
-		if(!authToken.empty())
+		// only log in once, even if several files need it at the same time.
+		static std::mutex loginLock;
+		auto lk = std::unique_lock(loginLock);
+
+		if(!getToken().empty())
 			return;
 
 		auto key = config::getTVDBApiKey();
+
+		// replayed requests don't need (or check) a key.
+		if(key.empty() && !config::getHttpReplayPath().empty())
+			key = "replay";
+
 		if(key.empty())
 		{
 			util::error("%serror:%s missing api-key for theTVDB (use '--tvdb-api <api_key>', see '--help')",
 				COLOUR_RED_BOLD, COLOUR_RESET);
-			exit(-1);
+
+			// other jobs might be running, so this can't just exit; without a token, this file fails.
+			driver::stop();
+			return;
 		}
 
-		auto r = cpr::Post(
-			cpr::Url(zpr::sprint("%s/login", API_URL)),
-			cpr::Body(zpr::sprint("{\"apikey\":\"%s\"}", key)),
-			cpr::Header{{"Content-Type", "application/json"}}
+		auto r = http::post(
+			zpr::sprint("%s/login", API_URL),
+			zpr::sprint("{\"apikey\":\"%s\"}", key),
+			{{ "Content-Type", "application/json" }}
 		);
 
 		if(r.status_code != 200)
@@ -355,8 +378,10 @@ namespace tag::tvdb
 			util::error("failed to login to thetvdb!"); util::indent_log();
 			util::info("status: %d", r.status_code);
 			if(r.status_code != 404) util::info("body: %s", r.text);
+			util::unindent_log();
 
-			exit(-1);
+			driver::stop();
+			return;
 		}
 
 		// then get the token:
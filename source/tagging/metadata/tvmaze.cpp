@@ -5,7 +5,6 @@
 #include <regex>
 
 #include "defs.h"
-#include "cpr/cpr.h"
 #include "picojson.h"
 
 namespace pj = picojson;
@@ -46,9 +45,9 @@ namespace tag::tvmaze
 					if(c == '.' || c == '-')
 						c = ' ';
 
-				auto r = cpr::Get(
-					cpr::Url(zpr::sprint("%s/search/shows", API_URL)),
-					cpr::Parameters({{ "q", search_name }})
+				auto r = http::get(
+					zpr::sprint("%s/search/shows", API_URL),
+					{{ "q", search_name }}
 				);
 
 				if(r.status_code != 200)
@@ -152,8 +151,8 @@ namespace tag::tvmaze
 		{
 			ret.id = seriesId;
 
-			auto r = cpr::Get(
-				cpr::Url(zpr::sprint("%s/shows/%s", API_URL, seriesId))
+			auto r = http::get(
+				zpr::sprint("%s/shows/%s", API_URL, seriesId)
 			);
 
 			if(r.status_code != 200)
@@ -179,8 +178,8 @@ namespace tag::tvmaze
 
 			// actors come from elsewhere:
 			{
-				auto r = cpr::Get(
-					cpr::Url(zpr::sprint("%s/shows/%s/cast", API_URL, seriesId))
+				auto r = http::get(
+					zpr::sprint("%s/shows/%s/cast", API_URL, seriesId)
 				);
 
 				if(r.status_code != 200)
@@ -233,22 +232,22 @@ namespace tag::tvmaze
 			return ret;
 
 		{
-			cpr::Response r {};
+			http::Response r {};
 
 			if(auto episode_id = config::getManualEpisodeId(); !episode_id.empty())
 			{
-				r = cpr::Get(
-					cpr::Url(zpr::sprint("%s/episodes/%s", API_URL, episode_id))
+				r = http::get(
+					zpr::sprint("%s/episodes/%s", API_URL, episode_id)
 				);
 			}
 			else
 			{
-				r = cpr::Get(
-					cpr::Url(zpr::sprint("%s/shows/%s/episodebynumber", API_URL, ret.seriesMeta.id)),
-					cpr::Parameters({
+				r = http::get(
+					zpr::sprint("%s/shows/%s/episodebynumber", API_URL, ret.seriesMeta.id),
+					{
 						{ "season", std::to_string(season) },
 						{ "number", std::to_string(episode) }
-					})
+					}
 				);
 			}
 
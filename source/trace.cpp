@@ -0,0 +1,166 @@
+// trace.cpp
+// Copyright (c) 2022, zhiayang
+// SPDX-License-Identifier: Apache-2.0
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "defs.h"
+
+#include "picojson.h"
+namespace pj = picojson;
+
+// events are written out as they happen (one per line), in the json array flavour of the chrome trace
+// event format. that format allows the closing ']' to be missing, so a trace from a run that died
+// halfway is still loadable in perfetto or chrome://tracing.
+namespace trace
+{
+	static std::mutex lock;
+	static FILE* out = 0;
+	static bool active = false;
+	static bool first = true;
+
+	static uint64_t startNs = 0;
+
+	static std::atomic<int> threadCounter = 0;
+
+	struct ThreadInfo
+	{
+		int id = threadCounter++;
+		bool named = false;
+	};
+
+	static thread_local ThreadInfo thread;
+
+	static uint64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static void emit(pj::object& ev)
+	{
+		ev["pid"] = pj::value(static_cast<int64_t>(1));
+		ev["tid"] = pj::value(static_cast<int64_t>(thread.id));
+
+		auto line = pj::value(ev).serialise();
+
+		auto lk = std::unique_lock(lock);
+		if(!out)
+			return;
+
+		if(!first)
+			fputs(",\n", out);
+
+		fwrite(line.data(), 1, line.size(), out);
+		first = false;
+	}
+
+	static void emit_thread_name(const std::string& name)
+	{
+		pj::object args;
+		args["name"] = pj::value(name);
+
+		pj::object ev;
+		ev["name"]  = pj::value("thread_name");
+		ev["ph"]    = pj::value("M");
+		ev["args"]  = pj::value(args);
+
+		thread.named = true;
+		emit(ev);
+	}
+
+	static void emit_event(const char* phase, const std::string& name, const char* category, const Args& args)
+	{
+		if(!thread.named)
+			emit_thread_name(thread.id == 0 ? "main" : zpr::sprint("thread %d", thread.id));
+
+		pj::object ev;
+		ev["ph"] = pj::value(phase);
+		ev["ts"] = pj::value((now_ns() - startNs) / 1000.0);
+
+		if(!name.empty())
+			ev["name"] = pj::value(name);
+
+		if(category)
+			ev["cat"] = pj::value(category);
+
+		if(!args.empty())
+		{
+			pj::object obj;
+			for(const auto& [ k, v ] : args)
+				obj[k] = pj::value(v);
+
+			ev["args"] = pj::value(obj);
+		}
+
+		// instant events are scoped to their thread, rather than drawn across the whole process.
+		if(phase[0] == 'i')
+			ev["s"] = pj::value("t");
+
+		emit(ev);
+	}
+
+
+
+
+	bool open(const std::string& path)
+	{
+		auto lk = std::unique_lock(lock);
+		if(out)
+			fclose(out);
+
+		if(out = fopen(path.c_str(), "wb"); !out)
+			return false;
+
+		fputs("[\n", out);
+
+		first = true;
+		startNs = now_ns();
+		active = true;
+		return true;
+	}
+
+	void close()
+	{
+		auto lk = std::unique_lock(lock);
+		if(!out)
+			return;
+
+		fputs("\n]\n", out);
+		fclose(out);
+
+		out = 0;
+		active = false;
+	}
+
+	bool enabled()
+	{
+		return active;
+	}
+
+	void setThreadName(const std::string& name)
+	{
+		if(active)
+			emit_thread_name(name);
+	}
+
+	void begin(const std::string& name, const char* category, const Args& args)
+	{
+		if(active)
+			emit_event("B", name, category, args);
+	}
+
+	void end(const Args& args)
+	{
+		if(active)
+			emit_event("E", "", nullptr, args);
+	}
+
+	void instant(const std::string& name, const char* category, const Args& args)
+	{
+		if(active)
+			emit_event("i", name, category, args);
+	}
+}
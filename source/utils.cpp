@@ -86,6 +86,46 @@ namespace util
 		#endif
 	}
 
+	bool statFile(const std::string& path, FileStat* out)
+	{
+		#ifdef _WIN32
+
+			// there's no inode on windows, so the best we can do is the size and mtime.
+			std::error_code ec;
+			auto sz = std::fs::file_size(path, ec);
+			if(ec) return false;
+
+			auto mt = std::fs::last_write_time(path, ec);
+			if(ec) return false;
+
+			out->dev = 0;
+			out->inode = 0;
+			out->size = sz;
+			out->mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(mt.time_since_epoch()).count();
+
+			return true;
+
+		#else
+
+			struct stat st;
+			if(stat(path.c_str(), &st) != 0)
+				return false;
+
+			out->dev = st.st_dev;
+			out->inode = st.st_ino;
+			out->size = st.st_size;
+
+			#ifdef __APPLE__
+				out->mtime = st.st_mtimespec.tv_sec * 1'000'000'000LL + st.st_mtimespec.tv_nsec;
+			#else
+				out->mtime = st.st_mtim.tv_sec * 1'000'000'000LL + st.st_mtim.tv_nsec;
+			#endif
+
+			return true;
+
+		#endif
+	}
+
 	std::pair<uint8_t*, size_t> readEntireFile(const std::string& path)
 	{
 		auto bad = std::pair(nullptr, 0);;
@@ -105,6 +145,36 @@ namespace util
 		return std::pair(buf, sz);
 	}
 
+	bool parseByteSize(const std::string& s, uint64_t* out)
+	{
+		char* end = nullptr;
+		auto n = strtod(s.c_str(), &end);
+
+		if(s.empty() || end == s.c_str() || !(n >= 0) || s[0] == '-')
+			return false;
+
+		uint64_t unit = 1024 * 1024;
+		switch(*end)
+		{
+			case 'k': case 'K': unit = 1024ULL; break;
+			case 'm': case 'M': unit = 1024ULL * 1024; break;
+			case 'g': case 'G': unit = 1024ULL * 1024 * 1024; break;
+			case 't': case 'T': unit = 1024ULL * 1024 * 1024 * 1024; break;
+			case 0: break;
+			default: return false;
+		}
+
+		// allow "2GB" and "2GiB" too.
+		if(*end != 0 && (!strcmp(end + 1, "") || !strcmp(end + 1, "B") || !strcmp(end + 1, "iB")))
+			end += strlen(end);
+
+		if(*end != 0)
+			return false;
+
+		*out = static_cast<uint64_t>(n * unit);
+		return true;
+	}
+
 	std::wstring corruptUTF8ToWChar(const std::string& str)
 	{
 		// give us UTF-8.
@@ -193,26 +263,4 @@ namespace util
 #else
 	#pragma GCC diagnostic pop
 #endif
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-	static int log_indent = 0;
-	void indent_log(int n)    { log_indent += n; }
-	void unindent_log(int n)  { log_indent = std::max(0, log_indent - n); }
-	int get_log_indent()      { return log_indent; }
 }